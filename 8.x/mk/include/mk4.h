@@ -220,6 +220,13 @@ bool operator == (const t4_i64 a_, const t4_i64 b_);
 bool operator < (const t4_i64 a_, const t4_i64 b_);
 #endif 
 
+#if q4_LONG64 || defined (LONG_LONG) || HAVE_LONG_LONG
+typedef t4_i64 t4_off; // file positions are 64b whenever possible
+#define q4_LARGEFILE 1
+#else 
+typedef t4_i32 t4_off; // no native 64b ints, so files are limited to 2 Gb
+#endif 
+
 //---------------------------------------------------------------------------
 
 class c4_View {
@@ -536,6 +543,7 @@ class c4_Storage: public c4_View {
 
     void SetStructure(const char*);
     bool AutoCommit(bool = true);
+    int ParallelCommit(int = 4);
     c4_Strategy &Strategy()const;
     const char *Description(const char * = 0);
 
@@ -788,15 +796,15 @@ class c4_Strategy {
     virtual ~c4_Strategy();
 
     virtual bool IsValid()const;
-    virtual int DataRead(t4_i32, void *, int);
-    virtual void DataWrite(t4_i32, const void *, int);
-    virtual void DataCommit(t4_i32);
+    virtual int DataRead(t4_off, void *, int);
+    virtual void DataWrite(t4_off, const void *, int);
+    virtual void DataCommit(t4_off);
     virtual void ResetFileMapping();
-    virtual t4_i32 FileSize();
+    virtual t4_off FileSize();
     virtual t4_i32 FreshGeneration();
 
-    void SetBase(t4_i32);
-    t4_i32 EndOfData(t4_i32 =  - 1);
+    void SetBase(t4_off);
+    t4_off EndOfData(t4_off =  - 1);
 
     /// True if the storage format is not native (default is false)
     bool _bytesFlipped;
@@ -805,11 +813,11 @@ class c4_Strategy {
     /// First byte in file mapping, zero if not active
     const t4_byte *_mapStart;
     /// Number of bytes filled with active data
-    t4_i32 _dataSize;
+    t4_off _dataSize;
     /// All file positions are relative to this offset
-    t4_i32 _baseOffset;
+    t4_off _baseOffset;
     /// The root position of the shallow tree walks
-    t4_i32 _rootPos;
+    t4_off _rootPos;
     /// The size of the root column
     t4_i32 _rootLen;
 };
@@ -40,15 +40,15 @@ class c4_FileStrategy: public c4_Strategy {
     /// Open a data file by name
     virtual bool DataOpen(const char *fileName_, int mode_);
     /// Read a number of bytes
-    virtual int DataRead(t4_i32 pos_, void *buffer_, int length_);
+    virtual int DataRead(t4_off pos_, void *buffer_, int length_);
     /// Write a number of bytes, return true if successful
-    virtual void DataWrite(t4_i32 pos_, const void *buffer_, int length_);
+    virtual void DataWrite(t4_off pos_, const void *buffer_, int length_);
     /// Flush and truncate file
-    virtual void DataCommit(t4_i32 newSize_);
+    virtual void DataCommit(t4_off newSize_);
     /// Support for memory-mapped files
     virtual void ResetFileMapping();
     /// Report total size of the datafile
-    virtual t4_i32 FileSize();
+    virtual t4_off FileSize();
     /// Return a good value to use as fresh generation counter
     virtual t4_i32 FreshGeneration();
 
@@ -59,6 +59,105 @@ class c4_FileStrategy: public c4_Strategy {
     FILE *_cleanup;
 };
 
+/////////////////////////////////////////////////////////////////////////////
+/// A POSIX strategy does positioned I/O on the file descriptor.
+//
+//  Reads and writes use pread and pwrite, bypassing the stdio buffer and the
+//  seek it needs, so that reads do not disturb each other.  Writes which are
+//  adjacent (as most of those in a commit are) get merged in a buffer before
+//  they are issued.  Each DataCommit flushes the buffer and then, if the
+//  _syncCommits flag is set, waits with fdatasync until the data is on disk.
+//  Where pread and pwrite are not available, stdio is used instead.
+
+class c4_PosixStrategy: public c4_FileStrategy {
+  public:
+    /// Construct a new strategy object
+    c4_PosixStrategy(FILE *file_ = 0);
+    virtual ~c4_PosixStrategy();
+
+    /// Read a number of bytes
+    virtual int DataRead(t4_off pos_, void *buffer_, int length_);
+    /// Write a number of bytes, merging them with adjacent ones
+    virtual void DataWrite(t4_off pos_, const void *buffer_, int length_);
+    /// Flush buffered writes and sync them to disk
+    virtual void DataCommit(t4_off newSize_);
+    /// Support for memory-mapped files
+    virtual void ResetFileMapping();
+    /// Report total size of the datafile, including buffered writes
+    virtual t4_off FileSize();
+
+    /// Issue all buffered writes to the file
+    void FlushWrites();
+
+    /// Set to false to only flush, and leave syncing to the OS
+    bool _syncCommits;
+
+  private:
+    void WriteThrough(t4_off pos_, const void *buffer_, int length_);
+
+    t4_byte *_buffer;
+    t4_off _bufPos;
+    int _bufFill;
+    bool _unsynced;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// A log strategy turns each commit into one append to a write-ahead log.
+//
+//  Writes go to a sidecar file named "<datafile>-log" and are kept in memory
+//  as an overlay on top of the datafile, which stays unchanged until the log
+//  is folded back into it by Checkpoint.  This happens automatically once
+//  the log grows beyond _checkpointSize bytes, when the datafile is opened
+//  in a writable mode, and when the strategy is destroyed.  Transactions
+//  which were not completely logged before a crash are ignored on replay.
+//  The writes of a transaction are held apart until its commit record has
+//  been synced to disk, a failed commit leaves the overlay as it was.
+
+class c4_LogPages; // not defined here
+
+class c4_LogStrategy: public c4_FileStrategy {
+  public:
+    /// Construct a new strategy object
+    c4_LogStrategy();
+    virtual ~c4_LogStrategy();
+
+    /// Open a data file and its log by name, replaying all logged commits
+    virtual bool DataOpen(const char *fileName_, int mode_);
+    /// Read a number of bytes, including changes not yet checkpointed
+    virtual int DataRead(t4_off pos_, void *buffer_, int length_);
+    /// Add a number of bytes to the current transaction
+    virtual void DataWrite(t4_off pos_, const void *buffer_, int length_);
+    /// Append the current transaction to the log, or drop it if size < 0
+    virtual void DataCommit(t4_off newSize_);
+    /// Memory-mapping is suspended while the log holds changes
+    virtual void ResetFileMapping();
+    /// Report total size of the datafile, including changes in the log
+    virtual t4_off FileSize();
+
+    /// Fold all logged changes into the datafile, then empty the log
+    bool Checkpoint();
+
+    /// The log is checkpointed after a commit once it is this large
+    t4_off _checkpointSize;
+
+  protected:
+    /// Pointer to the log file, if open
+    FILE *_log;
+
+  private:
+    bool ReplayLog(int mode_);
+    void LogWrite(const void *buffer_, int length_);
+    bool ResetLog();
+    void DropTransaction();
+    bool HasOverlay()const;
+
+    c4_LogPages *_pages;
+    c4_LogPages *_txPages;
+    t4_off _logEnd;
+    t4_off _txBytes;
+    unsigned long _txCheck;
+};
+
 /////////////////////////////////////////////////////////////////////////////
 
 #endif // __MK4IO_H__
@@ -93,7 +93,7 @@ class SiasStrategy: public c4_Strategy {
         _dataSize = 0;
     }
 
-    virtual int DataRead(t4_i32 pos_, void *buffer_, int length_) {
+    virtual int DataRead(t4_off pos_, void *buffer_, int length_) {
         int i = 0;
 
         while (i < length_) {
@@ -108,13 +108,13 @@ class SiasStrategy: public c4_Strategy {
         return i;
     }
 
-    virtual void DataWrite(t4_i32 pos_, const void *buffer_, int length_) {
+    virtual void DataWrite(t4_off pos_, const void *buffer_, int length_) {
         c4_Bytes data(buffer_, length_);
         if (!_memo(_view[_row]).Modify(data, pos_))
           ++_failure;
     }
 
-    virtual void DataCommit(t4_i32 newSize_) {
+    virtual void DataCommit(t4_off newSize_) {
         if (newSize_ > 0)
           _memo(_view[_row]).Modify(c4_Bytes(), newSize_);
     }
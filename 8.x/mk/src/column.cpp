@@ -137,7 +137,7 @@ void c4_Column::ReleaseAllSegments() {
 }
 
 //@func Define where data is on file, or setup buffers (opt cleared).
-void c4_Column::SetLocation(t4_i32 pos_, t4_i32 size_) {
+void c4_Column::SetLocation(t4_off pos_, t4_i32 size_) {
   d4_assert(size_ > 0 || pos_ == 0);
 
   ReleaseAllSegments();
@@ -159,7 +159,7 @@ void c4_Column::PullLocation(const t4_byte * &ptr_) {
   _size = PullValue(ptr_);
   _position = 0;
   if (_size > 0) {
-    _position = PullValue(ptr_);
+    _position = PullLong(ptr_);
     if (_position > 0) {
       d4_assert(_persist != 0);
       _persist->OccupySpace(_position, _size);
@@ -232,7 +232,7 @@ void c4_Column::SetupSegments() {
     }
   } else {
     int chunk = kSegMax;
-    t4_i32 pos = _position;
+    t4_off pos = _position;
 
     // allocate buffers, load them if necessary
     for (int i = 0; i < n; ++i) {
@@ -690,7 +690,7 @@ void c4_Column::FinishSlack() {
   }
 }
 
-void c4_Column::SaveNow(c4_Strategy &strategy_, t4_i32 pos_) {
+void c4_Column::SaveNow(c4_Strategy &strategy_, t4_off pos_) {
   if (_segments.GetSize() == 0)
     SetupSegments();
 
@@ -705,6 +705,27 @@ void c4_Column::SaveNow(c4_Strategy &strategy_, t4_i32 pos_) {
   }
 }
 
+void c4_Column::MoveDataTo(c4_Column &dest_) {
+  d4_assert(dest_._segments.GetSize() == 0);
+
+  if (_segments.GetSize() == 0)
+    SetupSegments();
+
+  // the segments now belong to dest_, including any mapped ones
+  int n = _segments.GetSize();
+  dest_._segments.SetSize(n);
+  for (int i = 0; i < n; ++i)
+    dest_._segments.SetAt(i, _segments.GetAt(i));
+
+  dest_._size = _size;
+  dest_._gap = _gap;
+  dest_._slack = _slack;
+
+  _segments.SetSize(0);
+  _gap = 0;
+  _slack = 0;
+}
+
 const t4_byte *c4_Column::FetchBytes(t4_i32 pos_, int len_, c4_Bytes &buffer_,
   bool forceCopy_) {
   d4_assert(len_ > 0);
@@ -789,6 +810,46 @@ void c4_Column::PushValue(t4_byte * &ptr_, t4_i32 v_) {
   }
 }
 
+/*
+PushLong and PullLong are the same encoding, extended to the full width
+of file offsets.  Values which fit in 32 bits are represented exactly as
+with PushValue, so file positions in existing datafiles remain valid.
+ */
+
+t4_off c4_Column::PullLong(const t4_byte * &ptr_) {
+  t4_off mask =  *ptr_ ? 0 : ~0;
+
+  t4_off v = 0;
+  for (;;) {
+    v = (v << 7) +  *ptr_;
+    if (*ptr_++ &0x80)
+      break;
+  }
+
+  return mask ^ (v - 0x80); // oops, last byte had bit 7 set
+}
+
+void c4_Column::PushLong(t4_byte * &ptr_, t4_off v_) {
+  if (v_ < 0) {
+    v_ = ~v_;
+    *ptr_++ = 0;
+  }
+
+  int n = 0;
+  do {
+    n += 7;
+  } while (n < (int)(8 *sizeof v_) && (v_ >> n));
+
+  while (n) {
+    n -= 7;
+    t4_byte b = (t4_byte)((v_ >> n) &0x7F);
+    if (!n)
+      b |= 0x80;
+    // set bit 7 on the last byte
+    *ptr_++ = b;
+  }
+}
+
 void c4_Column::InsertData(t4_i32 index_, t4_i32 count_, bool clear_) {
   d4_assert(index_ <= ColSize());
 
@@ -23,7 +23,7 @@ class c4_Strategy; // not defined here
 
 class c4_Column {
     c4_PtrArray _segments;
-    t4_i32 _position;
+    t4_off _position;
     t4_i32 _size;
     c4_Persist *_persist;
     t4_i32 _gap;
@@ -42,14 +42,14 @@ class c4_Column {
     //: Returns persistence manager for this column, or zero.
     c4_Strategy &Strategy()const;
     //: Returns the associated strategy pointer.
-    t4_i32 Position()const;
+    t4_off Position()const;
     //: Special access for the DUMP program.
     t4_i32 ColSize()const;
     //: Returns the number of bytes as stored on disk.
     bool IsDirty()const;
     //: Returns true if contents needs to be saved.
 
-    void SetLocation(t4_i32, t4_i32);
+    void SetLocation(t4_off, t4_i32);
     //: Sets the position and size of this column on file.
     void PullLocation(const t4_byte * &ptr_);
     //: Extract position and size of this column.
@@ -64,8 +64,10 @@ class c4_Column {
     //: Grows the buffer by inserting space.
     void Shrink(t4_i32, t4_i32);
     //: Shrinks the buffer by removing space.
-    void SaveNow(c4_Strategy &, t4_i32 pos_);
+    void SaveNow(c4_Strategy &, t4_off pos_);
     //: Save the buffer to file.
+    void MoveDataTo(c4_Column &dest_);
+    //: Hands the loaded buffer over to another column, for deferred saves.
 
     const t4_byte *FetchBytes(t4_i32 pos_, int len_, c4_Bytes &buffer_, bool
       forceCopy_);
@@ -78,6 +80,8 @@ class c4_Column {
 
     static t4_i32 PullValue(const t4_byte * &ptr_);
     static void PushValue(t4_byte * &ptr_, t4_i32 v_);
+    static t4_off PullLong(const t4_byte * &ptr_);
+    static void PushLong(t4_byte * &ptr_, t4_off v_);
 
     void InsertData(t4_i32 index_, t4_i32 count_, bool clear_);
     void RemoveData(t4_i32 index_, t4_i32 count_);
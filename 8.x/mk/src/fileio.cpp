@@ -3,9 +3,14 @@
 // This is part of Metakit, see http://www.equi4.com/metakit.html
 
 /** @file
- * Implementation of c4_FileStrategy and c4_FileStream
+ * Implementation of c4_FileStream and the file strategy classes
  */
 
+// request 64-bit file offsets from stdio on 32-bit Unix systems
+#if !defined (_FILE_OFFSET_BITS) && !defined (_WIN32)
+#define _FILE_OFFSET_BITS 64
+#endif 
+
 #include "header.h"
 #include "mk4io.h"
 
@@ -26,8 +31,18 @@
 #endif 
 
 #if q4_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#endif 
+
+// positioned I/O, used by c4_PosixStrategy if available
+#if q4_UNIX && !(defined (q4_CARBON) && q4_CARBON)
+#define d4_PREAD 1
+#else 
+#define d4_PREAD 0
 #endif 
 
 #if q4_WINCE
@@ -162,6 +177,26 @@ static void FinalizeIO() {
 
 #endif 
 
+/////////////////////////////////////////////////////////////////////////////
+//
+//  Plain fseek/ftell are limited to a long, which is 32 bits on Win32 and on
+//  32-bit Unix.  Use the 64-bit variants where they exist, so that datafiles
+//  (and starpacks with a Metakit tail) can grow beyond 2 Gb.
+
+#if q4_LARGEFILE && q4_WIN32 && q4_MSVC && _MSC_VER >= 1400
+#define d4_fseek  _fseeki64
+#define d4_ftell  _ftelli64
+typedef t4_off t4_fpos;
+#elif q4_LARGEFILE && q4_UNIX && !(defined (q4_CARBON) && q4_CARBON)
+#define d4_fseek  fseeko
+#define d4_ftell  ftello
+typedef off_t t4_fpos;
+#else 
+#define d4_fseek  fseek
+#define d4_ftell  ftell
+typedef long t4_fpos;
+#endif 
+
 /////////////////////////////////////////////////////////////////////////////
 
 #if q4_CHECK
@@ -221,15 +256,15 @@ bool c4_FileStrategy::IsValid()const {
   return _file != 0;
 }
 
-t4_i32 c4_FileStrategy::FileSize() {
+t4_off c4_FileStrategy::FileSize() {
   d4_assert(_file != 0);
 
-  long size =  - 1;
+  t4_off size =  - 1;
 
-  long old = ftell(_file);
-  if (old >= 0 && fseek(_file, 0, 2) == 0) {
-    long pos = ftell(_file);
-    if (fseek(_file, old, 0) == 0)
+  t4_fpos old = d4_ftell(_file);
+  if (old >= 0 && d4_fseek(_file, 0, 2) == 0) {
+    t4_fpos pos = d4_ftell(_file);
+    if (d4_fseek(_file, old, 0) == 0)
       size = pos;
   }
 
@@ -255,15 +290,22 @@ void c4_FileStrategy::ResetFileMapping() {
   }
 
   if (_file != 0) {
-    t4_i32 len = FileSize();
+    t4_off len = FileSize();
 
-    if (len > 0) {
+    // a file which does not fit in the address space is not mapped at all
+    if (len > 0 && (t4_off)(size_t)len == len) {
       FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(_file)));
+#if q4_LARGEFILE
+      DWORD lenHigh = (DWORD)(len >> 32);
+#else 
+      DWORD lenHigh = 0;
+#endif 
       HANDLE h = ::CreateFileMapping((HANDLE)_get_osfhandle(_fileno(_file)), 0,
-        PAGE_READONLY, 0, len, 0);
+        PAGE_READONLY, lenHigh, (DWORD)len, 0);
 
       if (h) {
-        _mapStart = (t4_byte*)::MapViewOfFile(h, FILE_MAP_READ, 0, 0, len);
+        _mapStart = (t4_byte*)::MapViewOfFile(h, FILE_MAP_READ, 0, 0, (size_t)
+          len);
 
         if (_mapStart != 0) {
           _mapStart += _baseOffset;
@@ -278,17 +320,18 @@ void c4_FileStrategy::ResetFileMapping() {
 #elif HAVE_MMAP && !NO_MMAP
   if (_mapStart != 0) {
     _mapStart -= _baseOffset;
-    munmap((char*)_mapStart, _baseOffset + _dataSize); // also loses const
+    munmap((char*)_mapStart, (size_t)(_baseOffset + _dataSize)); // loses const
     _mapStart = 0;
     _dataSize = 0;
   }
 
   if (_file != 0) {
-    t4_i32 len = FileSize();
+    t4_off len = FileSize();
 
-    if (len > 0) {
-      _mapStart = (const t4_byte*)mmap(0, len, PROT_READ, MAP_SHARED, fileno
-        (_file), 0);
+    // a file which does not fit in the address space is not mapped at all
+    if (len > 0 && (t4_off)(size_t)len == len) {
+      _mapStart = (const t4_byte*)mmap(0, (size_t)len, PROT_READ, MAP_SHARED,
+        fileno(_file), 0);
       if (_mapStart != (void*) - 1L) {
         _mapStart += _baseOffset;
         _dataSize = len - _baseOffset;
@@ -360,16 +403,16 @@ bool c4_FileStrategy::DataOpen(const char *fname_, int mode_) {
   return false;
 }
 
-int c4_FileStrategy::DataRead(t4_i32 pos_, void *buf_, int len_) {
+int c4_FileStrategy::DataRead(t4_off pos_, void *buf_, int len_) {
   d4_assert(_baseOffset + pos_ >= 0);
   d4_assert(_file != 0);
 
   //printf("DataRead at %d len %d\n", pos_, len_);
-  return fseek(_file, _baseOffset + pos_, 0) != 0 ?  - 1: (int)fread(buf_, 1,
-    len_, _file);
+  return d4_fseek(_file, (t4_fpos)(_baseOffset + pos_), 0) != 0 ?  - 1: (int)
+    fread(buf_, 1, len_, _file);
 }
 
-void c4_FileStrategy::DataWrite(t4_i32 pos_, const void *buf_, int len_) {
+void c4_FileStrategy::DataWrite(t4_off pos_, const void *buf_, int len_) {
   d4_assert(_baseOffset + pos_ >= 0);
   d4_assert(_file != 0);
 #if 0
@@ -396,20 +439,25 @@ void c4_FileStrategy::DataWrite(t4_i32 pos_, const void *buf_, int len_) {
   //  6-Feb-1999  --  this workaround is not thread safe
   // 30-Nov-2001  --  changed to use the stack so now it is
   // 28-Oct-2002  --  added HP/UX to the mix, to avoid hard lockup
+  // 17-Oct-2026  --  only for data in the map, parallel commits write
+  //                  larger batches from their own buffers
   char tempBuf[4096];
-  d4_assert(len_ <= sizeof tempBuf);
-  buf_ = memcpy(tempBuf, buf_, len_);
+  if (_mapStart != 0 && (const t4_byte*)buf_ >= _mapStart && (const t4_byte*)
+    buf_ < _mapStart + _dataSize) {
+    d4_assert(len_ <= sizeof tempBuf);
+    buf_ = memcpy(tempBuf, buf_, len_);
+  }
 #endif 
 
-  if (fseek(_file, _baseOffset + pos_, 0) != 0 || (int)fwrite(buf_, 1, len_,
-    _file) != len_) {
+  if (d4_fseek(_file, (t4_fpos)(_baseOffset + pos_), 0) != 0 || (int)fwrite
+    (buf_, 1, len_, _file) != len_) {
     _failure = ferror(_file);
     d4_assert(_failure != 0);
     d4_assert(true); // always force an assertion failure in debug mode
   }
 }
 
-void c4_FileStrategy::DataCommit(t4_i32 limit_) {
+void c4_FileStrategy::DataCommit(t4_off limit_) {
   d4_assert(_file != 0);
 
   if (fflush(_file) < 0) {
@@ -435,3 +483,696 @@ void c4_FileStrategy::DataCommit(t4_i32 limit_) {
 }
 
 /////////////////////////////////////////////////////////////////////////////
+// c4_PosixStrategy
+
+enum {
+    kWriteBufSize = 64 * 1024 // writes are merged up to this size
+};
+
+// wait until all data written to a file is on disk, metadata is only
+// synced where it is needed to read the data back (such as file length)
+static void FileSync(FILE *file_) {
+#if q4_WIN32 && !q4_WINCE
+  _commit(_fileno(file_));
+#elif q4_UNIX && defined (_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0 \
+  && !defined (__MACH__)
+  fdatasync(fileno(file_));
+#elif q4_UNIX
+  fsync(fileno(file_));
+#endif 
+}
+
+c4_PosixStrategy::c4_PosixStrategy(FILE *file_): c4_FileStrategy(file_),
+  _syncCommits(true), _buffer(0), _bufPos(0), _bufFill(0), _unsynced(false){}
+
+c4_PosixStrategy::~c4_PosixStrategy() {
+  if (_file != 0)
+    FlushWrites();
+  delete [] _buffer;
+}
+
+void c4_PosixStrategy::WriteThrough(t4_off pos_, const void *buf_, int len_) {
+  d4_assert(_baseOffset + pos_ >= 0);
+  d4_assert(_file != 0);
+
+  _unsynced = true;
+
+#if d4_PREAD
+  const char *ptr = (const char*)buf_;
+  off_t off = (off_t)(_baseOffset + pos_);
+
+  while (len_ > 0) {
+    ssize_t n = pwrite(fileno(_file), ptr, len_, off);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      _failure = n < 0 ? errno : - 1;
+      d4_assert(_failure != 0);
+      return ;
+    }
+    ptr += n;
+    off += n;
+    len_ -= (int)n;
+  }
+#else 
+  c4_FileStrategy::DataWrite(pos_, buf_, len_);
+#endif 
+}
+
+void c4_PosixStrategy::FlushWrites() {
+  if (_bufFill > 0) {
+    int n = _bufFill;
+    _bufFill = 0;
+    WriteThrough(_bufPos, _buffer, n);
+  }
+}
+
+int c4_PosixStrategy::DataRead(t4_off pos_, void *buf_, int len_) {
+  d4_assert(_baseOffset + pos_ >= 0);
+  d4_assert(_file != 0);
+
+  // reads are rare during a commit, so simply flush if they overlap
+  if (_bufFill > 0 && pos_ < _bufPos + _bufFill && _bufPos < pos_ + len_)
+    FlushWrites();
+
+#if d4_PREAD
+  char *ptr = (char*)buf_;
+  off_t off = (off_t)(_baseOffset + pos_);
+  int total = 0;
+
+  while (total < len_) {
+    ssize_t n = pread(fileno(_file), ptr + total, len_ - total, off + total);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return total > 0 ? total : - 1;
+    if (n == 0)
+      break;
+    total += (int)n;
+  }
+
+  return total;
+#else 
+  return c4_FileStrategy::DataRead(pos_, buf_, len_);
+#endif 
+}
+
+void c4_PosixStrategy::DataWrite(t4_off pos_, const void *buf_, int len_) {
+  d4_assert(_file != 0);
+
+  // merge with the buffer if this extends or overwrites what is in it
+  if (_bufFill > 0 && _bufPos <= pos_ && pos_ <= _bufPos + _bufFill && pos_ +
+    len_ <= _bufPos + kWriteBufSize) {
+    int off = (int)(pos_ - _bufPos);
+    memcpy(_buffer + off, buf_, len_);
+    if (_bufFill < off + len_)
+      _bufFill = off + len_;
+    return ;
+  }
+
+  FlushWrites();
+
+  if (len_ >= kWriteBufSize)
+    WriteThrough(pos_, buf_, len_);
+  else {
+    if (_buffer == 0)
+      _buffer = d4_new t4_byte[kWriteBufSize];
+
+    memcpy(_buffer, buf_, len_);
+    _bufPos = pos_;
+    _bufFill = len_;
+  }
+}
+
+void c4_PosixStrategy::DataCommit(t4_off limit_) {
+  d4_assert(_file != 0);
+
+  FlushWrites();
+  if (_failure != 0)
+    return ;
+
+#if !d4_PREAD
+  if (fflush(_file) < 0) {
+    _failure = ferror(_file);
+    d4_assert(_failure != 0);
+    return ;
+  }
+#endif 
+
+  // syncing at every commit point also orders the writes: all data is on
+  // disk before the header which refers to it is written over
+  if (_syncCommits && _unsynced)
+    FileSync(_file);
+  _unsynced = false;
+
+  if (limit_ > 0)
+    ResetFileMapping(); // remap, since file length may have changed
+}
+
+void c4_PosixStrategy::ResetFileMapping() {
+  // never map beyond the data which is actually in the file
+  if (_file != 0)
+    FlushWrites();
+  c4_FileStrategy::ResetFileMapping();
+}
+
+t4_off c4_PosixStrategy::FileSize() {
+  d4_assert(_file != 0);
+
+#if d4_PREAD
+  struct stat sb;
+  if (fstat(fileno(_file), &sb) != 0) {
+    _failure = errno;
+    return - 1;
+  }
+  t4_off size = sb.st_size;
+#else 
+  t4_off size = c4_FileStrategy::FileSize();
+#endif 
+
+  if (_bufFill > 0 && size < _baseOffset + _bufPos + _bufFill)
+    size = _baseOffset + _bufPos + _bufFill;
+
+  return size;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// c4_LogStrategy
+//
+//  The log starts with an 8-byte header, followed by transactions.  Each
+//  transaction is a sequence of write records, i.e. an 8-byte absolute file
+//  position, a 4-byte length, and that many data bytes.  It ends with a
+//  commit record: an 8-byte count of the bytes in the transaction, a length
+//  of 0xFFFFFFFF, and a 4-byte Adler-32 checksum of the transaction bytes.
+//  All integers are stored in little-endian byte order.
+
+static const char sLogHeader[] = "MK4LOG\032\001";
+
+enum {
+    kLogHeadSize = 8, kLogRecSize = 12, kLogCommitSize = 16
+};
+
+static void LogPutLong(t4_byte *ptr_, t4_off v_) {
+  for (int i = 0; i < 8; ++i) {
+    ptr_[i] = (t4_byte)v_;
+#if q4_LARGEFILE
+    v_ >>= 8;
+#else 
+    v_ = i < 3 ? v_ >> 8 : 0;
+#endif 
+  }
+}
+
+static t4_off LogGetLong(const t4_byte *ptr_) {
+  t4_off v = 0;
+#if q4_LARGEFILE
+  for (int i = 8; --i >= 0;)
+#else 
+  for (int i = 4; --i >= 0;)
+#endif 
+    v = (v << 8) | ptr_[i];
+  return v;
+}
+
+static void LogPutInt(t4_byte *ptr_, unsigned long v_) {
+  for (int i = 0; i < 4; ++i) {
+    ptr_[i] = (t4_byte)v_;
+    v_ >>= 8;
+  }
+}
+
+static unsigned long LogGetInt(const t4_byte *ptr_) {
+  return ptr_[0] | ((unsigned long)ptr_[1] << 8) | ((unsigned long)ptr_[2] <<
+    16) | ((unsigned long)ptr_[3] << 24);
+}
+
+static unsigned long LogChecksum(unsigned long sum_, const t4_byte *ptr_, int
+  len_) {
+  unsigned long a = sum_ &0xFFFF, b = (sum_ >> 16) &0xFFFF;
+
+  while (len_ > 0) {
+    int n = len_ < 5552 ? len_ : 5552; // the largest n without overflow
+    len_ -= n;
+    while (--n >= 0) {
+      a += *ptr_++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+
+  return (b << 16) | a;
+}
+
+static FILE *LogOpen(const char *fname_, const char *mode_) {
+#if q4_WIN32 && !q4_BORC && !q4_WINCE
+  WCHAR wName[MAX_PATH], wMode[8];
+  MultiByteToWideChar(CP_UTF8, 0, fname_,  - 1, wName, MAX_PATH);
+  MultiByteToWideChar(CP_UTF8, 0, mode_,  - 1, wMode, 8);
+  return _wfopen(wName, wMode);
+#else 
+  FILE *fp = fopen(fname_, mode_);
+#if q4_UNIX
+  if (fp != 0)
+    fcntl(fileno(fp), F_SETFD, FD_CLOEXEC);
+#endif //q4_UNIX
+  return fp;
+#endif //q4_WIN32 && !q4_BORC && !q4_WINCE
+}
+
+//  The overlay keeps all logged data in pages, indexed by page number.
+
+class c4_LogPages {
+  public:
+    enum {
+        kPageBits = 12, kPageSize = 1 << kPageBits
+    };
+
+    c4_String _name; // file name of the log
+    c4_OffsetArray _numbers; // page numbers, in increasing order
+    c4_PtrArray _data; // page contents, each kPageSize bytes
+    t4_off _limit; // end of the logged data, as absolute file position
+
+    c4_LogPages(const char *name_);
+    ~c4_LogPages();
+
+    bool IsEmpty()const;
+    void Clear();
+
+    void Store(FILE *file_, c4_LogPages *base_, t4_off pos_, const t4_byte
+      *buf_, int len_);
+    void Fetch(t4_off pos_, t4_byte *buf_, int len_);
+    void Absorb(c4_LogPages &pages_);
+
+  private:
+    int Lookup(t4_off page_);
+};
+
+c4_LogPages::c4_LogPages(const char *name_): _name(name_), _limit(0){}
+
+c4_LogPages::~c4_LogPages() {
+  Clear();
+}
+
+bool c4_LogPages::IsEmpty()const {
+  return _data.GetSize() == 0;
+}
+
+void c4_LogPages::Clear() {
+  for (int i = 0; i < _data.GetSize(); ++i)
+    delete [](t4_byte*)_data.GetAt(i);
+
+  _numbers.SetSize(0);
+  _data.SetSize(0);
+  _limit = 0;
+}
+
+int c4_LogPages::Lookup(t4_off page_) {
+  // binary search, returns the index of the first page >= page_
+  int lo = 0, hi = _numbers.GetSize();
+  while (lo < hi) {
+    int mid = (lo + hi) >> 1;
+    if (_numbers.GetAt(mid) < page_)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void c4_LogPages::Store(FILE *file_, c4_LogPages *base_, t4_off pos_, const
+  t4_byte *buf_, int len_) {
+  while (len_ > 0) {
+    t4_off page = pos_ >> kPageBits;
+    int offset = (int)(pos_ &(kPageSize - 1));
+    int n = kPageSize - offset;
+    if (n > len_)
+      n = len_;
+
+    int i = Lookup(page);
+    if (i >= _numbers.GetSize() || _numbers.GetAt(i) != page) {
+      // new page, start from what the datafile has there (or zeros)
+      t4_byte *p = d4_new t4_byte[kPageSize];
+      int k = 0;
+      if (d4_fseek(file_, (t4_fpos)(page << kPageBits), 0) == 0)
+        k = (int)fread(p, 1, kPageSize, file_);
+      if (k < 0)
+        k = 0;
+      memset(p + k, 0, kPageSize - k);
+      if (base_ != 0)
+        base_->Fetch(page << kPageBits, p, kPageSize);
+
+      _numbers.InsertAt(i, page);
+      _data.InsertAt(i, p);
+    }
+
+    memcpy((t4_byte*)_data.GetAt(i) + offset, buf_, n);
+
+    pos_ += n;
+    buf_ += n;
+    len_ -= n;
+  }
+
+  if (_limit < pos_)
+    _limit = pos_;
+}
+
+void c4_LogPages::Fetch(t4_off pos_, t4_byte *buf_, int len_) {
+  int i = Lookup(pos_ >> kPageBits);
+
+  while (len_ > 0 && i < _numbers.GetSize()) {
+    t4_off start = _numbers.GetAt(i) << kPageBits;
+    if (start >= pos_ + len_)
+      break;
+
+    // copy the overlapping part of this page
+    t4_off from = start > pos_ ? start : pos_;
+    t4_off to = start + kPageSize < pos_ + len_ ? start + kPageSize : pos_ +
+      len_;
+    memcpy(buf_ + (int)(from - pos_), (t4_byte*)_data.GetAt(i) + (int)(from -
+      start), (int)(to - from));
+    ++i;
+  }
+}
+
+void c4_LogPages::Absorb(c4_LogPages &pages_) {
+  // take over all pages, they replace the ones we have for the same range
+  for (int j = 0; j < pages_._data.GetSize(); ++j) {
+    t4_off page = pages_._numbers.GetAt(j);
+    int i = Lookup(page);
+    if (i < _numbers.GetSize() && _numbers.GetAt(i) == page) {
+      delete [](t4_byte*)_data.GetAt(i);
+      _data.SetAt(i, pages_._data.GetAt(j));
+    } else {
+      _numbers.InsertAt(i, page);
+      _data.InsertAt(i, pages_._data.GetAt(j));
+    }
+  }
+
+  if (_limit < pages_._limit)
+    _limit = pages_._limit;
+
+  pages_._numbers.SetSize(0);
+  pages_._data.SetSize(0);
+  pages_._limit = 0;
+}
+
+c4_LogStrategy::c4_LogStrategy(): _checkpointSize(4 *1024 * 1024), _log(0),
+  _pages(0), _txPages(0), _logEnd(0), _txBytes(0), _txCheck(1){}
+
+c4_LogStrategy::~c4_LogStrategy() {
+  // an unfinished transaction is dropped, as if a crash had happened
+  if (_log != 0) {
+    DropTransaction();
+    Checkpoint();
+    fclose(_log);
+  }
+
+  delete _txPages;
+  _txPages = 0;
+  delete _pages;
+  _pages = 0;
+}
+
+bool c4_LogStrategy::DataOpen(const char *fname_, int mode_) {
+  d4_assert(_pages == 0);
+  _pages = d4_new c4_LogPages(c4_String(fname_) + "-log");
+  _txPages = d4_new c4_LogPages(_pages->_name);
+
+  bool existed = c4_FileStrategy::DataOpen(fname_, mode_);
+  if (!IsValid())
+    return false;
+
+  _log = LogOpen(_pages->_name, mode_ > 0 ? "r+b" : "rb");
+  if (_log == 0 && mode_ > 0)
+    _log = LogOpen(_pages->_name, "w+b");
+
+  if (!ReplayLog(mode_)) {
+    // not a log, or a damaged one: refuse to touch the datafile
+    if (_log != 0)
+      fclose(_log);
+    _log = 0;
+    _pages->Clear();
+    _file = 0;
+    ResetFileMapping();
+    fclose(_cleanup);
+    _cleanup = 0;
+    return false;
+  }
+
+  return existed;
+}
+
+bool c4_LogStrategy::ReplayLog(int mode_) {
+  if (_log == 0)
+    return true;
+  // read-only, and there is no log
+
+  t4_byte head[kLogCommitSize];
+  int n = d4_fseek(_log, 0, 0) == 0 ? (int)fread(head, 1, kLogHeadSize, _log):
+     - 1;
+  if (n == 0 && mode_ > 0)
+    return ResetLog();
+  // new log
+
+  if (n != kLogHeadSize || memcmp(head, sLogHeader, kLogHeadSize) != 0)
+    return false;
+
+  // first pass: find the end of the last complete transaction
+  t4_off good = kLogHeadSize, pos = kLogHeadSize, count = 0;
+  unsigned long check = 1;
+  c4_Bytes buffer;
+
+  while (fread(head, 1, kLogRecSize, _log) == kLogRecSize) {
+    unsigned long len = LogGetInt(head + 8);
+    if (len == 0xFFFFFFFF) {
+      if (fread(head + kLogRecSize, 1, 4, _log) != 4 || LogGetLong(head) !=
+        count || LogGetInt(head + kLogRecSize) != check)
+        break;
+
+      pos += kLogCommitSize;
+      good = pos;
+      count = 0;
+      check = 1;
+      continue;
+    }
+
+    if (len > 0x7FFFFFFF)
+      break;
+
+    t4_byte *p = buffer.SetBuffer((int)len);
+    if (fread(p, 1, (int)len, _log) != len)
+      break;
+
+    check = LogChecksum(check, head, kLogRecSize);
+    check = LogChecksum(check, p, (int)len);
+    count += kLogRecSize + len;
+    pos += kLogRecSize + len;
+  }
+
+  // second pass: apply all write records up to that point
+  d4_fseek(_log, kLogHeadSize, 0);
+  for (pos = kLogHeadSize; pos < good;) {
+    fread(head, 1, kLogRecSize, _log);
+    unsigned long len = LogGetInt(head + 8);
+    if (len == 0xFFFFFFFF) {
+      fread(head, 1, 4, _log);
+      pos += kLogCommitSize;
+    } else {
+      t4_byte *p = buffer.SetBuffer((int)len);
+      fread(p, 1, (int)len, _log);
+      _pages->Store(_file, 0, LogGetLong(head), p, (int)len);
+      pos += kLogRecSize + len;
+    }
+  }
+
+  _logEnd = good;
+
+  // fold recovered changes into the datafile right away if we may write
+  if (mode_ > 0)
+    return Checkpoint();
+
+  ResetFileMapping();
+  return true;
+}
+
+bool c4_LogStrategy::ResetLog() {
+  d4_assert(_log != 0);
+
+  // reopening with "w+b" is the portable way to truncate the log
+  fclose(_log);
+  _log = LogOpen(_pages->_name, "w+b");
+  if (_log == 0 || fwrite(sLogHeader, 1, kLogHeadSize, _log) != kLogHeadSize
+    || fflush(_log) < 0)
+    return false;
+
+  _logEnd = kLogHeadSize;
+  return true;
+}
+
+void c4_LogStrategy::DropTransaction() {
+  // the log records are left as a torn transaction, to be overwritten later
+  if (_txPages != 0)
+    _txPages->Clear();
+  _txBytes = 0;
+  _txCheck = 1;
+}
+
+bool c4_LogStrategy::HasOverlay()const {
+  return _pages != 0 && (!_pages->IsEmpty() || !_txPages->IsEmpty());
+}
+
+void c4_LogStrategy::LogWrite(const void *buf_, int len_) {
+  if (fwrite(buf_, 1, len_, _log) != (size_t)len_)
+    _failure = ferror(_log);
+
+  _txCheck = LogChecksum(_txCheck, (const t4_byte*)buf_, len_);
+  _txBytes += len_;
+}
+
+int c4_LogStrategy::DataRead(t4_off pos_, void *buf_, int len_) {
+  if (!HasOverlay())
+    return c4_FileStrategy::DataRead(pos_, buf_, len_);
+
+  int n = c4_FileStrategy::DataRead(pos_, buf_, len_);
+  if (n < 0)
+    n = 0;
+
+  // logged data may extend beyond the end of the datafile
+  t4_off pos = _baseOffset + pos_;
+  t4_off limit = _pages->_limit < _txPages->_limit ? _txPages->_limit :
+    _pages->_limit;
+  if (pos + n < limit) {
+    int k = limit - pos < len_ ? (int)(limit - pos): len_;
+    memset((t4_byte*)buf_ + n, 0, k - n);
+    n = k;
+  }
+
+  // committed changes first, then those of the transaction in progress
+  _pages->Fetch(pos, (t4_byte*)buf_, n);
+  _txPages->Fetch(pos, (t4_byte*)buf_, n);
+  return n;
+}
+
+void c4_LogStrategy::DataWrite(t4_off pos_, const void *buf_, int len_) {
+  d4_assert(_baseOffset + pos_ >= 0);
+  d4_assert(_log != 0);
+
+  // a new transaction starts at the end of the committed part of the log
+  if (_txBytes == 0 && d4_fseek(_log, (t4_fpos)_logEnd, 0) != 0)
+    _failure = ferror(_log);
+
+  t4_byte head[kLogRecSize];
+  LogPutLong(head, _baseOffset + pos_);
+  LogPutInt(head + 8, len_);
+  LogWrite(head, sizeof head);
+  LogWrite(buf_, len_);
+
+  // kept apart until the commit is durable, see DataCommit
+  _txPages->Store(_file, _pages, _baseOffset + pos_, (const t4_byte*)buf_,
+    len_);
+}
+
+void c4_LogStrategy::DataCommit(t4_off limit_) {
+  d4_assert(_log != 0);
+
+  // intermediate flushes only order writes, the log already does that
+  if (limit_ == 0)
+    return ;
+
+  // a failed commit is abandoned, none of its changes may become visible
+  if (limit_ < 0 || _failure != 0) {
+    DropTransaction();
+    ResetFileMapping();
+    return ;
+  }
+
+  if (_txBytes > 0) {
+    t4_byte tail[kLogCommitSize];
+    LogPutLong(tail, _txBytes);
+    LogPutInt(tail + 8, 0xFFFFFFFF);
+    LogPutInt(tail + kLogRecSize, _txCheck);
+
+    if (fwrite(tail, 1, sizeof tail, _log) != sizeof tail || fflush(_log) < 0)
+    {
+      _failure = ferror(_log);
+      d4_assert(_failure != 0);
+      DropTransaction();
+      ResetFileMapping();
+      return ;
+    }
+
+    // the commit is only done once its log record has reached the disk
+    FileSync(_log);
+
+    _logEnd += _txBytes + kLogCommitSize;
+    _pages->Absorb(*_txPages);
+    _txBytes = 0;
+    _txCheck = 1;
+  }
+
+  ResetFileMapping(); // the datafile no longer has the latest data
+
+  if (_logEnd > _checkpointSize)
+    Checkpoint();
+}
+
+void c4_LogStrategy::ResetFileMapping() {
+  if (!HasOverlay()) {
+    c4_FileStrategy::ResetFileMapping();
+    return ;
+  }
+
+  // unmap, but don't map again while the log holds changes
+  FILE *save = _file;
+  _file = 0;
+  c4_FileStrategy::ResetFileMapping();
+  _file = save;
+}
+
+t4_off c4_LogStrategy::FileSize() {
+  t4_off size = c4_FileStrategy::FileSize();
+  if (_pages != 0 && size >= 0) {
+    if (size < _pages->_limit)
+      size = _pages->_limit;
+    if (size < _txPages->_limit)
+      size = _txPages->_limit;
+  }
+  return size;
+}
+
+bool c4_LogStrategy::Checkpoint() {
+  if (_log == 0 || _txBytes > 0)
+    return false;
+  // can't checkpoint in the middle of a transaction
+
+  if (_logEnd <= kLogHeadSize && _pages->IsEmpty())
+    return true;
+
+  for (int i = 0; i < _pages->_data.GetSize(); ++i) {
+    t4_off start = _pages->_numbers.GetAt(i) << c4_LogPages::kPageBits;
+    int n = c4_LogPages::kPageSize;
+    if (n > _pages->_limit - start)
+      n = (int)(_pages->_limit - start);
+
+    if (d4_fseek(_file, (t4_fpos)start, 0) != 0 || (int)fwrite
+      (_pages->_data.GetAt(i), 1, n, _file) != n) {
+      _failure = ferror(_file);
+      return false;
+    }
+  }
+
+  // the datafile must be safely on disk before the log can go
+  if (fflush(_file) < 0) {
+    _failure = ferror(_file);
+    return false;
+  }
+  FileSync(_file);
+
+  _pages->Clear();
+  ResetFileMapping();
+
+  return ResetLog();
+}
+
+/////////////////////////////////////////////////////////////////////////////
@@ -253,6 +253,7 @@ class c4_FormatB: public c4_FormatHandler {
     virtual void Define(int, const t4_byte **);
     virtual void OldDefine(char type_, c4_Persist &);
     virtual void Commit(c4_SaveContext &ar_);
+    virtual bool Encode(c4_SaveContext &ar_);
 
     virtual int ItemSize(int index_);
     virtual const void *Get(int index_, int &length_);
@@ -277,6 +278,7 @@ class c4_FormatB: public c4_FormatHandler {
     int ItemLenOffCol(int index_, t4_i32 &off_, c4_Column * &col_);
     bool CommitItem(c4_SaveContext &ar_, int index_);
     void InitOffsets(c4_ColOfInts &sizes_);
+    bool NeedsFullCommit(c4_SaveContext &ar_)const;
 
     c4_Column _data;
     c4_ColOfInts _sizeCol; // 2001-11-27: keep, to track position on disk
@@ -284,13 +286,15 @@ class c4_FormatB: public c4_FormatHandler {
     c4_DWordArray _offsets;
     c4_PtrArray _memos;
     bool _recalc; // 2001-11-27: remember when to redo _{size,memo}Col
+    t4_i32 _encoded; // commit for which Encode has redone _sizeCol
+    c4_DWordArray _memoRows; // rows which Encode left for Commit
 };
 
 /////////////////////////////////////////////////////////////////////////////
 
 c4_FormatB::c4_FormatB(const c4_Property &prop_, c4_HandlerSeq &seq_):
   c4_FormatHandler(prop_, seq_), _data(seq_.Persist()), _sizeCol(seq_.Persist())
-  , _memoCol(seq_.Persist()), _recalc(false) {
+  , _memoCol(seq_.Persist()), _recalc(false), _encoded(0) {
   _offsets.SetSize(1, 100);
   _offsets.SetAt(0, 0);
 }
@@ -493,8 +497,8 @@ void c4_FormatB::OldDefine(char type_, c4_Persist &pers_) {
         if (fix)
 #endif 
          {
-          t4_i32 p1 = sizes.Position();
-          t4_i32 p2 = _data.Position();
+          t4_off p1 = sizes.Position();
+          t4_off p2 = _data.Position();
           _data.SetLocation(p1, s1);
           sizes.SetLocation(p2, s2);
         }
@@ -725,34 +729,72 @@ void c4_FormatB::Remove(int index_, int count_) {
   d4_assert(index_ <= _memos.GetSize() + 1);
 }
 
+bool c4_FormatB::NeedsFullCommit(c4_SaveContext &ar_)const {
+  if (_recalc || ar_.Serializing())
+    return true;
+
+  for (int i = 0; i < _memos.GetSize(); ++i)
+    if (_memos.GetAt(i) != 0)
+      return true;
+
+  return false;
+}
+
+bool c4_FormatB::Encode(c4_SaveContext &ar_) {
+  int rows = _memos.GetSize();
+  if (rows == 0 || !NeedsFullCommit(ar_))
+    return false;
+
+  // redo the sizes of all inline items, memos need the walk buffer and are
+  // left to Commit, which runs in the same order as the allocator expects
+  _sizeCol.SetBuffer(0);
+  _sizeCol.SetAccessWidth(0);
+  _sizeCol.SetRowCount(rows);
+  _memoRows.SetSize(0);
+
+  for (int r = 0; r < rows; ++r) {
+    t4_i32 start;
+    c4_Column *col;
+    int len = ItemLenOffCol(r, start, col);
+
+    if (col !=  &_data || ShouldBeMemo(len))
+      _memoRows.Add(r);
+    else
+      _sizeCol.SetInt(r, len);
+  }
+
+  _encoded = ar_.CommitId();
+  return true;
+}
+
 void c4_FormatB::Commit(c4_SaveContext &ar_) {
   int rows = _memos.GetSize();
   d4_assert(rows > 0);
 
-  bool full = _recalc || ar_.Serializing();
-
-  if (!full)
-  for (int i = 0; i < rows; ++i) {
-    c4_Column *col = (c4_Column*)_memos.GetAt(i);
-    if (col != 0) {
-      full = true;
-      break;
-    }
-  }
+  bool full = NeedsFullCommit(ar_);
   d4_assert(_recalc || _sizeCol.RowCount() == rows);
 
   if (full) {
+    // only the rows left over by Encode need to be visited, if it ran
+    bool encoded = _encoded != 0 && _encoded == ar_.CommitId();
+    int n = encoded ? _memoRows.GetSize() : rows;
+
     _memoCol.SetBuffer(0);
-    _sizeCol.SetBuffer(0);
-    _sizeCol.SetAccessWidth(0);
-    _sizeCol.SetRowCount(rows);
+    if (!encoded) {
+      _sizeCol.SetBuffer(0);
+      _sizeCol.SetAccessWidth(0);
+      _sizeCol.SetRowCount(rows);
+    }
 
     int skip = 0;
+    int last =  - 1;
 
     c4_Column *saved = ar_.SetWalkBuffer(&_memoCol);
 
-    for (int r = 0; r < rows; ++r) {
-      ++skip;
+    for (int i = 0; i < n; ++i) {
+      int r = encoded ? (int)_memoRows.GetAt(i): i;
+      skip += r - last;
+      last = r;
 
       t4_i32 start;
       c4_Column *col;
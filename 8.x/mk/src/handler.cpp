@@ -43,6 +43,10 @@ void c4_Handler::Commit(c4_SaveContext &) {
   d4_assert(0);
 }
 
+bool c4_Handler::Encode(c4_SaveContext &) {
+  return false; // nothing to do ahead of time
+}
+
 void c4_Handler::OldDefine(char, c4_Persist &) {
   d4_assert(0);
 }
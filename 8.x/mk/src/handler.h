@@ -38,6 +38,8 @@ class c4_Handler {
     //: Called to reverse the internal byte order of foreign data.
     virtual void Commit(c4_SaveContext &ar_);
     //: Commit the associated column(s) to file.
+    virtual bool Encode(c4_SaveContext &ar_);
+    //: Prepare part of the next Commit ahead of time, on a worker thread.
     virtual void OldDefine(char, c4_Persist &);
 
     const c4_Property &Property()const;
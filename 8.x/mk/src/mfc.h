@@ -13,6 +13,7 @@
 #else 
 #include <afxcoll.h>
 #endif 
+#include <afxtempl.h>
 
 #undef d4_assert
 #define d4_assert ASSERT
@@ -26,6 +27,7 @@
 typedef class CString c4_String;
 typedef class CPtrArray c4_PtrArray;
 typedef class CDWordArray c4_DWordArray;
+typedef CArray < t4_off, t4_off > c4_OffsetArray;
 typedef class CStringArray c4_StringArray;
 
 // MSVC 1.52 thinks a typedef has no constructor, so use a define instead
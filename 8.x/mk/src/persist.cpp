@@ -13,6 +13,19 @@
 #include "store.h"
 #include "field.h"
 
+#include <stdlib.h>   // qsort
+
+#if q4_MULTI
+#if q4_WIN32
+#if q4_MSVC && !q4_STRICT
+#pragma warning(disable: 4201) // nonstandard extension used : ...
+#endif 
+#include <windows.h>
+#else 
+#include <pthread.h>
+#endif 
+#endif 
+
 /////////////////////////////////////////////////////////////////////////////
 
 class c4_FileMark {
@@ -25,15 +38,19 @@ class c4_FileMark {
 
   public:
     c4_FileMark();
-    c4_FileMark(t4_i32 pos_, bool flipped_, bool extend_);
-    c4_FileMark(t4_i32 pos_, int len_);
+    c4_FileMark(t4_off pos_, bool flipped_, bool extend_, bool large_);
+    c4_FileMark(t4_off pos_, int len_, bool large_);
 
-    t4_i32 Offset()const;
+    t4_off Offset()const;
     t4_i32 OldOffset()const;
 
     bool IsHeader()const;
     bool IsOldHeader()const;
     bool IsFlipped()const;
+    bool IsLarge()const;
+
+    static bool NeedsLarge(t4_off pos_);
+    static t4_off MaxOffset();
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -42,21 +59,43 @@ c4_FileMark::c4_FileMark() {
   d4_assert(sizeof *this == 8);
 }
 
-c4_FileMark::c4_FileMark(t4_i32 pos_, bool flipped_, bool extend_) {
+//  Large-file datafiles use the same 8-byte marks, but keep 4 more bits of
+//  each file position in otherwise unused bits: the header has 0x1B instead
+//  of 0x1A (0x0B instead of 0x0A when extending) with bits 32..35 in byte 3,
+//  and tails start with 0xC0 + bits 32..35 instead of 0x80, so the high
+//  nibble of a large tail is always 0xC.  This allows datafiles up to 64 Gb,
+//  while older readers simply reject such files.
+
+c4_FileMark::c4_FileMark(t4_off pos_, bool flipped_, bool extend_, bool large_)
+  {
   d4_assert(sizeof *this == 8);
+  d4_assert(large_ || !NeedsLarge(pos_));
   *(short*)_data = flipped_ ? kReverseFormat : kStorageFormat;
   _data[2] = extend_ ? 0x0A : 0x1A;
   _data[3] = 0;
+  if (large_) {
+    _data[2] |= 0x01;
+#if q4_LARGEFILE
+    _data[3] = (t4_byte)((pos_ >> 32) &0x0F);
+#endif 
+  }
   t4_byte *p = _data + 4;
   for (int i = 24; i >= 0; i -= 8)
     *p++ = (t4_byte)(pos_ >> i);
   d4_assert(p == _data + sizeof _data);
 }
 
-c4_FileMark::c4_FileMark(t4_i32 pos_, int len_) {
+c4_FileMark::c4_FileMark(t4_off pos_, int len_, bool large_) {
   d4_assert(sizeof *this == 8);
+  d4_assert(large_ || !NeedsLarge(pos_));
   t4_byte *p = _data;
   *p++ = 0x80;
+  if (large_) {
+    _data[0] = 0xC0;
+#if q4_LARGEFILE
+    _data[0] |= (t4_byte)((pos_ >> 32) &0x0F);
+#endif 
+  }
   for (int j = 16; j >= 0; j -= 8)
     *p++ = (t4_byte)(len_ >> j);
   for (int i = 24; i >= 0; i -= 8)
@@ -64,8 +103,12 @@ c4_FileMark::c4_FileMark(t4_i32 pos_, int len_) {
   d4_assert(p == _data + sizeof _data);
 }
 
-t4_i32 c4_FileMark::Offset()const {
-  t4_i32 v = 0;
+t4_off c4_FileMark::Offset()const {
+  t4_off v = 0;
+#if q4_LARGEFILE
+  if (IsLarge())
+    v = IsHeader() ? _data[3] &0x0F : _data[0] &0x0F;
+#endif 
   for (int i = 4; i < 8; ++i)
     v = (v << 8) + _data[i];
   return v;
@@ -80,7 +123,7 @@ t4_i32 c4_FileMark::OldOffset()const {
 
 bool c4_FileMark::IsHeader()const {
   return (_data[0] == 'J' || _data[0] == 'L') && (_data[0] ^ _data[1]) == ('J'
-    ^ 'L') && _data[2] == 0x1A;
+    ^ 'L') && (_data[2] == 0x1A || _data[2] == 0x1B);
 }
 
 bool c4_FileMark::IsOldHeader()const {
@@ -92,26 +135,42 @@ bool c4_FileMark::IsFlipped()const {
 
 }
 
+bool c4_FileMark::IsLarge()const {
+  return IsHeader() ? (_data[2] &0x01) != 0 : (_data[0] &0xF0) == 0xC0;
+}
+
+bool c4_FileMark::NeedsLarge(t4_off pos_) {
+  return pos_ > 0x7FFFFFFF;
+}
+
+t4_off c4_FileMark::MaxOffset() {
+#if q4_LARGEFILE
+  return ((t4_off)1 << 36) - 1;
+#else 
+  return 0x7FFFFFFF;
+#endif 
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
-class c4_Allocator: public c4_DWordArray {
+class c4_Allocator: public c4_OffsetArray {
   public:
     c4_Allocator();
 
-    void Initialize(t4_i32 first_ = 1);
+    void Initialize(t4_off first_ = 1);
 
-    t4_i32 AllocationLimit()const;
+    t4_off AllocationLimit()const;
 
-    t4_i32 Allocate(t4_i32 len_);
-    void Occupy(t4_i32 pos_, t4_i32 len_);
-    void Release(t4_i32 pos_, t4_i32 len_);
+    t4_off Allocate(t4_i32 len_);
+    void Occupy(t4_off pos_, t4_off len_);
+    void Release(t4_off pos_, t4_off len_);
     void Dump(const char *str_);
     t4_i32 FreeCounts(t4_i32 *bytes_ = 0);
 
   private:
-    int Locate(t4_i32 pos_)const;
-    void InsertPair(int i_, t4_i32 from_, t4_i32 to_);
-    t4_i32 ReduceFrags(int goal_, int sHi_, int sLo_);
+    int Locate(t4_off pos_)const;
+    void InsertPair(int i_, t4_off from_, t4_off to_);
+    t4_off ReduceFrags(int goal_, int sHi_, int sLo_);
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -143,13 +202,17 @@ c4_Allocator::c4_Allocator() {
   Initialize();
 }
 
-void c4_Allocator::Initialize(t4_i32 first_) {
+void c4_Allocator::Initialize(t4_off first_) {
   SetSize(0, 1000); // empty, and growing in large chunks 
   Add(0); // fake block at start
   Add(0); // ... only used to avoid merging
 
   // if occupied, add a tiny free slot at the end, else add entire range
-  const t4_i32 kMaxInt = 0x7fffffff;
+#if q4_LARGEFILE
+  const t4_off kMaxInt = (t4_off)0x7fffffff << 32;
+#else 
+  const t4_off kMaxInt = 0x7fffffff;
+#endif 
   if (first_ == 0)
     first_ = kMaxInt;
 
@@ -157,12 +220,12 @@ void c4_Allocator::Initialize(t4_i32 first_) {
   Add(kMaxInt); // ... there is no limit on file size
 }
 
-t4_i32 c4_Allocator::Allocate(t4_i32 len_) {
+t4_off c4_Allocator::Allocate(t4_i32 len_) {
   // zero arg is ok, it simply returns first allocatable position   
   for (int i = 2; i < GetSize(); i += 2)
   if (GetAt(i + 1) >= GetAt(i) + len_) {
-    t4_i32 pos = GetAt(i);
-    if ((t4_i32)GetAt(i + 1) > pos + len_)
+    t4_off pos = GetAt(i);
+    if (GetAt(i + 1) > pos + len_)
       ElementAt(i) += len_;
     else
       RemoveAt(i, 2);
@@ -173,7 +236,7 @@ t4_i32 c4_Allocator::Allocate(t4_i32 len_) {
   return 0; // not reached
 }
 
-void c4_Allocator::Occupy(t4_i32 pos_, t4_i32 len_) {
+void c4_Allocator::Occupy(t4_off pos_, t4_off len_) {
   d4_assert(pos_ > 0);
   // note that zero size simply checks if there is any space to extend
 
@@ -182,15 +245,15 @@ void c4_Allocator::Occupy(t4_i32 pos_, t4_i32 len_) {
 
   if (i % 2) {
     // allocation is not at start of free block
-    d4_assert((t4_i32)GetAt(i - 1) < pos_);
+    d4_assert(GetAt(i - 1) < pos_);
 
-    if ((t4_i32)GetAt(i) == pos_ + len_)
+    if (GetAt(i) == pos_ + len_)
     // allocate from end of free block
       SetAt(i, pos_);
     else
     // split free block in two
       InsertPair(i, pos_, pos_ + len_);
-  } else if ((t4_i32)GetAt(i) == pos_)
+  } else if (GetAt(i) == pos_)
   /*
   This side of the if used to be unconditional, but that was
   incorrect if ReduceFrags gets called (which only happens with
@@ -202,7 +265,7 @@ void c4_Allocator::Occupy(t4_i32 pos_, t4_i32 len_) {
    */
    {
     // else extend tail of allocated area
-    if ((t4_i32)GetAt(i + 1) > pos_ + len_)
+    if (GetAt(i + 1) > pos_ + len_)
       ElementAt(i) += len_;
     // move start of next free up
     else
@@ -211,15 +274,15 @@ void c4_Allocator::Occupy(t4_i32 pos_, t4_i32 len_) {
   }
 }
 
-void c4_Allocator::Release(t4_i32 pos, t4_i32 len) {
+void c4_Allocator::Release(t4_off pos, t4_off len) {
   int i = Locate(pos + len);
   d4_assert(0 < i && i < GetSize());
   d4_assert(i % 2 == 0); // don't release inside a free block
 
-  if ((t4_i32)GetAt(i) == pos)
+  if (GetAt(i) == pos)
   // move start of next free down 
     ElementAt(i) -= len;
-  else if ((t4_i32)GetAt(i - 1) == pos)
+  else if (GetAt(i - 1) == pos)
   // move end of previous free up
     ElementAt(i - 1) += len;
   else
@@ -231,37 +294,37 @@ void c4_Allocator::Release(t4_i32 pos, t4_i32 len) {
     RemoveAt(i - 1, 2);
 }
 
-t4_i32 c4_Allocator::AllocationLimit()const {
+t4_off c4_Allocator::AllocationLimit()const {
   d4_assert(GetSize() >= 2);
 
   return GetAt(GetSize() - 2);
 }
 
-int c4_Allocator::Locate(t4_i32 pos)const {
+int c4_Allocator::Locate(t4_off pos)const {
   int lo = 0, hi = GetSize() - 1;
 
   while (lo < hi) {
     int i = (lo + hi) / 2;
-    if (pos < (t4_i32)GetAt(i))
+    if (pos < GetAt(i))
       hi = i - 1;
-    else if (pos > (t4_i32)GetAt(i))
+    else if (pos > GetAt(i))
       lo = i + 1;
     else
       return i;
   }
 
-  return lo < GetSize() && pos > (t4_i32)GetAt(lo) ? lo + 1: lo;
+  return lo < GetSize() && pos > GetAt(lo) ? lo + 1: lo;
 }
 
-void c4_Allocator::InsertPair(int i_, t4_i32 from_, t4_i32 to_) {
+void c4_Allocator::InsertPair(int i_, t4_off from_, t4_off to_) {
   d4_assert(0 < i_);
   d4_assert(i_ < GetSize());
 
   d4_assert(from_ < to_);
-  d4_assert((t4_i32)GetAt(i_ - 1) < from_);
+  d4_assert(GetAt(i_ - 1) < from_);
   //!d4_assert(to_ < GetAt(i_));
 
-  if (to_ >= (t4_i32)GetAt(i_))
+  if (to_ >= GetAt(i_))
     return ;
   // ignore 2nd allocation of used area
 
@@ -273,24 +336,24 @@ void c4_Allocator::InsertPair(int i_, t4_i32 from_, t4_i32 to_) {
     ReduceFrags(5000, 12, 6);
 }
 
-t4_i32 c4_Allocator::ReduceFrags(int goal_, int sHi_, int sLo_) {
+t4_off c4_Allocator::ReduceFrags(int goal_, int sHi_, int sLo_) {
   // drastic fail-safe measure: remove small gaps if vec gets too long
   // this will cause some lost free space but avoids array overflow
   // the lost space will most probably be re-used after the next commit
 
   int limit = GetSize() - 2;
-  t4_i32 loss = 0;
+  t4_off loss = 0;
 
   // go through all entries and remove gaps under the given threshold
   for (int shift = sHi_; shift >= sLo_; --shift) {
     // the threshold is a fraction of the current size of the arena
-    t4_i32 threshold = AllocationLimit() >> shift;
+    t4_off threshold = AllocationLimit() >> shift;
     if (threshold == 0)
       continue;
 
     int n = 2;
     for (int i = n; i < limit; i += 2)
-    if ((t4_i32)GetAt(i + 1) - (t4_i32)GetAt(i) > threshold) {
+    if (GetAt(i + 1) - GetAt(i) > threshold) {
       SetAt(n++, GetAt(i));
       SetAt(n++, GetAt(i + 1));
     } else
@@ -318,7 +381,8 @@ t4_i32 c4_Allocator::ReduceFrags(int goal_, int sHi_, int sLo_) {
 void c4_Allocator::Dump(const char *str_) {
   fprintf(stderr, "c4_Allocator::Dump, %d entries <%s>\n", GetSize(), str_);
   for (int i = 2; i < GetSize(); i += 2)
-    fprintf(stderr, "  %10ld .. %ld\n", GetAt(i - 1), GetAt(i));
+    fprintf(stderr, "  %10.0f .. %.0f\n", (double)GetAt(i - 1), (double)GetAt(i))
+      ;
   fprintf(stderr, "END\n");
 }
 
@@ -330,10 +394,10 @@ void c4_Allocator::Dump(const char *str_){}
 
 t4_i32 c4_Allocator::FreeCounts(t4_i32 *bytes_) {
   if (bytes_ != 0) {
-    t4_i32 total = 0;
+    t4_off total = 0;
     for (int i = 2; i < GetSize() - 2; i += 2)
       total += GetAt(i + 1) - GetAt(i);
-    *bytes_ = total;
+    *bytes_ = total < 0x7FFFFFFF ? (t4_i32)total : 0x7FFFFFFF;
   }
   return GetSize() / 2-2;
 }
@@ -346,8 +410,8 @@ class c4_Differ {
     ~c4_Differ();
 
     int NewDiffID();
-    void CreateDiff(int id_, c4_Column &col_);
-    t4_i32 BaseOfDiff(int id_);
+    bool CreateDiff(int id_, c4_Column &col_);
+    t4_off BaseOfDiff(int id_);
     void ApplyDiff(int id_, c4_Column &col_)const;
 
     void GetRoot(c4_Bytes &buffer_);
@@ -393,7 +457,11 @@ int c4_Differ::NewDiffID() {
   return n;
 }
 
-void c4_Differ::CreateDiff(int id_, c4_Column &col_) {
+bool c4_Differ::CreateDiff(int id_, c4_Column &col_) {
+  // aside datafiles keep 32-bit base positions, for compatibility
+  if (c4_FileMark::NeedsLarge(col_.Position()))
+    return false;
+
   _temp.SetSize(0);
 #if 0
   t4_i32 offset = 0;
@@ -436,11 +504,11 @@ void c4_Differ::CreateDiff(int id_, c4_Column &col_) {
   AddEntry(0, 0, c4_Bytes(p, col_.ColSize()));
 #endif 
   pDiff(_diffs[id_]) = _temp;
-
-  pOrig(_diffs[id_]) = col_.Position();
+  pOrig(_diffs[id_]) = (t4_i32)col_.Position();
+  return true;
 }
 
-t4_i32 c4_Differ::BaseOfDiff(int id_) {
+t4_off c4_Differ::BaseOfDiff(int id_) {
   d4_assert(0 <= id_ && id_ < _diffs.GetSize());
 
   return pOrig(_diffs[id_]);
@@ -484,13 +552,339 @@ void c4_Differ::GetRoot(c4_Bytes &buffer_) {
   }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+//  Parallel commits: these use a pool of worker threads, which is owned by
+//  c4_Persist and kept across commits.  Before the first pass of SaveIt,
+//  each handler gets a chance to encode its columns on one of the workers
+//  (see c4_Handler::Encode), as long as that does not depend on the walk
+//  buffer or on allocation order.  The second pass then does not write each
+//  changed column as soon as it is reached.  Instead, the column data is
+//  handed over to a c4_PendingSave and written later on by FlushPending,
+//  once all file positions are known.  At that point the pending columns
+//  are sorted by file offset, adjacent ones are coalesced into batches of up
+//  to kBatchMax bytes, and the batches are gathered into contiguous buffers
+//  by the workers while the main thread writes out the previous round.  The
+//  file contents are the same as in serial mode.
+
+class c4_WorkerPool {
+  public:
+    typedef void(*Func)(void *arg_, int index_);
+
+    c4_WorkerPool(int threads_);
+    ~c4_WorkerPool();
+
+    int NumThreads()const;
+
+    void Start(Func func_, void *arg_, int count_);
+    void Finish(bool help_ = true);
+
+  private:
+    Func _func;
+    void *_arg;
+    int _count; // number of items in the current round
+    int _next; // next item to hand out
+    int _done; // number of items completed
+    int _numThreads;
+    bool _stop;
+
+#if q4_MULTI
+#if q4_WIN32
+    CRITICAL_SECTION _lock;
+    HANDLE _work; // manual-reset, set while there are items to hand out
+    HANDLE _idle; // auto-reset, set when the last item is done
+    HANDLE _threads[c4_Persist::kMaxThreads];
+
+    static DWORD WINAPI Main(void *arg_);
+#else 
+    pthread_mutex_t _lock;
+    pthread_cond_t _work;
+    pthread_cond_t _idle;
+    pthread_t _threads[c4_Persist::kMaxThreads];
+
+    static void *Main(void *arg_);
+#endif 
+#endif 
+
+    void Lock();
+    void Unlock();
+    void WaitForWork();
+    void WaitForIdle();
+    void RunNext();
+};
+
+c4_WorkerPool::c4_WorkerPool(int threads_): _func(0), _arg(0), _count(0),
+  _next(0), _done(0), _numThreads(0), _stop(false) {
+  d4_assert(threads_ <= c4_Persist::kMaxThreads);
+
+#if q4_MULTI
+#if q4_WIN32
+  InitializeCriticalSection(&_lock);
+  _work = CreateEvent(0, TRUE, FALSE, 0);
+  _idle = CreateEvent(0, FALSE, FALSE, 0);
+
+  while (_numThreads < threads_ && (_threads[_numThreads] = CreateThread(0, 0,
+    Main, this, 0, 0)) != 0)
+    ++_numThreads;
+#else 
+  pthread_mutex_init(&_lock, 0);
+  pthread_cond_init(&_work, 0);
+  pthread_cond_init(&_idle, 0);
+
+  while (_numThreads < threads_ && pthread_create(_threads + _numThreads, 0,
+    Main, this) == 0)
+    ++_numThreads;
+#endif 
+#endif 
+}
+
+c4_WorkerPool::~c4_WorkerPool() {
+  d4_assert(_count == 0);
+
+#if q4_MULTI
+  Lock();
+  _stop = true;
+#if q4_WIN32
+  SetEvent(_work);
+#else 
+  pthread_cond_broadcast(&_work);
+#endif 
+  Unlock();
+
+  for (int i = 0; i < _numThreads; ++i) {
+#if q4_WIN32
+    WaitForSingleObject(_threads[i], INFINITE);
+    CloseHandle(_threads[i]);
+#else 
+    pthread_join(_threads[i], 0);
+#endif 
+  }
+
+#if q4_WIN32
+  CloseHandle(_work);
+  CloseHandle(_idle);
+  DeleteCriticalSection(&_lock);
+#else 
+  pthread_cond_destroy(&_work);
+  pthread_cond_destroy(&_idle);
+  pthread_mutex_destroy(&_lock);
+#endif 
+#endif 
+}
+
+int c4_WorkerPool::NumThreads()const {
+  return _numThreads;
+}
+
+void c4_WorkerPool::Lock() {
+#if q4_MULTI
+#if q4_WIN32
+  EnterCriticalSection(&_lock);
+#else 
+  pthread_mutex_lock(&_lock);
+#endif 
+#endif 
+}
+
+void c4_WorkerPool::Unlock() {
+#if q4_MULTI
+#if q4_WIN32
+  LeaveCriticalSection(&_lock);
+#else 
+  pthread_mutex_unlock(&_lock);
+#endif 
+#endif 
+}
+
+// called with the lock held, returns with the lock held
+void c4_WorkerPool::WaitForWork() {
+#if q4_MULTI
+#if q4_WIN32
+  Unlock();
+  WaitForSingleObject(_work, INFINITE);
+  Lock();
+#else 
+  pthread_cond_wait(&_work, &_lock);
+#endif 
+#endif 
+}
+
+// called with the lock held, returns with the lock held
+void c4_WorkerPool::WaitForIdle() {
+#if q4_MULTI
+#if q4_WIN32
+  Unlock();
+  WaitForSingleObject(_idle, INFINITE);
+  Lock();
+#else 
+  pthread_cond_wait(&_idle, &_lock);
+#endif 
+#endif 
+}
+
+// called with the lock held, runs one item without it
+void c4_WorkerPool::RunNext() {
+  d4_assert(_next < _count);
+  int i = _next++;
+#if q4_MULTI && q4_WIN32
+  if (_next == _count)
+    ResetEvent(_work);
+#endif 
+
+  Unlock();
+  _func(_arg, i);
+  Lock();
+
+  if (++_done == _count) {
+#if q4_MULTI
+#if q4_WIN32
+    SetEvent(_idle);
+#else 
+    pthread_cond_signal(&_idle);
+#endif 
+#endif 
+  }
+}
+
+#if q4_MULTI
+#if q4_WIN32
+DWORD WINAPI c4_WorkerPool::Main(void *arg_)
+#else 
+void *c4_WorkerPool::Main(void *arg_)
+#endif 
+{
+  c4_WorkerPool *pool = (c4_WorkerPool*)arg_;
+
+  pool->Lock();
+  while (!pool->_stop)
+    if (pool->_next < pool->_count)
+      pool->RunNext();
+    else
+      pool->WaitForWork();
+  pool->Unlock();
+
+  return 0;
+}
+#endif 
+
+// hand out items 0 .. count_-1 to the workers, returns at once
+void c4_WorkerPool::Start(Func func_, void *arg_, int count_) {
+  Lock();
+  d4_assert(_count == 0);
+  _func = func_;
+  _arg = arg_;
+  _count = count_;
+  _next = 0;
+  _done = 0;
+#if q4_MULTI
+#if q4_WIN32
+  if (count_ > 0)
+    SetEvent(_work);
+#else 
+  pthread_cond_broadcast(&_work);
+#endif 
+#endif 
+  Unlock();
+}
+
+// wait until all items have been done, optionally helping out
+void c4_WorkerPool::Finish(bool help_) {
+  Lock();
+  while (_done < _count)
+    if (_next < _count && (help_ || _numThreads == 0))
+      RunNext();
+    else
+      WaitForIdle();
+  _count = 0;
+  Unlock();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+class c4_PendingSave {
+  public:
+    t4_off _pos;
+    c4_Column _data;
+
+    c4_PendingSave(t4_off pos_, c4_Persist *persist_): _pos(pos_), _data
+      (persist_){}
+};
+
+static int PendingCompare(const void *a_, const void *b_) {
+  t4_off a = (*(c4_PendingSave **)a_)->_pos;
+  t4_off b = (*(c4_PendingSave **)b_)->_pos;
+  return a < b ?  - 1: a > b ? 1 : 0;
+}
+
+class c4_SaveBatch {
+  public:
+    enum {
+        kBatchMax = 1 << 18
+    };
+
+    c4_PendingSave **_items;
+    int _first; // index of the first item in this batch
+    t4_i32 _offset; // offset of the first byte inside that item
+    int _length; // total number of bytes, at most kBatchMax
+    t4_off _pos; // where the batch goes on file
+    t4_byte *_buffer;
+
+    void Gather();
+
+    static void Work(void *arg_, int index_);
+};
+
+void c4_SaveBatch::Gather() {
+  t4_byte *p = _buffer;
+  int i = _first;
+  t4_i32 offset = _offset;
+  int left = _length;
+
+  while (left > 0) {
+    c4_Column &col = _items[i++]->_data;
+
+    t4_i32 limit = col.ColSize();
+    if (limit - offset > left)
+      limit = offset + left;
+
+    c4_ColIter iter(col, offset, limit);
+    while (iter.Next()) {
+      memcpy(p, iter.BufLoad(), iter.BufLen());
+      p += iter.BufLen();
+      left -= iter.BufLen();
+    }
+
+    offset = 0;
+  }
+
+  d4_assert(p == _buffer + _length);
+}
+
+void c4_SaveBatch::Work(void *arg_, int index_) {
+  ((c4_SaveBatch*)arg_)[index_].Gather();
+}
+
+// used to call c4_Handler::Encode on the workers
+struct c4_EncodeJob {
+  c4_SaveContext *_context;
+  const c4_PtrArray *_handlers;
+
+  static void Work(void *arg_, int index_);
+};
+
+void c4_EncodeJob::Work(void *arg_, int index_) {
+  c4_EncodeJob *job = (c4_EncodeJob*)arg_;
+  ((c4_Handler*)job->_handlers->GetAt(index_))->Encode(*job->_context);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 c4_SaveContext::c4_SaveContext(c4_Strategy &strategy_, bool fullScan_, int
-  mode_, c4_Differ *differ_, c4_Allocator *space_): _strategy(strategy_), _walk
-  (0), _differ(differ_), _space(space_), _cleanup(0), _nextSpace(0), _preflight
-  (true), _fullScan(fullScan_), _mode(mode_), _nextPosIndex(0), _bufPtr(_buffer)
-  , _curr(_buffer), _limit(_buffer) {
+  mode_, c4_Differ *differ_, c4_Allocator *space_, c4_WorkerPool *pool_,
+  t4_i32 commitId_): _strategy(strategy_), _walk(0), _differ(differ_), _space
+  (space_), _cleanup(0), _nextSpace(0), _preflight(true), _fullScan(fullScan_),
+  _mode(mode_), _pool(pool_), _commitId(commitId_), _nextPosIndex(0), _bufPtr
+  (_buffer), _curr(_buffer), _limit(_buffer) {
   if (_space == 0)
     _space = _cleanup = d4_new c4_Allocator;
 
@@ -498,6 +892,9 @@ c4_SaveContext::c4_SaveContext(c4_Strategy &strategy_, bool fullScan_, int
 }
 
 c4_SaveContext::~c4_SaveContext() {
+  for (int i = 0; i < _pending.GetSize(); ++i)
+    delete (c4_PendingSave*)_pending.GetAt(i);
+
   delete _cleanup;
   if (_nextSpace != _space)
     delete _nextSpace;
@@ -511,6 +908,11 @@ bool c4_SaveContext::Serializing()const {
   return _fullScan;
 }
 
+// lets handlers check that their Encode call belongs to this commit
+t4_i32 c4_SaveContext::CommitId()const {
+  return _commitId;
+}
+
 void c4_SaveContext::AllocDump(const char *str_, bool next_) {
   c4_Allocator *ap = next_ ? _nextSpace : _space;
   if (ap != 0)
@@ -561,15 +963,26 @@ void c4_SaveContext::StoreValue(t4_i32 v_) {
   c4_Column::PushValue(_curr, v_);
 }
 
+void c4_SaveContext::StoreLong(t4_off v_) {
+  if (_walk == 0)
+    return ;
+
+  if (_curr + 10 >= _limit)
+    FlushBuffer();
+
+  d4_assert(_curr + 10 < _limit);
+  c4_Column::PushLong(_curr, v_);
+}
+
 void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   c4_Bytes &rootWalk_) {
   d4_assert(_space != 0);
 
-  const t4_i32 size = _strategy.FileSize();
+  const t4_off size = _strategy.FileSize();
   if (_strategy._failure != 0)
     return ;
 
-  const t4_i32 end = _fullScan ? 0 : size - _strategy._baseOffset;
+  const t4_off end = _fullScan ? 0 : size - _strategy._baseOffset;
 
   if (_differ == 0) {
     if (_mode != 1)
@@ -597,6 +1010,10 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   //AllocDump("a1", false);
   //AllocDump("a2", true);
 
+  // with a worker pool, let the handlers encode what they can in parallel
+  if (_pool != 0 && !_fullScan)
+    EncodeAhead(root_);
+
   // first pass allocates columns and constructs shallow walks
   c4_Column walk(root_.Persist());
   SetWalkBuffer(&walk);
@@ -607,15 +1024,18 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   c4_Bytes tempWalk;
   walk.FetchBytes(0, walk.ColSize(), tempWalk, true);
 
-  t4_i32 limit = _nextSpace->AllocationLimit();
+  t4_off limit = _nextSpace->AllocationLimit();
   d4_assert(limit >= 8 || _differ != 0);
 
-  if (limit < 0) {
-    // 2006-01-12 #2: catch file size exceeding 2 Gb
+  if (limit < 0 || limit + 16 > c4_FileMark::MaxOffset()) {
+    // 2006-01-12 #2: catch file size exceeding what file marks can hold
     _strategy._failure =  - 1; // unusual non-zero value flags this case
     return ;
   }
 
+  // switch to large-file marks once the file grows beyond 2 Gb
+  const bool large = c4_FileMark::NeedsLarge(limit + 16);
+
   bool changed = _fullScan || tempWalk != rootWalk_;
 
   rootWalk_ = c4_Bytes(tempWalk.Contents(), tempWalk.Size(), true);
@@ -638,7 +1058,8 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
 
   if (_differ != 0) {
     int n = _differ->NewDiffID();
-    _differ->CreateDiff(n, walk);
+    if (!_differ->CreateDiff(n, walk))
+      _strategy._failure =  - 1; // base position does not fit in 32 bits
     return ;
   }
 
@@ -647,7 +1068,7 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   // this is the place where writing may start
 
   // figure out where the new file ends and write a skip tail there
-  t4_i32 end0 = end;
+  t4_off end0 = end;
 
   // true if the file need not be extended due to internal free space
   bool inPlace = end0 == limit - 8;
@@ -659,14 +1080,14 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   } else {
     /* 18-11-2005 write new end marker and flush it before *anything* else! */
     if (!_fullScan && end0 < limit) {
-      c4_FileMark mark1(limit, 0);
+      c4_FileMark mark1(limit, 0, large);
       _strategy.DataWrite(limit, &mark1, sizeof mark1);
       _strategy.DataCommit(0);
       if (_strategy._failure != 0)
         return ;
     }
 
-    c4_FileMark head(limit + 16-end, _strategy._bytesFlipped, end > 0);
+    c4_FileMark head(limit + 16-end, _strategy._bytesFlipped, end > 0, large);
     _strategy.DataWrite(end, &head, sizeof head);
 
     if (end0 < limit)
@@ -674,11 +1095,11 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
     // create a gap
   }
 
-  t4_i32 end1 = end0 + 8;
-  t4_i32 end2 = end1 + 8;
+  t4_off end1 = end0 + 8;
+  t4_off end2 = end1 + 8;
 
   if (!_fullScan && !inPlace) {
-    c4_FileMark mark1(end0, 0);
+    c4_FileMark mark1(end0, 0, large);
     _strategy.DataWrite(end0, &mark1, sizeof mark1);
 #if q4_WIN32
     /* March 8, 2002
@@ -688,12 +1109,12 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
      * workaround it so simply accept the new end instead and rewrite.
      * Note that between these two writes, the file is in a bad state.
      */
-    t4_i32 realend = _strategy.FileSize() - _strategy._baseOffset;
+    t4_off realend = _strategy.FileSize() - _strategy._baseOffset;
     if (realend > end1) {
       end0 = limit = realend - 8;
       end1 = realend;
       end2 = realend + 8;
-      c4_FileMark mark1a(end0, 0);
+      c4_FileMark mark1a(end0, 0, large);
       _strategy.DataWrite(end0, &mark1a, sizeof mark1a);
     }
 #endif 
@@ -709,16 +1130,17 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   // second pass saves the columns and structure to disk
   CommitSequence(root_, true); // writes changed columns
   CommitColumn(walk);
+  FlushPending(); // in parallel mode, this is where the writing happens
 
   //! d4_assert(_curr == 0);
   d4_assert(_nextPosIndex == _newPositions.GetSize());
 
   if (_fullScan) {
-    c4_FileMark mark1(limit, 0);
+    c4_FileMark mark1(limit, 0, large);
     _strategy.DataWrite(_strategy.FileSize() - _strategy._baseOffset,  &mark1,
       sizeof mark1);
 
-    c4_FileMark mark2(limit - walk.ColSize(), walk.ColSize());
+    c4_FileMark mark2(limit - walk.ColSize(), walk.ColSize(), large);
     _strategy.DataWrite(_strategy.FileSize() - _strategy._baseOffset,  &mark2,
       sizeof mark2);
 
@@ -739,7 +1161,7 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
 
   _strategy.DataCommit(0);
 
-  c4_FileMark mark2(walk.Position(), walk.ColSize());
+  c4_FileMark mark2(walk.Position(), walk.ColSize(), large);
   _strategy.DataWrite(end1, &mark2, sizeof mark2);
   d4_assert(_strategy.FileSize() - _strategy._baseOffset == end2);
 
@@ -747,7 +1169,7 @@ void c4_SaveContext::SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_,
   if (!_fullScan && (_mode == 1 || end == 0)) {
     _strategy.DataCommit(0);
 
-    c4_FileMark head(end2, _strategy._bytesFlipped, false);
+    c4_FileMark head(end2, _strategy._bytesFlipped, false, large);
     d4_assert(head.IsHeader());
     _strategy.DataWrite(0, &head, sizeof head);
 
@@ -794,12 +1216,13 @@ bool c4_SaveContext::CommitColumn(c4_Column &col_) {
   t4_i32 sz = col_.ColSize();
   StoreValue(sz);
   if (sz > 0) {
-    t4_i32 pos = col_.Position();
+    t4_off pos = col_.Position();
 
     if (_differ) {
       if (changed) {
-        int n = pos < 0 ? ~pos: _differ->NewDiffID();
-        _differ->CreateDiff(n, col_);
+        int n = pos < 0 ? (int)~pos: _differ->NewDiffID();
+        if (!_differ->CreateDiff(n, col_))
+          _strategy._failure =  - 1; // base position does not fit in 32 bits
 
         d4_assert(n >= 0);
         pos = ~n;
@@ -813,19 +1236,146 @@ bool c4_SaveContext::CommitColumn(c4_Column &col_) {
     } else {
       pos = _newPositions.GetAt(_nextPosIndex++);
 
-      if (changed)
-        col_.SaveNow(_strategy, pos);
+      if (changed) {
+        if (_pool != 0 && !_fullScan) {
+          c4_PendingSave *ps = d4_new c4_PendingSave(pos, col_.Persist());
+          col_.MoveDataTo(ps->_data);
+          _pending.Add(ps);
+        } else
+          col_.SaveNow(_strategy, pos);
+      }
 
       if (!_fullScan)
         col_.SetLocation(pos, sz);
     }
 
-    StoreValue(pos);
+    StoreLong(pos);
   }
 
   return changed;
 }
 
+void c4_SaveContext::FlushPending() {
+  int n = _pending.GetSize();
+  if (n == 0)
+    return ;
+
+  c4_PendingSave **items = d4_new c4_PendingSave *[n];
+  t4_off total = 0;
+  for (int i = 0; i < n; ++i) {
+    items[i] = (c4_PendingSave*)_pending.GetAt(i);
+    total += items[i]->_data.ColSize();
+  }
+  _pending.SetSize(0);
+
+  qsort(items, n, sizeof *items, PendingCompare);
+
+  // split into batches of adjacent columns, large ones span several batches
+  int limit = n + (int)(total / c4_SaveBatch::kBatchMax) + 1;
+  c4_SaveBatch *batches = d4_new c4_SaveBatch[limit];
+  int count = 0;
+
+  int next = 0;
+  t4_i32 offset = 0;
+  while (next < n) {
+    d4_assert(count < limit);
+    c4_SaveBatch &b = batches[count++];
+    b._items = items;
+    b._first = next;
+    b._offset = offset;
+    b._length = 0;
+    b._pos = items[next]->_pos + offset;
+
+    for (;;) {
+      t4_i32 avail = items[next]->_data.ColSize() - offset;
+      int room = c4_SaveBatch::kBatchMax - b._length;
+      if (avail > room) {
+        b._length += room;
+        offset += room;
+        break;
+      }
+
+      b._length += avail;
+      offset = 0;
+
+      t4_off end = items[next]->_pos + items[next]->_data.ColSize();
+      if (++next >= n || items[next]->_pos != end)
+        break;
+    }
+  }
+
+  // gather one round while the previous one is being written
+  int perRound = _pool->NumThreads() > 0 ? _pool->NumThreads(): 1;
+  if (perRound > count)
+    perRound = count;
+
+  c4_Bytes space;
+  t4_byte *buffers = space.SetBuffer(2 *perRound * c4_SaveBatch::kBatchMax);
+
+  int curr = 0, first = 0, last = perRound;
+
+  for (int j = first; j < last; ++j)
+    batches[j]._buffer = buffers + (j - first) *c4_SaveBatch::kBatchMax;
+  _pool->Start(c4_SaveBatch::Work, batches + first, last - first);
+
+  while (first < count) {
+    _pool->Finish();
+
+    int second = last;
+    last = second + perRound <= count ? second + perRound : count;
+    if (second < last && _strategy._failure == 0) {
+      t4_byte *p = buffers + (1-curr) *perRound * c4_SaveBatch::kBatchMax;
+      for (int j = second; j < last; ++j)
+        batches[j]._buffer = p + (j - second) *c4_SaveBatch::kBatchMax;
+      _pool->Start(c4_SaveBatch::Work, batches + second, last - second);
+    }
+
+    for (int k = first; k < second && _strategy._failure == 0; ++k)
+      _strategy.DataWrite(batches[k]._pos, batches[k]._buffer,
+        batches[k]._length);
+
+    first = second;
+    curr = 1-curr;
+  }
+
+  _pool->Finish();
+
+  delete [] batches;
+
+  for (int k = 0; k < n; ++k)
+    delete items[k];
+  delete [] items;
+}
+
+void c4_SaveContext::CollectHandlers(c4_HandlerSeq &seq_, c4_PtrArray &list_)
+  {
+  if (seq_.NumRows() == 0)
+    return ;
+  // handlers of empty sequences are not committed
+
+  for (int c = 0; c < seq_.NumFields(); ++c) {
+    c4_Handler &h = seq_.NthHandler(c);
+    if (seq_.IsNested(c)) {
+      for (int r = 0; r < seq_.NumRows(); ++r)
+        if (h.HasSubview(r))
+          CollectHandlers(seq_.SubEntry(c, r), list_);
+    } else
+      list_.Add(&h);
+  }
+}
+
+void c4_SaveContext::EncodeAhead(c4_HandlerSeq &root_) {
+  c4_PtrArray list;
+  CollectHandlers(root_, list);
+
+  c4_EncodeJob job;
+  job._context = this;
+  job._handlers = &list;
+
+  _pool->Start(c4_EncodeJob::Work, &job, list.GetSize());
+  _pool->Finish();
+}
+
 void c4_SaveContext::CommitSequence(c4_HandlerSeq &seq_, bool selfDesc_) {
   StoreValue(0); // sias prefix
 
@@ -848,18 +1398,20 @@ void c4_SaveContext::CommitSequence(c4_HandlerSeq &seq_, bool selfDesc_) {
 t4_byte *_oldBuf;
 const t4_byte *_oldCurr;
 const t4_byte *_oldLimit;
-t4_i32 _oldSeek;
+t4_off _oldSeek;
 
 
 c4_Persist::c4_Persist(c4_Strategy &strategy_, bool owned_, int mode_): _space
   (0), _strategy(strategy_), _root(0), _differ(0), _fCommit(0), _mode(mode_),
-  _owned(owned_), _oldBuf(0), _oldCurr(0), _oldLimit(0), _oldSeek( - 1) {
+  _threads(0), _pool(0), _commits(0), _owned(owned_), _oldBuf(0), _oldCurr(0),
+  _oldLimit(0), _oldSeek( - 1) {
   if (_mode == 1)
     _space = d4_new c4_Allocator;
 }
 
 c4_Persist::~c4_Persist() {
   delete _differ;
+  delete _pool;
 
   if (_owned) {
     if (_root != 0)
@@ -896,6 +1448,19 @@ bool c4_Persist::AutoCommit(bool flag_) {
   return prev;
 }
 
+int c4_Persist::ParallelCommit(int threads_) {
+  int prev = _threads;
+  _threads = threads_ < 0 ? 0 : threads_ > kMaxThreads ? kMaxThreads :
+    threads_;
+
+  // the worker threads are started again on the next commit
+  if (_threads != prev) {
+    delete _pool;
+    _pool = 0;
+  }
+  return prev;
+}
+
 void c4_Persist::DoAutoCommit() {
   if (_fCommit != 0)
     (this->*_fCommit)(false);
@@ -924,7 +1489,11 @@ bool c4_Persist::Commit(bool full_) {
     return false;
   // note that _strategy._failure is *zero* in this case
 
-  c4_SaveContext ar(_strategy, false, _mode, full_ ? 0 : _differ, _space);
+  if (_threads > 0 && _pool == 0)
+    _pool = d4_new c4_WorkerPool(_threads);
+
+  c4_SaveContext ar(_strategy, false, _mode, full_ ? 0 : _differ, _space,
+    _pool, ++_commits);
 
   // get rid of temp properties which still use the datafile
   if (_mode == 1)
@@ -932,6 +1501,11 @@ bool c4_Persist::Commit(bool full_) {
 
   // 30-3-2001: moved down, fixes "crash every 2nd call of mkdemo/dbg"
   ar.SaveIt(*_root, &_space, _rootWalk);
+
+  // let the strategy know that whatever it was given so far is abandoned
+  if (_strategy._failure != 0)
+    _strategy.DataCommit( - 1);
+
   return _strategy._failure == 0;
 }
 
@@ -958,7 +1532,7 @@ bool c4_Persist::Rollback(bool full_) {
 }
 
 bool c4_Persist::LoadIt(c4_Column &walk_) {
-  t4_i32 limit = _strategy.FileSize();
+  t4_off limit = _strategy.FileSize();
   if (_strategy._failure != 0)
     return false;
 
@@ -1074,7 +1648,7 @@ t4_i32 c4_Persist::FreeBytes(t4_i32 *bytes_) {
 int c4_Persist::OldRead(t4_byte *buf_, int len_) {
   d4_assert(_oldSeek >= 0);
 
-  t4_i32 newSeek = _oldSeek + _oldCurr - _oldLimit;
+  t4_off newSeek = _oldSeek + (_oldCurr - _oldLimit);
   int n = _strategy.DataRead(newSeek, buf_, len_);
   d4_assert(n > 0);
   _oldSeek = newSeek + n;
@@ -1093,9 +1667,9 @@ c4_HandlerSeq *c4_Persist::Load(c4_Stream *stream_) {
   //_oldStyle = head._data[3] == 0x80;
   d4_assert(!head.IsOldHeader());
 
-  t4_i32 limit = head.Offset();
+  t4_off limit = head.Offset();
 
-  c4_StreamStrategy *strat = d4_new c4_StreamStrategy(limit);
+  c4_StreamStrategy *strat = d4_new c4_StreamStrategy((t4_i32)limit);
   strat->_bytesFlipped = head.IsFlipped();
   strat->DataWrite(strat->FileSize() - strat->_baseOffset, &head, sizeof head);
 
@@ -1143,7 +1717,7 @@ void c4_Persist::Save(c4_Stream *stream_, c4_HandlerSeq &root_) {
   ar.SaveIt(root_, 0, tempWalk);
 }
 
-t4_i32 c4_Persist::LookupAside(int id_) {
+t4_off c4_Persist::LookupAside(int id_) {
   d4_assert(_differ != 0);
 
   return _differ->BaseOfDiff(id_);
@@ -1155,7 +1729,7 @@ void c4_Persist::ApplyAside(int id_, c4_Column &col_) {
   _differ->ApplyDiff(id_, col_);
 }
 
-void c4_Persist::OccupySpace(t4_i32 pos_, t4_i32 len_) {
+void c4_Persist::OccupySpace(t4_off pos_, t4_i32 len_) {
   d4_assert(_mode != 1 || _space != 0);
 
   if (_space != 0)
@@ -21,6 +21,7 @@ class c4_Differ; // not defined here
 class c4_FileMark; // not defined here
 class c4_Strategy; // not defined here
 class c4_HandlerSeq; // not defined here
+class c4_WorkerPool; // not defined here
 
 /////////////////////////////////////////////////////////////////////////////
 
@@ -36,10 +37,14 @@ class c4_SaveContext {
     bool _preflight;
     bool _fullScan;
     int _mode;
+    c4_WorkerPool *_pool;
+    t4_i32 _commitId;
 
-    c4_DWordArray _newPositions;
+    c4_OffsetArray _newPositions;
     int _nextPosIndex;
 
+    c4_PtrArray _pending; // columns waiting to be written, see FlushPending
+
     t4_byte *_bufPtr;
     t4_byte *_curr;
     t4_byte *_limit;
@@ -47,13 +52,15 @@ class c4_SaveContext {
 
   public:
     c4_SaveContext(c4_Strategy &strategy_, bool fullScan_, int mode_, c4_Differ
-      *differ_, c4_Allocator *space_);
+      *differ_, c4_Allocator *space_, c4_WorkerPool *pool_ = 0, t4_i32
+      commitId_ = 0);
     ~c4_SaveContext();
 
     void SaveIt(c4_HandlerSeq &root_, c4_Allocator **spacePtr_, c4_Bytes
       &rootWalk_);
 
     void StoreValue(t4_i32 v_);
+    void StoreLong(t4_off v_);
     bool CommitColumn(c4_Column &col_);
     void CommitSequence(c4_HandlerSeq &seq_, bool selfDesc_);
 
@@ -61,10 +68,14 @@ class c4_SaveContext {
     bool IsFlipped()const;
 
     bool Serializing()const;
+    t4_i32 CommitId()const;
     void AllocDump(const char *, bool = false);
 
   private:
     void FlushBuffer();
+    void FlushPending();
+    void EncodeAhead(c4_HandlerSeq &root_);
+    void CollectHandlers(c4_HandlerSeq &seq_, c4_PtrArray &list_);
     void Write(const void *buf_, int len_);
 };
 
@@ -78,17 +89,24 @@ class c4_Persist {
     c4_Bytes _rootWalk;
     bool(c4_Persist:: *_fCommit)(bool);
     int _mode;
+    int _threads;
+    c4_WorkerPool *_pool; // created on the first parallel commit
+    t4_i32 _commits;
     bool _owned;
 
     // used for on-the-fly conversion of old-format datafiles
     t4_byte *_oldBuf;
     const t4_byte *_oldCurr;
     const t4_byte *_oldLimit;
-    t4_i32 _oldSeek;
+    t4_off _oldSeek;
 
     int OldRead(t4_byte *buf_, int len_);
 
   public:
+    enum {
+        kMaxThreads = 16 // upper limit for parallel commits
+    };
+
     c4_Persist(c4_Strategy &, bool owned_, int mode_);
     ~c4_Persist();
 
@@ -98,6 +116,7 @@ class c4_Persist {
 
     bool AutoCommit(bool = true);
     void DoAutoCommit();
+    int ParallelCommit(int threads_);
 
     bool SetAside(c4_Storage &aside_);
     c4_Storage *GetAside()const;
@@ -108,10 +127,10 @@ class c4_Persist {
     bool LoadIt(c4_Column &walk_);
     void LoadAll();
 
-    t4_i32 LookupAside(int id_);
+    t4_off LookupAside(int id_);
     void ApplyAside(int id_, c4_Column &col_);
 
-    void OccupySpace(t4_i32 pos_, t4_i32 len_);
+    void OccupySpace(t4_off pos_, t4_i32 len_);
 
     t4_i32 FetchOldValue();
     void FetchOldLocation(c4_Column &col_);
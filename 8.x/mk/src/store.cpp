@@ -379,6 +379,11 @@ bool c4_Storage::AutoCommit(bool flag_) {
   return Persist()->AutoCommit(flag_);
 }
 
+/// Write commits in coalesced batches, using threads (0 = off, serial)
+int c4_Storage::ParallelCommit(int threads_) {
+  return Persist()->ParallelCommit(threads_);
+}
+
 /// Load contents from the specified input stream
 bool c4_Storage::LoadFrom(c4_Stream &stream_) {
   c4_HandlerSeq *newRoot = c4_Persist::Load(&stream_);
@@ -498,13 +503,13 @@ bool c4_StreamStrategy::IsValid()const {
   return true;
 }
 
-int c4_StreamStrategy::DataRead(t4_i32 pos_, void *buffer_, int length_) {
+int c4_StreamStrategy::DataRead(t4_off pos_, void *buffer_, int length_) {
   if (_buffer != 0) {
     d4_assert(pos_ <= _buflen);
     _position = pos_ + _baseOffset;
 
     if (length_ > _buflen - _position)
-      length_ = _buflen - _position;
+      length_ = (int)(_buflen - _position);
     if (length_ > 0)
       memcpy(buffer_, _buffer + _position, length_);
   } else {
@@ -516,7 +521,7 @@ int c4_StreamStrategy::DataRead(t4_i32 pos_, void *buffer_, int length_) {
   return length_;
 }
 
-void c4_StreamStrategy::DataWrite(t4_i32 pos_, const void *buffer_, int length_)
+void c4_StreamStrategy::DataWrite(t4_off pos_, const void *buffer_, int length_)
   {
   if (_buffer != 0) {
     d4_assert(pos_ <= _buflen);
@@ -524,7 +529,7 @@ void c4_StreamStrategy::DataWrite(t4_i32 pos_, const void *buffer_, int length_)
 
     int n = length_;
     if (n > _buflen - _position)
-      n = _buflen - _position;
+      n = (int)(_buflen - _position);
     if (n > 0)
       memcpy(_buffer + _position, buffer_, n);
   } else {
@@ -536,7 +541,7 @@ void c4_StreamStrategy::DataWrite(t4_i32 pos_, const void *buffer_, int length_)
   _position += length_;
 }
 
-t4_i32 c4_StreamStrategy::FileSize() {
+t4_off c4_StreamStrategy::FileSize() {
   return _position;
 }
 
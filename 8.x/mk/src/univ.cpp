@@ -130,6 +130,27 @@ void c4_DWordArray::RemoveAt(int nIndex, int nCount) {
   _vector.RemoveAt(Off(nIndex), nCount *sizeof(t4_i32));
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// c4_OffsetArray
+
+int c4_OffsetArray::Add(t4_off newElement) {
+  int n = GetSize();
+  _vector.Grow(Off(n + 1));
+  SetAt(n, newElement);
+  return n;
+}
+
+void c4_OffsetArray::InsertAt(int nIndex, t4_off newElement, int nCount) {
+  _vector.InsertAt(Off(nIndex), nCount *sizeof(t4_off));
+
+  while (--nCount >= 0)
+    SetAt(nIndex++, newElement);
+}
+
+void c4_OffsetArray::RemoveAt(int nIndex, int nCount) {
+  _vector.RemoveAt(Off(nIndex), nCount *sizeof(t4_off));
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // c4_PtrArray
 
@@ -80,6 +80,29 @@ class c4_DWordArray {
     c4_BaseArray _vector;
 };
 
+class c4_OffsetArray {
+  public:
+    c4_OffsetArray();
+    ~c4_OffsetArray();
+
+    int GetSize()const;
+    void SetSize(int nNewSize, int nGrowBy =  - 1);
+
+    t4_off GetAt(int nIndex)const;
+    void SetAt(int nIndex, t4_off newElement);
+    t4_off &ElementAt(int nIndex);
+
+    int Add(t4_off newElement);
+
+    void InsertAt(int nIndex, t4_off newElement, int nCount = 1);
+    void RemoveAt(int nIndex, int nCount = 1);
+
+  private:
+    static int Off(int n_);
+
+    c4_BaseArray _vector;
+};
+
 class c4_StringArray {
   public:
     c4_StringArray();
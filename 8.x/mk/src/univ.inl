@@ -106,6 +106,47 @@ d4_inline t4_i32& c4_DWordArray::ElementAt(int nIndex)
   return *(t4_i32*) _vector.GetData(Off(nIndex)); 
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// c4_OffsetArray
+
+d4_inline c4_OffsetArray::c4_OffsetArray ()
+{ 
+}
+
+d4_inline c4_OffsetArray::~c4_OffsetArray ()
+{ 
+}
+
+d4_inline int c4_OffsetArray::Off(int n_)
+{
+  return n_ * sizeof (t4_off); 
+}
+
+d4_inline int c4_OffsetArray::GetSize() const
+{ 
+  return _vector.GetLength() / sizeof (t4_off); 
+}
+
+d4_inline void c4_OffsetArray::SetSize(int nNewSize, int)
+{ 
+  _vector.SetLength(Off(nNewSize)); 
+}
+
+d4_inline t4_off c4_OffsetArray::GetAt(int nIndex) const
+{ 
+  return *(const t4_off*) _vector.GetData(Off(nIndex)); 
+}
+
+d4_inline void c4_OffsetArray::SetAt(int nIndex, t4_off newElement)
+{ 
+  *(t4_off*) _vector.GetData(Off(nIndex)) = newElement; 
+}
+
+d4_inline t4_off& c4_OffsetArray::ElementAt(int nIndex)
+{ 
+  return *(t4_off*) _vector.GetData(Off(nIndex)); 
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // c4_StringArray
 
@@ -611,7 +611,7 @@ c4_Strategy::~c4_Strategy() {
 }
 
 /// Read a number of bytes
-int c4_Strategy::DataRead(t4_i32, void *, int) {
+int c4_Strategy::DataRead(t4_off, void *, int) {
   /*
   if (_mapStart != 0 && pos_ + length_ <= _dataSize)
   {
@@ -624,18 +624,18 @@ int c4_Strategy::DataRead(t4_i32, void *, int) {
 }
 
 /// Write a number of bytes, return true if successful
-void c4_Strategy::DataWrite(t4_i32, const void *, int) {
+void c4_Strategy::DataWrite(t4_off, const void *, int) {
   ++_failure;
 }
 
 /// Flush and truncate file
-void c4_Strategy::DataCommit(t4_i32){}
+void c4_Strategy::DataCommit(t4_off){}
 
 /// Override to support memory-mapped files
 void c4_Strategy::ResetFileMapping(){}
 
 /// Report total size of the datafile
-t4_i32 c4_Strategy::FileSize() {
+t4_off c4_Strategy::FileSize() {
   return _dataSize;
 }
 
@@ -645,8 +645,8 @@ t4_i32 c4_Strategy::FreshGeneration() {
 }
 
 /// Define the base offset where data is stored
-void c4_Strategy::SetBase(t4_i32 base_) {
-  t4_i32 off = base_ - _baseOffset;
+void c4_Strategy::SetBase(t4_off base_) {
+  t4_off off = base_ - _baseOffset;
   _baseOffset = base_;
   _dataSize -= off;
   if (_mapStart != 0)
@@ -663,14 +663,14 @@ file marks is in one place within the loop.
  */
 
 /// Scan datafile head/tail markers, return logical end of data
-t4_i32 c4_Strategy::EndOfData(t4_i32 end_) {
+t4_off c4_Strategy::EndOfData(t4_off end_) {
   enum {
     kStateAtEnd, kStateCommit, kStateHead, kStateOld, kStateDone
   };
 
-  t4_i32 pos = (end_ >= 0 ? end_ : FileSize()) - _baseOffset;
-  t4_i32 last = pos;
-  t4_i32 rootPos = 0;
+  t4_off pos = (end_ >= 0 ? end_ : FileSize()) - _baseOffset;
+  t4_off last = pos;
+  t4_off rootPos = 0;
   t4_i32 rootLen =  - 1; // impossible value, flags old-style header
   t4_byte mark[8];
 
@@ -689,15 +689,25 @@ t4_i32 c4_Strategy::EndOfData(t4_i32 end_) {
     for (int i = 1; i < 4; ++i)
       count = (count << 8) + mark[i];
 
-    t4_i32 offset = 0;
+    // large-file tails are 0xC0 + bits 32..35 of the offset, see persist.cpp
+    const bool isLargeTail = (mark[0] & 0xF0) == 0xC0;
+
+    t4_off offset = 0;
+#if q4_LARGEFILE
+    if (isLargeTail)
+      offset = mark[0] & 0x0F;
+#endif 
     for (int j = 4; j < 8; ++j)
       offset = (offset << 8) + mark[j];
 
     const bool isSkipTail = ((mark[0] & 0xF0) == 0x90 /* 2006-11-11 */ ||
-                             mark[0] == 0x80 && count == 0) && offset > 0;
-    const bool isCommitTail = mark[0] == 0x80 && count > 0 && offset > 0;
+                             (mark[0] == 0x80 || isLargeTail) && count == 0) &&
+                             offset > 0;
+    const bool isCommitTail = (mark[0] == 0x80 || isLargeTail) && count > 0 &&
+      offset > 0;
     const bool isHeader = (mark[0] == 'J' || mark[0] == 'L') && (mark[0] ^
-      mark[1]) == ('J' ^ 'L') && mark[2] == 0x1A && (mark[3] & 0x40) == 0;
+      mark[1]) == ('J' ^ 'L') && (mark[2] == 0x1A || mark[2] == 0x1B) && 
+      (mark[3] & 0x40) == 0;
       
     switch (state) {
       case kStateAtEnd:
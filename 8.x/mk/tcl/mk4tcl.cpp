@@ -42,64 +42,135 @@ class MkTcl;
 ///////////////////////////////////////////////////////////////////////////////
 
 // inc'ed whenever a datafile is closed, forces relookup of all paths
+// all threads share it, so it is only accessed under lockMutex (see below)
 static int generation;
 
+// There is no global mutex protecting all of Mk4tcl.  A workspace belongs to
+// a single interp, and hence to a single thread, so all storages opened in it
+// are only ever used from that thread and need no locking at all.  This lets
+// threads which each have their own datafiles run completely in parallel.
+//
+// The exception are storages opened with "-shared", which every workspace can
+// use.  Each of these has its own MkLock, which is taken when the storage is
+// looked up by name, or used through a cursor which refers to it.  Locks are
+// held until the outermost call into Mk4tcl from that interp returns, so the
+// recursion from Tcl's type callbacks (see "Tcl_ObjType mkCursorType") works
+// as before.  Metakit caches decoded values inside a view while reading, so
+// even readers of the same shared storage must not run at the same time.
+//
+// Locks which are held are never let go of before the outermost call returns,
+// as the items and views found under them stay in use.  To avoid deadlocks,
+// each command first takes the locks of all shared storages named in its
+// arguments, in the order of their addresses (see LockArgs).  Should a lock
+// which is only found later on still close a cycle of threads waiting for
+// each other, the command fails instead of waiting.  All lock state is changed
+// under lockMutex, which is also used to manage the list of shared items.
+
+TCL_DECLARE_MUTEX(lockMutex)
+
 #ifdef TCL_THREADS
+static Tcl_Condition lockCond; // signalled whenever a lock is released
+#endif 
 
-// There is a single monolithic mutex for protecting all of Mk4tcl, but it has
-// to be a bit more advanced than Tcl's one since it has to support recursion,
-// i.e. re-entering this code from the *same* thread needs to be allowed.  The
-// recursion can happen in Tcl's type callbacks, see "Tcl_ObjType mkCursorType".
-//
-// We know the current interpreter in all cases, it can be used as mutex owner.
-// So we can be multiple times inside the mutex, but ONLY from a simgle interp.
-// No deadlock is possible, locking is always in the order mkMutex -> infoMutex.
+class MkLock {
+  public:
+    MkWorkspace *_owner; // the workspace holding this lock, if any
+    MkWorkspace::Item *_item; // shared item, cleared once it is closed
+    int _refs; // the item, each path using it, each workspace holding it
 
-TCL_DECLARE_MUTEX(mkMutex)    // use a single monolithic mutex for now
-TCL_DECLARE_MUTEX(infoMutex)  // use a second mutex to manage the info below
+    MkLock(MkWorkspace::Item *item_): _owner(0), _item(item_), _refs(1){}
+};
 
-// set to the interp holding the mutex, or to zero when not locked
-static Tcl_Interp *mutex_owner;
+static void NextGeneration() {
+  Tcl_MutexLock(&lockMutex);
+  ++generation;
+  Tcl_MutexUnlock(&lockMutex);
+}
 
-// set to the reursion level, > 1 means we've re-entered from same interp
-static int mutex_level;
-  
-static void EnterMutex(Tcl_Interp *ip_) {
-    d4_assert(ip_ != 0);
-    Tcl_MutexLock(&infoMutex);
-    if (ip_ != mutex_owner) {
-        Tcl_MutexUnlock(&infoMutex);
-        Tcl_MutexLock(&mkMutex);
-        Tcl_MutexLock(&infoMutex);
-        d4_assert(mutex_owner == 0);
-        mutex_owner = ip_;
-    }
-    ++mutex_level;
-    Tcl_MutexUnlock(&infoMutex);
+int CurrentGeneration() {
+  Tcl_MutexLock(&lockMutex);
+  int gen = generation;
+  Tcl_MutexUnlock(&lockMutex);
+  return gen;
+}
+
+// must be called with lockMutex held
+static void DropLock(MkLock *lock_) {
+  d4_assert(lock_->_refs > 0);
+  if (--lock_->_refs == 0)
+    delete lock_;
+}
+
+void MkWorkspace::Enter() {
+  ++_level;
 }
 
-static void LeaveMutex() {
-    Tcl_MutexLock(&infoMutex);
-    d4_assert(mutex_owner != 0 && mutex_level > 0);
-    if (--mutex_level == 0) {
-      mutex_owner = 0;
-      Tcl_MutexUnlock(&mkMutex);
+void MkWorkspace::Leave() {
+  d4_assert(_level > 0);
+  if (--_level == 0)
+    _deadlock = false;
+  if (_level == 0 && _locks.GetSize() > 0) {
+    Tcl_MutexLock(&lockMutex);
+    for (int i = 0; i < _locks.GetSize(); ++i) {
+      MkLock *lock = (MkLock*)_locks.GetAt(i);
+      lock->_owner = 0;
+      DropLock(lock);
     }
-    Tcl_MutexUnlock(&infoMutex);
+    _locks.SetSize(0);
+    Tcl_ConditionNotify(&lockCond);
+    Tcl_MutexUnlock(&lockMutex);
+  }
 }
 
-#else
+// must be called with lockMutex held, returns false if the item was closed,
+// or if waiting for it would deadlock, in which case Deadlocked() is true
+bool MkWorkspace::Lock(MkLock *lock_) {
+  d4_assert(_level > 0);
 
-#define EnterMutex(x)
-#define LeaveMutex()
+  while (lock_->_owner != this) {
+    MkWorkspace *owner = lock_->_owner;
+    if (owner == 0) {
+      lock_->_owner = this;
+      ++lock_->_refs;
+      _locks.Add(lock_);
+      break;
+    }
+
+    // follow what the owner waits for, a cycle leads back to this workspace
+    while (owner != 0 && owner != this && owner->_waiting != 0)
+      owner = owner->_waiting->_owner;
+    if (owner == this) {
+      _deadlock = true;
+      return false;
+    }
+
+    // all locks which are already held are kept while waiting
+    _waiting = lock_;
+    Tcl_ConditionWait(&lockCond, &lockMutex, 0);
+    _waiting = 0;
+  }
+
+  return lock_->_item != 0;
+}
+
+// take the lock of the shared storage a path refers to, if any, returns
+// false if that failed, in which case the path must be looked up again
+static bool LockPath(MkWorkspace &ws_, const MkPath &path_) {
+  bool ok = true;
+  if (path_._lock != 0) {
+    Tcl_MutexLock(&lockMutex);
+    ok = ws_.Lock(path_._lock);
+    Tcl_MutexUnlock(&lockMutex);
+  }
+  return ok;
+}
 
-#endif
- 
 // put code in this file as a mutex is static in Windows
 int Mk_EvalObj(Tcl_Interp *ip_, Tcl_Obj *cmd_) {
-    LeaveMutex();
+    MkWorkspace *ws = (MkWorkspace*)Tcl_GetAssocData(ip_, "mk4tcl", 0);
+    ws->Leave();
     int e = Tcl_EvalObj(ip_, cmd_);
-    EnterMutex(ip_);
+    ws->Enter();
     return e;
 }
 
@@ -190,19 +261,7 @@ class SiasStrategy: public c4_Strategy {
     SiasStrategy(c4_Storage &storage_, const c4_View &view_, const c4_BytesProp
       &memo_, int row_): _storage(storage_), _view(view_), _memo(memo_), _row
       (row_), _position(0), _interp(0), _next(0), _workspace(0) {
-        // set up mapping if the memo itself is mapped in its entirety
-        c4_Strategy &strat = storage_.Strategy();
-        if (strat._mapStart != 0) {
-            c4_RowRef r = _view[_row];
-            c4_Bytes data = _memo(r).Access(0);
-            const t4_byte *ptr = data.Contents();
-            if (data.Size() == _memo(r).GetSize() && strat._mapStart != 0 &&
-              ptr >= strat._mapStart && ptr - strat._mapStart < strat._dataSize)
-              {
-                _mapStart = ptr;
-                _dataSize = data.Size();
-            }
-        }
+        MapMemo();
     }
 
     virtual ~SiasStrategy() {
@@ -214,19 +273,51 @@ class SiasStrategy: public c4_Strategy {
           Tcl_UnregisterChannel(_interp, _chan);
     }
 
+    // set up mapping if the memo itself is mapped in its entirety
+    bool MapMemo() {
+        _mapStart = 0;
+        _dataSize = 0;
+
+        c4_Strategy &strat = _storage.Strategy();
+        if (strat._mapStart != 0) {
+            c4_BytesRef memo = _memo(_view[_row]);
+            c4_Bytes data = memo.Access(0, 0, true); // first segment, no copy
+            const t4_byte *ptr = data.Contents();
+            if (data.Size() > 0 && data.Size() == memo.GetSize() && ptr >=
+              strat._mapStart && ptr - strat._mapStart < strat._dataSize) {
+                _mapStart = ptr;
+                _dataSize = data.Size();
+            }
+        }
+
+        return _mapStart != 0;
+    }
+
     virtual void DataSeek(t4_i32 position_) {
         _position = position_;
     }
 
-    virtual int DataRead(t4_i32 pos_, void *buffer_, int length_) {
+    virtual int DataRead(t4_off pos_, void *buffer_, int length_) {
         if (pos_ != ~0)
           _position = pos_;
 
+        // read straight from the mapped file, unless the memo has been
+        // changed or the file remapped since the last read
+        if (_mapStart != 0 && (_memo(_view[_row]).Access(0, 1, true).Contents()
+          == _mapStart || MapMemo())) {
+            int n = _position < _dataSize ? _dataSize - _position : 0;
+            if (n > length_)
+              n = length_;
+            memcpy(buffer_, _mapStart + _position, n);
+            _position += n;
+            return n;
+        }
+
         int i = 0;
 
         while (i < length_) {
             c4_Bytes data = _memo(_view[_row]).Access(_position + i, length_ -
-              i);
+              i, true);
             int n = data.Size();
             if (n <= 0)
               break;
@@ -238,7 +329,7 @@ class SiasStrategy: public c4_Strategy {
         return i;
     }
 
-    virtual void DataWrite(t4_i32 pos_, const void *buffer_, int length_) {
+    virtual void DataWrite(t4_off pos_, const void *buffer_, int length_) {
         if (pos_ != ~0)
           _position = pos_;
 
@@ -249,7 +340,7 @@ class SiasStrategy: public c4_Strategy {
           ++_failure;
     }
 
-    virtual void DataCommit(t4_i32 newSize_) {
+    virtual void DataCommit(t4_off newSize_) {
         if (newSize_ > 0)
           _memo(_view[_row]).Modify(c4_Bytes(), newSize_);
     }
@@ -575,7 +666,8 @@ bool c4_TclStream::Write(const void *buffer_, int length_) {
 ///////////////////////////////////////////////////////////////////////////////
 
 MkPath::MkPath(MkWorkspace &ws_, const char * &path_, Tcl_Interp *interp):
-  _refs(1), _ws(&ws_), _path(path_), _currGen(generation) {
+  _refs(1), _ws(&ws_), _path(path_), _currGen(CurrentGeneration()),
+  _lock(0) {
   // if this view is not part of any storage, make a new temporary row
   if (_path.IsEmpty()) {
     ws_.AllocTempRow(_path);
@@ -596,6 +688,12 @@ MkPath::~MkPath() {
   // 24-01-2003: paths should not clean up workspaces once exiting
   if (_currGen != -1)
     _ws->ForgetPath(this);
+
+  if (_lock != 0) {
+    Tcl_MutexLock(&lockMutex);
+    DropLock(_lock);
+    Tcl_MutexUnlock(&lockMutex);
+  }
 }
 
 #if 0
@@ -638,6 +736,13 @@ int MkPath::AttachView(Tcl_Interp * /*interp*/) {
   //  In the second case, the trailing row# is ignored.
 
   MkWorkspace::Item *ip = _ws != 0 ? _ws->Find(f4_GetToken(p)): 0;
+  if (ip != 0 && ip->_lock != 0 && _lock == 0) {
+    Tcl_MutexLock(&lockMutex);
+    _lock = ip->_lock;
+    ++_lock->_refs;
+    Tcl_MutexUnlock(&lockMutex);
+  }
+
   if (ip != 0) {
     // 16-1-2003: allow path reference to root view (i.e. storage itself)
     if (*p == 0) {
@@ -711,27 +816,41 @@ int MkPath::Refs(int diff_) {
 c4_PtrArray *MkWorkspace::Item::_shared = 0;
 
 MkWorkspace::Item::Item(const char *name_, const char *fileName_, int mode_,
-  c4_PtrArray &items_, int index_, bool share_): _name(name_), _fileName
-  (fileName_), _items(items_), _index(index_) {
-  ++generation; // make sure all cached paths refresh on next access
-
-  if (*fileName_) {
+  c4_PtrArray &items_, int index_, bool share_, bool log_): _name(name_),
+  _fileName(fileName_), _items(items_), _index(index_), _lock(0) {
+  NextGeneration(); // make sure all cached paths refresh on next access
+
+  if (*fileName_ && log_) {
+    c4_LogStrategy *strat = new c4_LogStrategy;
+    strat->DataOpen(fileName_, mode_);
+    if (!strat->IsValid()) {
+      delete strat;
+      return ;
+    }
+    _storage = c4_Storage(*strat, true, mode_);
+  } else if (*fileName_) {
     c4_Storage s(fileName_, mode_);
     if (!s.Strategy().IsValid())
       return ;
     _storage = s;
   }
 
-  if (_index >= _items.GetSize())
-    _items.SetSize(_index + 1);
-
-  _items.SetAt(_index, this);
-
   if (share_) {
+    Tcl_MutexLock(&lockMutex);
+#ifdef TCL_THREADS
+    _lock = new MkLock(this);
+#endif 
     if (_shared == 0)
       _shared = new c4_PtrArray;
     _shared->Add(this);
+    Tcl_MutexUnlock(&lockMutex);
+    return ;
   }
+
+  if (_index >= _items.GetSize())
+    _items.SetSize(_index + 1);
+
+  _items.SetAt(_index, this);
 }
 
 MkWorkspace::Item::~Item() {
@@ -745,13 +864,13 @@ MkWorkspace::Item::~Item() {
     path->_currGen = -1; // make sure lookup is retried on next use
     // TODO: get rid of generations, use a "_valid" flag instead
   }
-  ++generation; // make sure all cached paths refresh on next access
+  NextGeneration(); // make sure all cached paths refresh on next access
 
-  if (_index < _items.GetSize()) {
-    d4_assert(_items.GetAt(_index) == this || _items.GetAt(_index) == 0);
+  // shared items have no slot, their index may be in use by another item
+  if (_index < _items.GetSize() && _items.GetAt(_index) == this)
     _items.SetAt(_index, 0);
-  }
 
+  Tcl_MutexLock(&lockMutex);
   if (_shared != 0) {
     for (int i = 0; i < _shared->GetSize(); ++i)
     if (_shared->GetAt(i) == this) {
@@ -764,6 +883,13 @@ MkWorkspace::Item::~Item() {
       _shared = 0;
     }
   }
+
+  // the lock stays around until all its users are done with it
+  if (_lock != 0) {
+    _lock->_item = 0;
+    DropLock(_lock);
+  }
+  Tcl_MutexUnlock(&lockMutex);
 }
 
 void MkWorkspace::Item::ForceRefresh() {
@@ -773,10 +899,11 @@ void MkWorkspace::Item::ForceRefresh() {
     path->_view = c4_View();
   }
 
-  ++generation; // make sure all cached paths refresh on next access
+  NextGeneration(); // make sure all cached paths refresh on next access
 }
 
-MkWorkspace::MkWorkspace(Tcl_Interp *ip_): _interp(ip_), _chanList(0) {
+MkWorkspace::MkWorkspace(Tcl_Interp *ip_): _level(0), _waiting(0), _deadlock
+  (false), _interp(ip_), _chanList(0) {
   new Item("", "", 0, _items, 0);
 
   // never uses entry zero (so atoi failure in ForgetPath is harmless)
@@ -789,9 +916,31 @@ MkWorkspace::~MkWorkspace() {
 
   d4_assert(_chanList == 0);
 
+  Enter();
+
   for (int i = _items.GetSize(); --i >= 0;)
     delete Nth(i);
 
+  // also close the shared items which were opened in this workspace
+  for (;;) {
+    Item *ip = 0;
+
+    Tcl_MutexLock(&lockMutex);
+    for (int j = 0; ip == 0 && Item::_shared != 0 && j < Item::_shared
+      ->GetSize(); ++j) {
+      Item *sp = (Item*)Item::_shared->GetAt(j);
+      if (Owns(sp) && Lock(sp->_lock))
+        ip = sp;
+    }
+    Tcl_MutexUnlock(&lockMutex);
+
+    if (ip == 0)
+      break;
+    delete ip;
+  }
+
+  Leave();
+
   // need this to prevent recursion in Tcl_DeleteAssocData in 8.2 (not 8.0!)
   Tcl_DeleteEventSource(SetupProc, CheckProc, this);
   Tcl_SetAssocData(_interp, "mk4tcl", 0, 0);
@@ -803,7 +952,7 @@ void MkWorkspace::DefCmd(MkTcl *cmd_) {
 }
 
 MkWorkspace::Item *MkWorkspace::Define(const char *name_, const char *fileName_,
-  int mode_, bool share_) {
+  int mode_, bool share_, bool log_) {
   Item *ip = Find(name_);
 
   if (ip == 0) {
@@ -812,7 +961,7 @@ MkWorkspace::Item *MkWorkspace::Define(const char *name_, const char *fileName_,
       if (Nth(n) == 0)
         break;
 
-    ip = new Item(name_, fileName_, mode_, _items, n, share_);
+    ip = new Item(name_, fileName_, mode_, _items, n, share_, log_);
     if (*fileName_ != 0 && !ip->_storage.Strategy().IsValid()) {
       delete ip;
       return 0;
@@ -822,23 +971,33 @@ MkWorkspace::Item *MkWorkspace::Define(const char *name_, const char *fileName_,
   return ip;
 }
 
-MkWorkspace::Item *MkWorkspace::Find(const char *name_)const {
+MkWorkspace::Item *MkWorkspace::Find(const char *name_) {
   for (int i = 0; i < _items.GetSize(); ++i) {
     Item *ip = Nth(i);
     if (ip && ip->_name.Compare(name_) == 0)
       return ip;
   }
 
+  Item *found = 0;
+
+  Tcl_MutexLock(&lockMutex);
   if (Item::_shared != 0)
    { // look in the shared pool, if there is one
     for (int j = 0; j < Item::_shared->GetSize(); ++j) {
       Item *ip = (Item*)Item::_shared->GetAt(j);
-      if (ip && ip->_name == name_)
-        return ip;
+      if (ip && ip->_name == name_) {
+        found = ip;
+        break;
+      }
     }
   }
 
-  return 0;
+  // the item may get closed by another thread while waiting for its lock
+  if (found != 0 && found->_lock != 0 && !Lock(found->_lock))
+    found = 0;
+  Tcl_MutexUnlock(&lockMutex);
+
+  return found;
 }
 
 int MkWorkspace::NumItems()const {
@@ -849,10 +1008,15 @@ MkWorkspace::Item *MkWorkspace::Nth(int index_)const {
   return (Item*)_items.GetAt(index_);
 }
 
+bool MkWorkspace::Owns(const Item *item_)const {
+  return &item_->_items == &_items;
+}
+
 MkPath *MkWorkspace::AddPath(const char * &name_, Tcl_Interp *interp) {
   const char *p = name_;
 
   Item *ip = Find(f4_GetToken(p));
+  int gen = CurrentGeneration();
   if (ip == 0) {
     ip = Nth(0);
     d4_assert(ip != 0);
@@ -862,7 +1026,9 @@ MkPath *MkWorkspace::AddPath(const char * &name_, Tcl_Interp *interp) {
     MkPath *path = (MkPath*)ip->_paths.GetAt(i);
     d4_assert(path != 0);
 
-    if (path->_path.CompareNoCase(name_) == 0 && path->_currGen == generation) {
+    // paths are never shared between workspaces, even for shared items
+    if (path->_ws == this && path->_path.CompareNoCase(name_) == 0 &&
+      path->_currGen == gen) {
       path->Refs( + 1);
       return path;
     }
@@ -1030,6 +1196,17 @@ static Tcl_ObjType mkPropertyType =  {
 
 const c4_Property &AsProperty(Tcl_Obj *objPtr, const c4_View &view_) {
   void *tag = (&view_[0])._seq; // horrific hack to get at c4_Sequence pointer
+  if (objPtr->typePtr ==  &mkPropertyType && objPtr
+    ->internalRep.twoPtrValue.ptr1 == tag) {
+    // the tag may be a sequence which has since been freed and reused,
+    // so make sure the cached property type still matches the view
+    const c4_Property &prop = *(c4_Property*)objPtr
+      ->internalRep.twoPtrValue.ptr2;
+    int n = ((c4_View &)view_).FindProperty(prop.GetId());
+    if (n >= 0 && view_.NthProperty(n).Type() != prop.Type())
+      objPtr->internalRep.twoPtrValue.ptr1 = 0;
+  }
+
   if (objPtr->typePtr !=  &mkPropertyType || objPtr
     ->internalRep.twoPtrValue.ptr1 != tag) {
     CONST86 Tcl_ObjType *oldTypePtr = objPtr->typePtr;
@@ -1103,29 +1280,88 @@ int &AsIndex(Tcl_Obj *obj_) {
   return (int &)obj_->internalRep.twoPtrValue.ptr1;
 }
 
+// take the locks of the shared storages named in the arguments of a command,
+// lowest address first, while no locks are held yet, so that commands which
+// use several of them wait for each other in one order
+void MkWorkspace::LockArgs(int objc_, Tcl_Obj *const *objv_) {
+  d4_assert(_level > 0);
+
+  if (_locks.GetSize() > 0)
+    return ;
+
+  c4_PtrArray wanted;
+
+  Tcl_MutexLock(&lockMutex);
+  for (int i = 1; Item::_shared != 0 && i < objc_; ++i) {
+    MkLock *lock = 0;
+    Tcl_Obj *obj = objv_[i];
+    if (obj->typePtr == &mkCursorType)
+      lock = AsPath(obj)._lock;
+    else if (obj->bytes != 0 && obj->length < 256) {
+      // a short string may be a path, starting with the storage tag
+      const char *p = obj->bytes;
+      c4_String tag = f4_GetToken(p);
+      for (int j = 0; j < Item::_shared->GetSize(); ++j) {
+        Item *ip = (Item*)Item::_shared->GetAt(j);
+        if (ip->_name == tag) {
+          lock = ip->_lock;
+          break;
+        }
+      }
+    }
+
+    // keep them sorted and without duplicates
+    int k = wanted.GetSize();
+    while (lock != 0 && k > 0 && (char*)wanted.GetAt(k - 1) > (char*)lock)
+      --k;
+    if (lock != 0 && (k == 0 || wanted.GetAt(k - 1) != lock))
+      wanted.InsertAt(k, lock);
+  }
+
+  // a lock may be released while waiting, so each one is kept referenced
+  for (int j = 0; j < wanted.GetSize(); ++j)
+    ++((MkLock*)wanted.GetAt(j))->_refs;
+  for (int j = 0; j < wanted.GetSize(); ++j) {
+    MkLock *lock = (MkLock*)wanted.GetAt(j);
+    if (lock->_item != 0)
+      Lock(lock);
+    DropLock(lock);
+  }
+  Tcl_MutexUnlock(&lockMutex);
+}
+
 static void FreeCursorInternalRep(Tcl_Obj *cursorPtr) {
   MkPath &path = AsPath(cursorPtr);
-  EnterMutex(path._ws->_interp);
+  MkWorkspace *ws = path._ws;
+  ws->Enter();
   path.Refs( - 1);
-  LeaveMutex();
+  ws->Leave();
 }
 
 static void DupCursorInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *copyPtr) {
   MkPath &path = AsPath(srcPtr);
-  EnterMutex(path._ws->_interp);
+  path._ws->Enter();
   path.Refs( + 1);
   copyPtr->internalRep = srcPtr->internalRep;
   copyPtr->typePtr = &mkCursorType;
-  LeaveMutex();
+  path._ws->Leave();
 }
 
 int SetCursorFromAny(Tcl_Interp *interp, Tcl_Obj *objPtr) {
   d4_assert(interp != 0);
-  EnterMutex(interp);
 
-  // force a relookup if the this object is of the wrong generation
-  if (objPtr->typePtr == &mkCursorType && AsPath(objPtr)._currGen !=
-    generation) {
+  // dig up the workspace used in this interpreter
+  MkWorkspace *work = (MkWorkspace*)Tcl_GetAssocData(interp, "mk4tcl", 0);
+  work->Enter();
+
+  // a cursor on a shared storage may only be used while holding its lock
+  bool locked = objPtr->typePtr != &mkCursorType || LockPath(*work, AsPath
+    (objPtr));
+
+  // force a relookup if the this object is of the wrong generation, or if
+  // its storage could not be locked
+  if (objPtr->typePtr == &mkCursorType && (!locked || AsPath(objPtr)._currGen
+    != CurrentGeneration())) {
     // make sure we have a string representation around
     if (objPtr->bytes == 0)
       UpdateStringOfCursor(objPtr);
@@ -1140,8 +1376,6 @@ int SetCursorFromAny(Tcl_Interp *interp, Tcl_Obj *objPtr) {
 
     const char *string = Tcl_GetStringFromObj(objPtr, 0);
 
-    // dig up the workspace used in this interpreter
-    MkWorkspace *work = (MkWorkspace*)Tcl_GetAssocData(interp, "mk4tcl", 0);
     // cast required for Mac
     char *s = (char*)(void*)work->AddPath(string, interp);
     int i = isdigit(*string) ? atoi(string):  - 1;
@@ -1154,13 +1388,13 @@ int SetCursorFromAny(Tcl_Interp *interp, Tcl_Obj *objPtr) {
     objPtr->internalRep.twoPtrValue.ptr2 = s;
   }
 
-  LeaveMutex();
+  work->Leave();
   return TCL_OK;
 }
 
 static void UpdateStringOfCursor(Tcl_Obj *cursorPtr) {
   MkPath &path = AsPath(cursorPtr);
-  EnterMutex(path._ws->_interp);
+  path._ws->Enter();
   c4_String s = path._path;
 
   int index = AsIndex(cursorPtr);
@@ -1172,7 +1406,7 @@ static void UpdateStringOfCursor(Tcl_Obj *cursorPtr) {
 
   cursorPtr->length = s.GetLength();
   cursorPtr->bytes = strcpy(Tcl_Alloc(cursorPtr->length + 1), s);
-  LeaveMutex();
+  path._ws->Leave();
 }
 
 static Tcl_Obj *AllocateNewTempRow(MkWorkspace &work_) {
@@ -1758,6 +1992,19 @@ int MkTcl::FileCmd() {
       }
     }
 
+    // shared items opened here are not in the above list, add them as well
+    Tcl_MutexLock(&lockMutex);
+    c4_PtrArray *shared = MkWorkspace::Item::_shared;
+    for (int j = 0; shared != 0 && j < shared->GetSize() && !_error; ++j) {
+      MkWorkspace::Item *ip = (MkWorkspace::Item*)shared->GetAt(j);
+
+      if (work.Owns(ip)) {
+        tcl_ListObjAppendElement(result, tcl_NewStringObj(ip->_name));
+        tcl_ListObjAppendElement(result, tcl_NewStringObj(ip->_fileName));
+      }
+    }
+    Tcl_MutexUnlock(&lockMutex);
+
     return _error;
   }
 
@@ -1774,9 +2021,9 @@ int MkTcl::FileCmd() {
           return Fail("file already open");
 
         int mode = 1;
-        bool nocommit = false, shared = false;
+        bool nocommit = false, shared = false, log = false;
         static const char *options[] =  {
-          "-readonly", "-extend", "-nocommit", "-shared", 0
+          "-readonly", "-extend", "-nocommit", "-shared", "-log", 0
         }
         ;
 
@@ -1794,6 +2041,9 @@ int MkTcl::FileCmd() {
         case 3:
           shared = true;
           break;
+        case 4:
+          log = true;
+          break;
         default:
           return _error;
         }
@@ -1802,11 +2052,11 @@ int MkTcl::FileCmd() {
         int len = 0;
         const char *file = objc < 4 ? "": Tcl_GetStringFromObj(objv[3], &len);
 #ifdef WIN32
-        np = work.Define(name, file, mode, shared);
+        np = work.Define(name, file, mode, shared, log);
 #else 
         Tcl_DString ds;
         const char *native = Tcl_UtfToExternalDString(NULL, file, len, &ds);
-        np = work.Define(name, native, mode, shared);
+        np = work.Define(name, native, mode, shared, log);
         Tcl_DStringFree(&ds);
 #endif 
         if (np == 0)
@@ -1832,11 +2082,11 @@ int MkTcl::FileCmd() {
 #endif 
         if (!err || !strat.IsValid())
           return Fail("no such file");
-        t4_i32 end = strat.EndOfData();
+        t4_off end = strat.EndOfData();
         if (end < 0)
           return Fail("not a Metakit datafile");
 
-        Tcl_SetIntObj(tcl_GetObjResult(), end);
+        Tcl_SetWideIntObj(tcl_GetObjResult(), (Tcl_WideInt)end);
         return _error;
       }
       break;
@@ -2197,9 +2447,9 @@ int MkTcl::LoopCmd() {
     if (!(i < limit && incr > 0 || i > limit && incr < 0))
       break;
 
-    LeaveMutex();
+    work.Leave();
     _error = Tcl_EvalObj(interp, cmd);
-    EnterMutex(interp);
+    work.Enter();
 
     if (_error == TCL_CONTINUE)
       _error = TCL_OK;
@@ -2432,6 +2682,13 @@ int MkTcl::ChannelCmd() {
   if (id == 2)
     Tcl_Seek(mkChan->_chan, 0, SEEK_END);
 
+  // mapped memos are copied out directly, so fewer and larger reads pay off
+  if (id == 0 && mkChan->_mapStart != 0) {
+    int size = mkChan->_dataSize < 65536 ? mkChan->_dataSize : 65536;
+    if (size > Tcl_GetChannelBufferSize(mkChan->_chan))
+      Tcl_SetChannelBufferSize(mkChan->_chan, size);
+  }
+
   Tcl_RegisterChannel(interp, mkChan->_chan);
 
   if (_error)
@@ -2481,6 +2738,9 @@ int MkTcl::Execute(int oc, Tcl_Obj *const * ov) {
     ,  {
       3, 4, "channel path prop ?mode?"
     }
+    ,  {
+      2, 4, "vfs option ?tag? ?path?"
+    }
     , 
     {
       0, 0, 0
@@ -2503,7 +2763,8 @@ int MkTcl::Execute(int oc, Tcl_Obj *const * ov) {
     return Fail(msg);
   }
 
-  EnterMutex(interp);
+  work.Enter();
+  work.LockArgs(oc, ov);
   int result = 0;
   switch (id) {
     case 0:
@@ -2533,8 +2794,15 @@ int MkTcl::Execute(int oc, Tcl_Obj *const * ov) {
     case 8:
       result = ChannelCmd();
       break;
+    case 9:
+      result = VfsCmd();
+      break;
+  }
+  if (work.Deadlocked()) {
+    _error = 0;
+    result = Fail("deadlock on a shared storage, the command was not done");
   }
-  LeaveMutex();
+  work.Leave();
   return result;
 }
 
@@ -2548,6 +2816,7 @@ void MkWorkspace::CleanupCommands() {
 
 static void ExitProc(ClientData cd_) {
   Tcl_DeleteEventSource(SetupProc, CheckProc, cd_);
+  MkVfsUnmountAll((MkWorkspace*)cd_);
   delete (MkWorkspace*)cd_;
 }
 
@@ -2578,7 +2847,7 @@ static int Mktcl_Cmds(Tcl_Interp *interp, bool /*safe*/) {
   // this list must match the "CmdDef defTab []" above.
   static const char *cmds[] =  {
     "get", "set", "cursor", "row", "view", "file", "loop", "select", "channel", 
-    0
+    "vfs", 0
   };
 
   c4_String prefix = "mk::";
@@ -92,6 +92,8 @@ int SetAsObj(Tcl_Interp *interp, const c4_RowRef &row_, const c4_Property
 // A path is a view which knows its place, and what workspace it belongs to.
 // Since it contains a string version, its tag can be used to find the item.
 
+class MkLock;
+
 class MkPath {
     int _refs; // reference count
 
@@ -106,6 +108,7 @@ class MkPath {
     c4_View _view; // the view corresponding to this path
     c4_String _path; // describes view, starting with storage tag
     int _currGen; // tracks the generation to force reloads
+    MkLock *_lock; // lock of the storage, if it is a shared one
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -119,6 +122,10 @@ class MkWorkspace {
     c4_Bytes _usedBuffer; // buffer, using 1 byte per entry
     t4_byte *_usedRows; // 1 if that row in item 0 is currently in use
     c4_PtrArray _commands;
+    c4_PtrArray _locks; // locks held by this workspace, see Lock()
+    int _level; // nesting level of calls into Mk4tcl from this interp
+    MkLock *_waiting; // the lock this workspace waits for, if any
+    bool _deadlock; // a lock was refused, as waiting would deadlock
 
   public:
     Tcl_Interp *_interp;
@@ -131,15 +138,16 @@ class MkWorkspace {
         c4_PtrArray _paths; // the paths associated with this entry
         c4_PtrArray &_items; // array from which this item is referenced
         int _index; // position in the _items array
+        MkLock *_lock; // only set for shared items, which are not in _items
 
         //Item ();        // special first entry initializer
         Item(const char *name_, const char *fileName_, int mode_, c4_PtrArray
-          &items_, int index_, bool share_ = false);
+          &items_, int index_, bool share_ = false, bool log_ = false);
         ~Item();
 
         void ForceRefresh(); // bump the generation to recreate views
 
-        static c4_PtrArray *_shared; // shared items are also listed here
+        static c4_PtrArray *_shared; // shared items are listed here instead
     };
 
     MkWorkspace(Tcl_Interp *ip_);
@@ -149,11 +157,24 @@ class MkWorkspace {
     void CleanupCommands();
 
     Item *Define(const char *name_, const char *fileName_, int mode_, bool
-      share_);
+      share_, bool log_ = false);
 
-    Item *Find(const char *name_)const;
+    Item *Find(const char *name_); // also locks the storage if shared
     int NumItems()const;
     Item *Nth(int index_)const;
+    bool Owns(const Item *item_)const; // true if opened in this workspace
+
+    // the Mk4tcl code is entered and left through these two
+    void Enter();
+    void Leave();
+    // wait for and take a lock, until the outermost Leave
+    bool Lock(MkLock *lock_);
+    // take the locks of the shared storages used by a command, in order
+    void LockArgs(int objc_, Tcl_Obj *const *objv_);
+    // true if a lock was refused since the outermost Enter
+    bool Deadlocked()const {
+        return _deadlock;
+    }
 
     // create a new path if it doesn't exist, else bump the reference count
     MkPath *AddPath(const char * &name_, Tcl_Interp *interp);
@@ -190,6 +211,9 @@ int SetCursorFromAny(Tcl_Interp *interp, Tcl_Obj *objPtr);
 // 24nov02: added to support releasing mutex lock during loop eval's
 int Mk_EvalObj(Tcl_Interp *ip_, Tcl_Obj *cmd_);
 
+// changes whenever a datafile is opened, closed, committed or reloaded
+int CurrentGeneration();
+
 ///////////////////////////////////////////////////////////////////////////////
 // Helper class for the mk::select command, stores params and performs select
 
@@ -289,6 +313,7 @@ class MkTcl: public Tcl {
     int CursorCmd();
     int SelectCmd();
     int ChannelCmd();
+    int VfsCmd(); // in mk4vfs.cpp
     int NewCmd();
     int Try1Cmd();
     int Try2Cmd();
@@ -299,6 +324,11 @@ class MkTcl: public Tcl {
     int Execute(int oc, Tcl_Obj *const * ov);
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Native VFS mounts, see mk4vfs.cpp: remove all mounts made in a workspace
+
+void MkVfsUnmountAll(MkWorkspace *ws_);
+
 ///////////////////////////////////////////////////////////////////////////////
 
 class MkView: public Tcl {
@@ -0,0 +1,1057 @@
+// mk4vfs.cpp -- Native Tcl filesystem for datafiles in the mk4vfs layout
+// This is part of Metakit, see http://www.equi4.com/metakit.html
+//
+// This serves the same "dirs" / "files" structure as mk4vfs.tcl, but as a
+// Tcl_Filesystem implemented directly on top of Metakit views, so that stat,
+// glob and open inside a starkit no longer evaluate Tcl scripts.  Mounts are
+// read-only, writing still needs the Tcl handler ("vfs::mk4::Mount").
+//
+//   mk::vfs mount tag path   - mount storage "tag" on path
+//   mk::vfs unmount path     - remove the mount again
+//   mk::vfs info             - list of mounted paths and their tags
+
+#include "mk4tcl.h"
+#include "mk4io.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef ENOENT
+#define ENOENT 2
+#endif
+#ifndef EIO
+#define EIO 5
+#endif
+#ifndef EISDIR
+#define EISDIR 21
+#endif
+#ifndef EINVAL
+#define EINVAL 22
+#endif
+#ifndef EROFS
+#define EROFS 30
+#endif
+#ifndef ENOTSUP
+#define ENOTSUP 48
+#endif
+
+#ifndef W_OK
+#define W_OK 2
+#endif
+
+#if 10 * TCL_MAJOR_VERSION + TCL_MINOR_VERSION < 85
+#define Tcl_StringCaseMatch(s,p,n) Tcl_StringMatch(s,p)
+#endif
+
+// compressed files need the zlib streams of the Tcl 8.6 core
+#if 10 * TCL_MAJOR_VERSION + TCL_MINOR_VERSION >= 86
+#define MKVFS_INFLATE 1
+#else
+#define MKVFS_INFLATE 0
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Defined in this file:
+
+class MkVfs;
+class MkVfsChannel;
+
+///////////////////////////////////////////////////////////////////////////////
+// The layout used by mk4vfs.tcl:
+//    dirs {name:S parent:I {files {name:S size:I date:I contents:M}}}
+// Row 0 of "dirs" is the root, deleted directories have their parent set to
+// -99.  A file is compressed if its size differs from that of its contents.
+
+static c4_StringProp pName("name");
+static c4_IntProp pParent("parent");
+static c4_ViewProp pFiles("files");
+static c4_IntProp pSize("size");
+static c4_IntProp pDate("date");
+static c4_BytesProp pContents("contents");
+
+// The optional path index stored by "mk4vfs::index":
+//    dirs_H {_H:I _R:I}
+//    files_H {count:I {map {_H:I _R:I}}}
+// The first is the hash map of "dirs" on (name, parent), the second has one
+// row per directory with its file count when indexed, and a hash map of its
+// files on name.  The maps are only used while the counts still match.
+
+static c4_IntProp pCount("count");
+static c4_ViewProp pMap("map");
+
+///////////////////////////////////////////////////////////////////////////////
+// A mount point, with an index from relative paths to directory and file rows.
+//
+// Paths are resolved through the index stored in the datafile if it has one.
+// Otherwise an index is built in memory on first use.  Hits are verified
+// against the row names, and misses are checked against the number of
+// directories and the number of files in the parent, so changes made through
+// the mk::* commands cause a rebuild instead of stale results.
+
+class MkVfs {
+    MkWorkspace::Item *_item; // the item the index was built for, or zero
+    int _numDirs; // size of the "dirs" view when indexed
+    Tcl_HashTable _index; // path to entry number, valid if _item is set
+    c4_DWordArray _entries; // pairs of dir and file row, file is -1 for dirs
+    c4_DWordArray _counts; // number of files in each directory when indexed
+    c4_DWordArray _first; // first subdirectory of each directory, or -1
+    c4_DWordArray _sibling; // next subdirectory of the same parent, or -1
+
+    void Build(MkWorkspace::Item *ip_);
+    bool Verify(const c4_View &dirs_, const char *path_, int dir_, int file_);
+    bool Changed(const c4_View &dirs_, const char *path_);
+    bool Resolve(c4_Storage &storage_, const char *path_, int &dir_, int
+      &file_, bool &found_);
+
+  public:
+    MkVfs *_next;
+    MkWorkspace *_ws; // workspace in which the storage was opened
+    c4_String _tag; // storage name, as in "mk::file open"
+    c4_String _local; // normalized mount point
+    bool _inflate; // true if compressed files can be read
+
+    MkVfs(MkWorkspace *ws_, const char *tag_, const char *local_);
+    ~MkVfs();
+
+    // these must be called between Enter() and Leave() of the workspace
+    MkWorkspace::Item *Storage();
+    bool Lookup(MkWorkspace::Item *ip_, const char *path_, int &dir_, int
+      &file_);
+    void List(MkWorkspace::Item *ip_, int dir_, int types_, const char
+      *pattern_, c4_StringArray &names_);
+};
+
+MkVfs::MkVfs(MkWorkspace *ws_, const char *tag_, const char *local_): _item(0),
+  _numDirs(0), _next(0), _ws(ws_), _tag(tag_), _local(local_), _inflate(false)
+  {}
+
+MkVfs::~MkVfs() {
+  if (_item != 0)
+    Tcl_DeleteHashTable(&_index);
+}
+
+MkWorkspace::Item *MkVfs::Storage() {
+  MkWorkspace::Item *ip = _ws->Find(_tag);
+  if (ip != _item && _item != 0) {
+    // closed, or reopened under the same name
+    Tcl_DeleteHashTable(&_index);
+    _item = 0;
+  }
+  return ip;
+}
+
+// resolve the path of a directory, returns false if it is deleted or orphaned
+static bool ResolveDir(const c4_View &dirs_, int row_, c4_StringArray &paths_,
+  c4_DWordArray &state_) {
+  // state: 0 = not yet seen, 1 = valid, 2 = invalid, 3 = being resolved
+  int s = state_.GetAt(row_);
+  if (s == 1 || s == 2)
+    return s == 1;
+  if (s == 3) {
+    state_.SetAt(row_, 2); // a cycle
+    return false;
+  }
+
+  state_.SetAt(row_, 3);
+
+  bool ok = row_ == 0;
+  if (row_ > 0) {
+    int parent = pParent(dirs_[row_]);
+    if (parent >= 0 && parent < dirs_.GetSize() && ResolveDir(dirs_, parent,
+      paths_, state_)) {
+      c4_String path = paths_.GetAt(parent);
+      if (!path.IsEmpty())
+        path += "/";
+      path += (const char*)pName(dirs_[row_]);
+      paths_.SetAt(row_, path);
+      ok = true;
+    }
+  }
+
+  state_.SetAt(row_, ok ? 1 : 2);
+  return ok;
+}
+
+void MkVfs::Build(MkWorkspace::Item *ip_) {
+  if (_item != 0)
+    Tcl_DeleteHashTable(&_index);
+  Tcl_InitHashTable(&_index, TCL_STRING_KEYS);
+  _item = ip_;
+
+  c4_View dirs = ip_->_storage.View("dirs");
+  int n = dirs.GetSize();
+
+  _numDirs = n;
+  _entries.SetSize(0);
+  _counts.SetSize(n);
+  _first.SetSize(n);
+  _sibling.SetSize(n);
+
+  c4_StringArray paths;
+  paths.SetSize(n);
+  c4_DWordArray state;
+  state.SetSize(n);
+
+  int i;
+  for (i = 0; i < n; ++i) {
+    state.SetAt(i, 0);
+    _first.SetAt(i,  - 1);
+    _sibling.SetAt(i,  - 1);
+    _counts.SetAt(i, 0);
+  }
+
+  // parents normally precede their children, but don't rely on it
+  for (i = n; --i >= 0;)
+    if (ResolveDir(dirs, i, paths, state) && i > 0) {
+      int parent = pParent(dirs[i]);
+      _sibling.SetAt(i, _first.GetAt(parent));
+      _first.SetAt(parent, i);
+    }
+
+  int isNew;
+  for (i = 0; i < n; ++i)
+    if (state.GetAt(i) == 1) {
+      c4_String path = paths.GetAt(i);
+      Tcl_HashEntry *hp = Tcl_CreateHashEntry(&_index, path, &isNew);
+      Tcl_SetHashValue(hp, (ClientData)(size_t)(_entries.GetSize() / 2));
+      _entries.Add(i);
+      _entries.Add( - 1);
+    }
+
+  // files go in last, so they win over directories of the same name
+  for (i = 0; i < n; ++i)
+    if (state.GetAt(i) == 1) {
+      c4_String prefix = paths.GetAt(i);
+      if (!prefix.IsEmpty())
+        prefix += "/";
+
+      c4_View files = pFiles(dirs[i]);
+      int m = files.GetSize();
+      _counts.SetAt(i, m);
+
+      for (int j = 0; j < m; ++j) {
+        c4_String path = prefix + (const char*)pName(files[j]);
+        Tcl_HashEntry *hp = Tcl_CreateHashEntry(&_index, path, &isNew);
+        Tcl_SetHashValue(hp, (ClientData)(size_t)(_entries.GetSize() / 2));
+        _entries.Add(i);
+        _entries.Add(j);
+      }
+    }
+}
+
+// true if the entry found in the index still has the right name
+bool MkVfs::Verify(const c4_View &dirs_, const char *path_, int dir_, int
+  file_) {
+  if (dir_ >= dirs_.GetSize())
+    return false;
+
+  const char *tail = strrchr(path_, '/');
+  tail = tail != 0 ? tail + 1 : path_;
+
+  if (file_ < 0)
+    return dir_ == 0 || strcmp(pName(dirs_[dir_]), tail) == 0;
+
+  c4_View files = pFiles(dirs_[dir_]);
+  return file_ < files.GetSize() && strcmp(pName(files[file_]), tail) == 0;
+}
+
+// true if a missing path may have been added since the index was built
+bool MkVfs::Changed(const c4_View &dirs_, const char *path_) {
+  if (dirs_.GetSize() != _numDirs)
+    return true;
+
+  const char *tail = strrchr(path_, '/');
+  c4_String parent(path_, tail != 0 ? tail - path_ : 0);
+
+  Tcl_HashEntry *hp = Tcl_FindHashEntry(&_index, parent);
+  if (hp == 0)
+    return false;
+
+  int e = (int)(size_t)Tcl_GetHashValue(hp);
+  int dir = _entries.GetAt(2 *e);
+  if (_entries.GetAt(2 *e + 1) >= 0)
+    return false;
+
+  return pFiles(dirs_[dir]).GetSize() != _counts.GetAt(dir);
+}
+
+// look up a path with the stored index, false if it is missing or outdated
+bool MkVfs::Resolve(c4_Storage &storage_, const char *path_, int &dir_, int
+  &file_, bool &found_) {
+  if (storage_.FindPropIndexByName("files_H") < 0 ||
+    storage_.FindPropIndexByName("dirs_H") < 0)
+    return false;
+
+  c4_View dirs = storage_.View("dirs");
+  c4_View dmap = storage_.View("dirs_H");
+  c4_View fmaps = storage_.View("files_H");
+
+  int n = dirs.GetSize();
+  if (dmap.GetSize() == 0 || fmaps.GetSize() != n)
+    return false;
+
+  // this does not modify the map, it is only resized when empty or full
+  c4_View hdirs = dirs.Hash(dmap, 2);
+
+  dir_ = 0;
+  file_ =  - 1;
+  found_ = false;
+
+  while (*path_ != 0) {
+    const char *next = strchr(path_, '/');
+    c4_String name(path_, next != 0 ? next - path_ : strlen(path_));
+    path_ = next != 0 ? next + 1 : "";
+
+    if (*path_ == 0) {
+      // the last component, files win over directories of the same name
+      c4_View files = pFiles(dirs[dir_]);
+      c4_RowRef info = fmaps[dir_];
+      if (pCount(info) != files.GetSize())
+        return false;
+
+      c4_View fmap = pMap(info);
+      if (fmap.GetSize() > 0) {
+        c4_Row key;
+        pName(key) = name;
+        int j = files.Hash(fmap, 1).Find(key);
+        if (j >= 0) {
+          file_ = j;
+          found_ = true;
+          return true;
+        }
+      }
+    }
+
+    c4_Row key;
+    pName(key) = name;
+    pParent(key) = dir_;
+    dir_ = hdirs.Find(key);
+    if (dir_ < 0)
+      return true;
+  }
+
+  found_ = true;
+  return true;
+}
+
+bool MkVfs::Lookup(MkWorkspace::Item *ip_, const char *path_, int &dir_, int
+  &file_) {
+  bool found;
+  if (_item == 0 && Resolve(ip_->_storage, path_, dir_, file_, found))
+    return found;
+
+  bool rebuilt = _item == 0;
+  if (rebuilt)
+    Build(ip_);
+
+  c4_View dirs = ip_->_storage.View("dirs");
+
+  for (;;) {
+    Tcl_HashEntry *hp = Tcl_FindHashEntry(&_index, path_);
+    if (hp != 0) {
+      int e = (int)(size_t)Tcl_GetHashValue(hp);
+      dir_ = _entries.GetAt(2 *e);
+      file_ = _entries.GetAt(2 *e + 1);
+      if (Verify(dirs, path_, dir_, file_))
+        return true;
+    } else if (!Changed(dirs, path_))
+      return false;
+
+    if (rebuilt)
+      return false;
+
+    Build(ip_);
+    rebuilt = true;
+  }
+}
+
+void MkVfs::List(MkWorkspace::Item *ip_, int dir_, int types_, const char
+  *pattern_, c4_StringArray &names_) {
+  c4_View dirs = ip_->_storage.View("dirs");
+
+  if (types_ == 0 || (types_ &TCL_GLOB_TYPE_DIR)) {
+    if (_item != 0 && _numDirs == dirs.GetSize())
+      for (int i = _first.GetAt(dir_); i >= 0; i = _sibling.GetAt(i)) {
+        const char *name = pName(dirs[i]);
+        if (Tcl_StringCaseMatch(name, pattern_, 0))
+          names_.Add(name);
+      }
+    else
+      // resolved through the stored index, there are no links to follow
+      for (int i = 1; i < dirs.GetSize(); ++i)
+        if (pParent(dirs[i]) == dir_) {
+          const char *name = pName(dirs[i]);
+          if (Tcl_StringCaseMatch(name, pattern_, 0))
+            names_.Add(name);
+        }
+  }
+
+  if (types_ == 0 || (types_ &TCL_GLOB_TYPE_FILE)) {
+    c4_View files = pFiles(dirs[dir_]);
+    for (int j = 0; j < files.GetSize(); ++j) {
+      const char *name = pName(files[j]);
+      if (Tcl_StringCaseMatch(name, pattern_, 0))
+        names_.Add(name);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Mounts are kept per thread, like the interps and workspaces they belong to.
+// The filesystem itself is registered once, on the first mount in any thread.
+
+TCL_DECLARE_MUTEX(vfsMutex)
+static Tcl_ThreadDataKey vfsKey;
+static bool vfsRegistered = false;
+
+static MkVfs **MountList() {
+  return (MkVfs **)Tcl_GetThreadData(&vfsKey, sizeof(MkVfs*));
+}
+
+// the internal representation of a path in one of our mounts
+struct MkVfsRep {
+  MkVfs *_vfs;
+  int _split; // offset of the relative part in the normalized path
+};
+
+static Tcl_FSPathInFilesystemProc VfsPathInFilesystem;
+static Tcl_FSDupInternalRepProc VfsDupInternalRep;
+static Tcl_FSFreeInternalRepProc VfsFreeInternalRep;
+static Tcl_FSFilesystemPathTypeProc VfsFilesystemPathType;
+static Tcl_FSFilesystemSeparatorProc VfsFilesystemSeparator;
+static Tcl_FSStatProc VfsStat;
+static Tcl_FSAccessProc VfsAccess;
+static Tcl_FSOpenFileChannelProc VfsOpenFileChannel;
+static Tcl_FSMatchInDirectoryProc VfsMatchInDirectory;
+static Tcl_FSUtimeProc VfsUtime;
+static Tcl_FSCreateDirectoryProc VfsReadOnly;
+static Tcl_FSRemoveDirectoryProc VfsRemoveDirectory;
+
+static Tcl_Filesystem mkVfsFilesystem =  {
+  "mk4vfs", sizeof(Tcl_Filesystem), TCL_FILESYSTEM_VERSION_1,
+    VfsPathInFilesystem, VfsDupInternalRep, VfsFreeInternalRep,
+  // no pure internal paths, and only one representation of each path
+  0, 0, 0, VfsFilesystemPathType, VfsFilesystemSeparator, VfsStat, VfsAccess,
+    VfsOpenFileChannel, VfsMatchInDirectory, VfsUtime,
+  // no links, no volumes and no attributes
+  0, 0, 0, 0, 0, VfsReadOnly, VfsRemoveDirectory,
+    VfsReadOnly,
+  // let Tcl fall back to copying through channels, and to its own lstat,
+  // load, getcwd and chdir
+  0, 0, 0, 0, 0, 0, 0
+};
+
+static void VfsExitProc(ClientData clientData) {
+  Tcl_FSUnregister(&mkVfsFilesystem);
+}
+
+static int VfsPathInFilesystem(Tcl_Obj *pathPtr, ClientData *clientDataPtr) {
+  MkVfs *list =  *MountList();
+  if (list == 0)
+    return  - 1;
+
+  Tcl_Obj *normed = Tcl_FSGetNormalizedPath(0, pathPtr);
+  if (normed == 0)
+    return  - 1;
+
+  int len;
+  const char *path = Tcl_GetStringFromObj(normed, &len);
+
+  // use the most specific mount point, i.e. the longest one
+  MkVfs *found = 0;
+  int split = 0;
+  for (MkVfs *vfs = list; vfs != 0; vfs = vfs->_next) {
+    int n = vfs->_local.GetLength();
+    if (n > split && n <= len && strncmp(path, vfs->_local, n) == 0 && (n ==
+      len || path[n] == '/')) {
+      found = vfs;
+      split = n;
+    }
+  }
+
+  if (found == 0)
+    return  - 1;
+
+  MkVfsRep *rep = (MkVfsRep*)ckalloc(sizeof(MkVfsRep));
+  rep->_vfs = found;
+  rep->_split = split;
+  *clientDataPtr = (ClientData)rep;
+  return TCL_OK;
+}
+
+static ClientData VfsDupInternalRep(ClientData clientData) {
+  MkVfsRep *rep = (MkVfsRep*)ckalloc(sizeof(MkVfsRep));
+  *rep = *(MkVfsRep*)clientData;
+  return (ClientData)rep;
+}
+
+static void VfsFreeInternalRep(ClientData clientData) {
+  ckfree((char*)clientData);
+}
+
+// find the mount of a path and its path relative to the mount point
+static MkVfs *VfsGetPath(Tcl_Obj *pathPtr, const char * &relative_) {
+  MkVfsRep *rep = (MkVfsRep*)Tcl_FSGetInternalRep(pathPtr, &mkVfsFilesystem);
+  if (rep == 0)
+    return 0;
+
+  relative_ = Tcl_GetString(Tcl_FSGetNormalizedPath(0, pathPtr)) + rep
+    ->_split;
+  if (*relative_ == '/')
+    ++relative_;
+  return rep->_vfs;
+}
+
+// Looks up a path in its storage, while keeping the workspace entered, so
+// that shared storages stay locked until the Leave() in the destructor.
+
+class VfsEntry {
+    MkVfs *_vfs;
+  public:
+    MkWorkspace::Item *_item;
+    int _dir;
+    int _file; // -1 for a directory
+    bool _found;
+
+    VfsEntry(Tcl_Obj *pathPtr): _vfs(0), _item(0), _dir(0), _file( - 1),
+      _found(false) {
+        const char *relative;
+        _vfs = VfsGetPath(pathPtr, relative);
+        if (_vfs != 0) {
+          _vfs->_ws->Enter();
+          _item = _vfs->Storage();
+          _found = _item != 0 && _vfs->Lookup(_item, relative, _dir, _file);
+        }
+        if (!_found)
+          Tcl_SetErrno(ENOENT);
+    }
+
+    ~VfsEntry() {
+        if (_vfs != 0)
+          _vfs->_ws->Leave();
+    }
+
+    MkVfs *Vfs()const {
+        return _vfs;
+    }
+
+};
+
+static Tcl_Obj *VfsFilesystemPathType(Tcl_Obj *pathPtr) {
+  const char *relative;
+  MkVfs *vfs = VfsGetPath(pathPtr, relative);
+  return vfs != 0 ? Tcl_NewStringObj(vfs->_tag, -1): 0;
+}
+
+static Tcl_Obj *VfsFilesystemSeparator(Tcl_Obj *pathPtr) {
+  return Tcl_NewStringObj("/", 1);
+}
+
+static int VfsStat(Tcl_Obj *pathPtr, Tcl_StatBuf *bufPtr) {
+  VfsEntry entry(pathPtr);
+  if (!entry._found)
+    return  - 1;
+
+  c4_View dirs = entry._item->_storage.View("dirs");
+  c4_View files = pFiles(dirs[entry._dir]);
+
+  memset(bufPtr, 0, sizeof *bufPtr);
+  if (entry._file < 0) {
+    bufPtr->st_mode = S_IFDIR | 0777;
+    bufPtr->st_nlink = files.GetSize() + 1;
+  } else {
+    c4_RowRef file = files[entry._file];
+    bufPtr->st_mode = S_IFREG | 0777;
+    bufPtr->st_nlink = 1;
+    bufPtr->st_size = pSize(file);
+    bufPtr->st_atime = bufPtr->st_mtime = bufPtr->st_ctime = pDate(file);
+  }
+  return 0;
+}
+
+static int VfsAccess(Tcl_Obj *pathPtr, int mode) {
+  VfsEntry entry(pathPtr);
+  if (!entry._found)
+    return  - 1;
+
+  if (mode &W_OK) {
+    Tcl_SetErrno(EROFS);
+    return  - 1;
+  }
+  return 0;
+}
+
+static int VfsReadOnly(Tcl_Obj *pathPtr) {
+  Tcl_SetErrno(EROFS);
+  return  - 1;
+}
+
+static int VfsRemoveDirectory(Tcl_Obj *pathPtr, int recursive, Tcl_Obj
+  **errorPtr) {
+  *errorPtr = pathPtr;
+  Tcl_IncrRefCount(pathPtr);
+  return VfsReadOnly(pathPtr);
+}
+
+static int VfsUtime(Tcl_Obj *pathPtr, struct utimbuf *tval) {
+  return VfsReadOnly(pathPtr);
+}
+
+static int CompareNames(const void *a_, const void *b_) {
+  return strcmp(*(const char **)a_, *(const char **)b_);
+}
+
+static int VfsMatchInDirectory(Tcl_Interp *interp, Tcl_Obj *resultPtr, Tcl_Obj
+  *pathPtr, const char *pattern, Tcl_GlobTypeData *types) {
+  int type = types != 0 ? types->type : 0;
+
+  if (type &TCL_GLOB_TYPE_MOUNT) {
+    // report our mount points which are directly inside this directory
+    int len;
+    const char *prefix = Tcl_GetStringFromObj(Tcl_FSGetNormalizedPath(0,
+      pathPtr), &len);
+    if (len > 0 && prefix[len - 1] == '/')
+      --len;
+
+    for (MkVfs *vfs =  *MountList(); vfs != 0; vfs = vfs->_next) {
+      const char *local = vfs->_local;
+      if (vfs->_local.GetLength() > len + 1 && strncmp(local, prefix, len) ==
+        0 && local[len] == '/' && strchr(local + len + 1, '/') == 0 &&
+        Tcl_StringCaseMatch(local + len + 1, pattern, 0))
+        Tcl_ListObjAppendElement(0, resultPtr, Tcl_NewStringObj(local, -1));
+    }
+    return TCL_OK;
+  }
+
+  VfsEntry entry(pathPtr);
+  if (!entry._found)
+    return TCL_OK;
+
+  if (pattern == 0) {
+    // only check whether this path exists and has the right type
+    if (type == 0 || (type &(entry._file < 0 ? TCL_GLOB_TYPE_DIR :
+      TCL_GLOB_TYPE_FILE)))
+      Tcl_ListObjAppendElement(0, resultPtr, pathPtr);
+    return TCL_OK;
+  }
+
+  if (entry._file >= 0)
+    return TCL_OK;
+
+  c4_StringArray names;
+  entry.Vfs()->List(entry._item, entry._dir, type, pattern, names);
+
+  // sorted and without duplicates, as returned by mk4vfs.tcl
+  int n = names.GetSize();
+  const char **sorted = (const char **)ckalloc(n * sizeof(const char*) + 1);
+  for (int i = 0; i < n; ++i)
+    sorted[i] = names.GetAt(i);
+  qsort(sorted, n, sizeof(const char*), CompareNames);
+
+  for (int j = 0; j < n; ++j)
+    if (j == 0 || strcmp(sorted[j - 1], sorted[j]) != 0) {
+      KeepRef name(Tcl_NewStringObj(sorted[j],  - 1));
+      Tcl_Obj *obj = name;
+      Tcl_ListObjAppendElement(0, resultPtr, Tcl_FSJoinToPath(pathPtr, 1,
+        &obj));
+    }
+
+  ckfree((char*)sorted);
+  return TCL_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A read-only channel on the contents of a file.
+//
+// If the contents are one contiguous piece of the memory-mapped datafile, they
+// are read from there without being copied first.  The storage is kept open
+// by the channel, and after a commit, which can move the contents or reuse
+// their space even if the mapping stays at the same address, they are looked
+// up again.  Anything else, including the inflated data of a compressed file,
+// is held in a byte array object.
+
+class MkVfsChannel {
+  public:
+    c4_Storage _storage; // keeps the datafile and its mapping alive
+    int _dir;
+    int _file;
+    c4_String _name; // to check that the file is still there after a remap
+    const t4_byte *_mapStart; // mapping which _data points into, or zero
+    int _gen; // generation in which _data was looked up in the mapping
+    const t4_byte *_data;
+    t4_i32 _size;
+    t4_i32 _position;
+    Tcl_Obj *_copy; // owns the data if it is not in the mapping
+    Tcl_Channel _chan;
+    Tcl_TimerToken _timer;
+    int _watchMask;
+
+    MkVfsChannel(c4_Storage &storage_, int dir_, int file_);
+    ~MkVfsChannel();
+
+    bool Attach(bool inflate_, bool map_);
+    bool Check();
+};
+
+MkVfsChannel::MkVfsChannel(c4_Storage &storage_, int dir_, int file_):
+  _storage(storage_), _dir(dir_), _file(file_), _mapStart(0), _gen(0), _data
+  (0), _size(0), _position(0), _copy(0), _chan(0), _timer(0), _watchMask(0){}
+
+MkVfsChannel::~MkVfsChannel() {
+  if (_timer != 0)
+    Tcl_DeleteTimerHandler(_timer);
+  if (_copy != 0)
+    Tcl_DecrRefCount(_copy);
+}
+
+#if MKVFS_INFLATE
+static Tcl_Obj *Inflate(const t4_byte *data_, int size_, int expect_) {
+  Tcl_ZlibStream zs;
+  if (Tcl_ZlibStreamInit(0, TCL_ZLIB_STREAM_INFLATE, TCL_ZLIB_FORMAT_ZLIB, 0,
+    0, &zs) != TCL_OK)
+    return 0;
+
+  KeepRef in(Tcl_NewByteArrayObj(data_, size_));
+  Tcl_Obj *out = Tcl_NewObj();
+  Tcl_IncrRefCount(out);
+
+  // the first get asks for the stored size, which normally inflates it all
+  // at once into an exact buffer, each further get appends at most one more
+  bool ok = Tcl_ZlibStreamPut(zs, in, TCL_ZLIB_FINALIZE) == TCL_OK;
+  int before =  - 1, after = 0;
+  while (ok && !Tcl_ZlibStreamEof(zs) && after > before) {
+    ok = Tcl_ZlibStreamGet(zs, out, before < 0 && expect_ > 0 ? expect_ :  - 1)
+      == TCL_OK;
+    before = after;
+    Tcl_GetByteArrayFromObj(out, &after);
+  }
+  ok = ok && Tcl_ZlibStreamEof(zs);
+
+  if (!ok) {
+    Tcl_DecrRefCount(out);
+    out = 0;
+  }
+
+  Tcl_ZlibStreamClose(zs);
+  return out;
+}
+#endif
+
+// set up the data pointer, returns false with errno set if that failed
+bool MkVfsChannel::Attach(bool inflate_, bool map_) {
+  _gen = CurrentGeneration();
+
+  c4_View dirs = _storage.View("dirs");
+  if (_dir >= dirs.GetSize()) {
+    Tcl_SetErrno(EIO);
+    return false;
+  }
+
+  c4_View files = pFiles(dirs[_dir]);
+  if (_file >= files.GetSize() || (!_name.IsEmpty() && _name.Compare(pName
+    (files[_file])) != 0)) {
+    Tcl_SetErrno(EIO);
+    return false;
+  }
+
+  c4_RowRef row = files[_file];
+  _name = (const char*)pName(row);
+
+  const c4_Strategy &strat = _storage.Strategy();
+  c4_Bytes data = pContents(row).Access(0, 0, true);
+  int length = pContents(row).GetSize();
+  int size = pSize(row);
+
+  if (size != length) {
+    // compressed, inflate it once into a private copy
+    if (!inflate_) {
+      Tcl_SetErrno(ENOTSUP);
+      return false;
+    }
+#if MKVFS_INFLATE
+    c4_Bytes all = pContents(row).Access(0);
+    _copy = Inflate(all.Contents(), all.Size(), size);
+#endif
+    if (_copy == 0) {
+      Tcl_SetErrno(EIO);
+      return false;
+    }
+    int n;
+    _data = Tcl_GetByteArrayFromObj(_copy, &n);
+    _size = n;
+    _mapStart = 0;
+    return true;
+  }
+
+  const t4_byte *ptr = data.Contents();
+  if (map_ && data.Size() == length && strat._mapStart != 0 && ptr >=
+    strat._mapStart && ptr + length <= strat._mapStart + strat._dataSize) {
+    _mapStart = strat._mapStart;
+    _data = ptr;
+  } else {
+    c4_Bytes all = pContents(row).Access(0);
+    if (_copy != 0)
+      Tcl_DecrRefCount(_copy);
+    _copy = Tcl_NewByteArrayObj(all.Contents(), all.Size());
+    Tcl_IncrRefCount(_copy);
+    _data = Tcl_GetByteArrayFromObj(_copy, 0);
+    _mapStart = 0;
+  }
+
+  _size = length;
+  return true;
+}
+
+// make sure that _data is still valid, i.e. there was no commit since
+bool MkVfsChannel::Check() {
+  return _mapStart == 0 || _gen == CurrentGeneration() || Attach(false, true);
+}
+
+static int vfsClose(ClientData instanceData, Tcl_Interp *interp) {
+  delete (MkVfsChannel*)instanceData;
+  return TCL_OK;
+}
+
+static int vfsInput(ClientData instanceData, char *buf, int toRead, int
+  *errorCodePtr) {
+  MkVfsChannel *chan = (MkVfsChannel*)instanceData;
+
+  if (!chan->Check()) {
+    *errorCodePtr = Tcl_GetErrno();
+    return  - 1;
+  }
+
+  // nothing to read at or after the end, the position may be past it
+  int n = chan->_size - chan->_position;
+  if (n > toRead)
+    n = toRead;
+  if (n <= 0)
+    return 0;
+
+  memcpy(buf, chan->_data + chan->_position, n);
+  chan->_position += n;
+  return n;
+}
+
+static int vfsOutput(ClientData instanceData, const char *buf, int toWrite, int
+  *errorCodePtr) {
+  *errorCodePtr = EROFS;
+  return  - 1;
+}
+
+static int vfsSeek(ClientData instanceData, long offset, int seekMode, int
+  *errorCodePtr) {
+  MkVfsChannel *chan = (MkVfsChannel*)instanceData;
+
+  switch (seekMode) {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+      offset += chan->_position;
+      break;
+    case SEEK_END:
+      offset += chan->_size;
+      break;
+    default:
+      offset =  - 1;
+  }
+
+  // positions are kept as 32-bit ints, just like the sizes of memo fields
+  if (offset < 0 || offset > 0x7FFFFFFFL) {
+    *errorCodePtr = EINVAL;
+    return  - 1;
+  }
+
+  chan->_position = (t4_i32)offset;
+  return offset;
+}
+
+// contents are always readable, so keep firing while there is interest
+static void vfsTimer(ClientData instanceData) {
+  MkVfsChannel *chan = (MkVfsChannel*)instanceData;
+  chan->_timer = 0;
+  if (chan->_watchMask != 0) {
+    chan->_timer = Tcl_CreateTimerHandler(0, vfsTimer, instanceData);
+    Tcl_NotifyChannel(chan->_chan, chan->_watchMask);
+  }
+}
+
+static void vfsWatchChannel(ClientData instanceData, int mask) {
+  MkVfsChannel *chan = (MkVfsChannel*)instanceData;
+  chan->_watchMask = mask &TCL_READABLE;
+  if (chan->_watchMask != 0 && chan->_timer == 0)
+    chan->_timer = Tcl_CreateTimerHandler(0, vfsTimer, instanceData);
+}
+
+static int vfsGetFile(ClientData instanceData, int direction, ClientData
+  *handlePtr) {
+  return TCL_ERROR;
+}
+
+static Tcl_ChannelType vfsChannelType =  {
+  "mk4vfs",  /* Type name.                  */
+  0,  /* Set blocking/nonblocking behaviour. NULL'able */
+  vfsClose,  /* Close channel, clean instance data      */
+  vfsInput,  /* Handle read request               */
+  (Tcl_DriverOutputProc*)vfsOutput,  /* Handle write request              */
+  (Tcl_DriverSeekProc*)vfsSeek,  /* Move location of access point.    NULL'able
+    */
+  0,  /* Set options.              NULL'able */
+  0,  /* Get options.              NULL'able */
+  (Tcl_DriverWatchProc*)vfsWatchChannel,  /* Initialize notifier          */
+  vfsGetFile /* Get OS handle from the channel.         */
+};
+
+static Tcl_Channel VfsOpenFileChannel(Tcl_Interp *interp, Tcl_Obj *pathPtr,
+  int mode, int permissions) {
+  VfsEntry entry(pathPtr);
+
+  MkVfsChannel *chan = 0;
+  if (!entry._found)
+    ; // errno is set
+  else if (mode &(O_WRONLY | O_RDWR | O_CREAT | O_APPEND | O_TRUNC))
+    Tcl_SetErrno(EROFS);
+  else if (entry._file < 0)
+    Tcl_SetErrno(EISDIR);
+  else {
+    chan = new MkVfsChannel(entry._item->_storage, entry._dir, entry._file);
+    // shared storages are used by other threads, keep a private copy of those
+    if (!chan->Attach(entry.Vfs()->_inflate, entry._item->_lock == 0)) {
+      delete chan;
+      chan = 0;
+    }
+  }
+
+  if (chan == 0) {
+    if (interp != 0)
+      Tcl_AppendResult(interp, "couldn't open \"", Tcl_GetString(pathPtr),
+        "\": ", Tcl_PosixError(interp), (char*)0);
+    return 0;
+  }
+
+  // channel names must be unique across all threads
+  static int vfsChanSeq = 0;
+  char buffer[20];
+  Tcl_MutexLock(&vfsMutex);
+  sprintf(buffer, "mkvfs%d", ++vfsChanSeq);
+  Tcl_MutexUnlock(&vfsMutex);
+
+  chan->_chan = Tcl_CreateChannel(&vfsChannelType, buffer, (ClientData)chan,
+    TCL_READABLE);
+  return chan->_chan;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Called before a workspace goes away, to remove all its mounts.
+
+void MkVfsUnmountAll(MkWorkspace *ws_) {
+  MkVfs **list = MountList();
+  bool changed = false;
+
+  while (*list != 0) {
+    MkVfs *vfs =  *list;
+    if (vfs->_ws == ws_) {
+      *list = vfs->_next;
+      delete vfs;
+      changed = true;
+    } else
+      list = &vfs->_next;
+  }
+
+  if (changed)
+    Tcl_FSMountsChanged(&mkVfsFilesystem);
+}
+
+static const char *vfsCmds[] =  {
+  "mount", "unmount", "info", 0
+};
+
+int MkTcl::VfsCmd() {
+  int id = tcl_GetIndexFromObj(objv[1], vfsCmds);
+  if (id < 0)
+    return _error;
+
+  MkVfs **list = MountList();
+
+  switch (id) {
+    case 0:
+       { // mount
+        if (objc != 4)
+          return Fail("wrong # args: should be \"mk::vfs mount tag path\"");
+
+        const char *tag = Tcl_GetString(objv[2]);
+        if (work.Find(tag) == 0)
+          return Fail("no storage with this name");
+
+        Tcl_Obj *normed = Tcl_FSGetNormalizedPath(interp, objv[3]);
+        if (normed == 0)
+          return TCL_ERROR;
+
+        const char *local = Tcl_GetString(normed);
+        for (MkVfs *vfs =  *list; vfs != 0; vfs = vfs->_next)
+          if (vfs->_local == local)
+            return Fail("already mounted");
+
+        Tcl_MutexLock(&vfsMutex);
+        if (!vfsRegistered) {
+          Tcl_FSRegister(0, &mkVfsFilesystem);
+          Tcl_CreateExitHandler(VfsExitProc, 0);
+          vfsRegistered = true;
+        }
+        Tcl_MutexUnlock(&vfsMutex);
+
+        MkVfs *vfs = new MkVfs(&work, tag, local);
+#if MKVFS_INFLATE
+        vfs->_inflate = Tcl_PkgPresent(interp, "Tcl", "8.6", 0) != 0;
+#endif
+        vfs->_next =  *list;
+        *list = vfs;
+
+        Tcl_FSMountsChanged(&mkVfsFilesystem);
+        return tcl_SetObjResult(normed);
+      }
+
+    case 1:
+       { // unmount
+        if (objc != 3)
+          return Fail("wrong # args: should be \"mk::vfs unmount path\"");
+
+        Tcl_Obj *normed = Tcl_FSGetNormalizedPath(interp, objv[2]);
+        if (normed == 0)
+          return TCL_ERROR;
+
+        const char *local = Tcl_GetString(normed);
+        for (; *list != 0; list = &(*list)->_next) {
+          MkVfs *vfs =  *list;
+          if (vfs->_local == local && vfs->_ws == &work) {
+            *list = vfs->_next;
+            delete vfs;
+            Tcl_FSMountsChanged(&mkVfsFilesystem);
+            return TCL_OK;
+          }
+        }
+        return Fail("not mounted");
+      }
+
+    case 2:
+       { // info
+        if (objc != 2)
+          return Fail("wrong # args: should be \"mk::vfs info\"");
+
+        Tcl_Obj *result = tcl_GetObjResult();
+        for (MkVfs *vfs =  *list; vfs != 0; vfs = vfs->_next)
+          if (vfs->_ws == &work) {
+            tcl_ListObjAppendElement(result, tcl_NewStringObj(vfs->_local));
+            tcl_ListObjAppendElement(result, tcl_NewStringObj(vfs->_tag));
+          }
+        return _error;
+      }
+  }
+
+  return _error;
+}
@@ -4,6 +4,80 @@
 
 #include "regress.h"
 
+#include <string.h>
+
+#if q4_LARGEFILE
+
+// An in-memory strategy for a huge but sparse datafile: only the first and
+// the last few Kb of the file hold data, everything in between reads as 0.
+
+class c4_SparseStrategy: public c4_Strategy {
+    enum {
+        kChunk = 65536
+    };
+    t4_byte _head[kChunk];
+    t4_byte _tail[kChunk];
+    t4_off _tailStart;
+    t4_off _size;
+
+  public:
+    int _farReads;
+
+    c4_SparseStrategy(): _tailStart(0), _size(0), _farReads(0) {
+        memset(_head, 0, sizeof _head);
+        memset(_tail, 0, sizeof _tail);
+    }
+
+    virtual bool IsValid()const {
+        return true;
+    }
+
+    void SetHole(t4_off start_) {
+        A(_size <= kChunk);
+        _tailStart = start_;
+        _size = start_;
+    }
+
+    t4_byte *Byte(t4_off pos_) {
+        if (pos_ < kChunk)
+          return _head + pos_;
+        if (_tailStart > 0 && pos_ >= _tailStart && pos_ < _tailStart + kChunk)
+          return _tail + (pos_ - _tailStart);
+        return 0;
+    }
+
+    virtual int DataRead(t4_off pos_, void *buf_, int len_) {
+        if (pos_ + len_ > _size)
+          len_ = (int)(_size - pos_);
+        if (pos_ > 0x7FFFFFFF)
+          ++_farReads;
+        for (int i = 0; i < len_; ++i) {
+            t4_byte *p = Byte(pos_ + i);
+            ((t4_byte*)buf_)[i] = p != 0 ?  *p : 0;
+        }
+        return len_;
+    }
+
+    virtual void DataWrite(t4_off pos_, const void *buf_, int len_) {
+        for (int i = 0; i < len_; ++i) {
+            t4_byte *p = Byte(pos_ + i);
+            if (p == 0) {
+                ++_failure;
+                return ;
+            }
+            *p = ((const t4_byte*)buf_)[i];
+        }
+        if (pos_ + len_ > _size)
+          _size = pos_ + len_;
+    }
+
+    virtual t4_off FileSize() {
+        return _size;
+    }
+};
+
+#endif 
+
 void TestLimits() {
   B(l00, Lots of properties, 0)W(l00a);
    {
@@ -289,4 +363,69 @@ void TestLimits() {
   D(l07a);
   R(l07a);
   E;
+
+  B(l08, Datafile beyond 2 Gb, 0) {
+#if q4_LARGEFILE
+    c4_IntProp p1("p1");
+    c4_BytesProp p2("p2");
+    c4_SparseStrategy *strat = new c4_SparseStrategy;
+
+     {
+      c4_Storage s1(*strat, false, 1);
+      c4_View v1 = s1.GetAs("a[p1:I,p2:B]");
+      v1.Add(p1[123] + p2[c4_Bytes("abc", 3)]);
+      s1.Commit();
+    }
+
+    // append 3 Gb of unused space, with a skip tail to step over it
+    t4_off end = strat->FileSize();
+    t4_off gap = ((t4_off)3 << 30) - end;
+    strat->SetHole(end + gap);
+
+    t4_byte mark[8];
+    mark[0] = (t4_byte)(0xC0 | (gap >> 32));
+    mark[1] = mark[2] = mark[3] = 0;
+    for (int i = 0; i < 4; ++i)
+      mark[4+i] = (t4_byte)(gap >> (24-8 * i));
+    strat->DataWrite(end + gap, mark, sizeof mark);
+
+     {
+      c4_Storage s1(*strat, false, 2);
+      c4_View v1 = s1.View("a");
+      A(v1.GetSize() == 1);
+      v1.Add(p1[456] + p2[c4_Bytes("defghi", 6)]);
+      A(s1.Commit());
+    }
+
+    // the last commit tail must be in large-file format
+    strat->DataRead(strat->FileSize() - 8, mark, sizeof mark);
+    A((mark[0] &0xF0) == 0xC0);
+
+     {
+      c4_Storage s1(*strat, false, 0);
+      c4_View v1 = s1.View("a");
+      A(v1.GetSize() == 2);
+      A(p1(v1[0]) == 123);
+      A(p1(v1[1]) == 456);
+      A(p2(v1[0]) == c4_Bytes("abc", 3));
+      A(p2(v1[1]) == c4_Bytes("defghi", 6));
+    }
+
+    A(strat->_failure == 0);
+    A(strat->_farReads > 0);
+
+     {
+      // aside datafiles only hold 32-bit base positions
+      c4_Storage s1(*strat, false, 0);
+      c4_Storage s2;
+      s1.SetAside(s2);
+      c4_View v1 = s1.View("a");
+      v1.Add(p1[789]);
+      A(!s1.Commit());
+      A(strat->_failure != 0);
+    }
+    delete strat;
+#endif 
+  }
+  E;
 }
@@ -4,6 +4,186 @@
 
 #include "regress.h"
 
+#include <string.h>
+
+#if defined (_WIN32)
+#include <windows.h>
+
+static double Seconds() {
+  return GetTickCount() / 1000.0;
+}
+
+#else 
+#include <sys/time.h>
+
+static double Seconds() {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#endif 
+
+// counts the writes which reach the file
+class c4_CountingStrategy: public c4_FileStrategy {
+  public:
+    int _writes;
+
+    c4_CountingStrategy(): _writes(0){}
+
+    virtual void DataWrite(t4_off pos_, const void *buf_, int len_) {
+      ++_writes;
+      c4_FileStrategy::DataWrite(pos_, buf_, len_);
+    }
+};
+
+// a log strategy which fails once armed, after accepting one more write
+class c4_FailingLogStrategy: public c4_LogStrategy {
+  public:
+    bool _armed;
+
+    c4_FailingLogStrategy(): _armed(false){}
+
+    virtual void DataWrite(t4_off pos_, const void *buf_, int len_) {
+      c4_LogStrategy::DataWrite(pos_, buf_, len_);
+      if (_armed)
+        _failure =  - 1;
+    }
+};
+
+// commit a spread of changes to a large store, return the number of writes
+// and add the time taken by the commits to secs_
+static int CommitBench(const char *file_, int threads_, double &secs_) {
+  c4_IntProp p1("p1");
+  c4_StringProp p2("p2");
+  c4_BytesProp p3("p3");
+  c4_ViewProp p4("p4");
+
+  char buf[5000];
+  memset(buf, 'x', sizeof buf);
+
+   {
+    c4_Storage s1(file_, 1);
+    s1.SetStructure("a[p1:I,p2:S,p3:B,p4[p1:I]]");
+    s1.ParallelCommit(threads_);
+
+    c4_View v1 = s1.View("a");
+    c4_Row r1;
+    for (int i = 0; i < 2000; ++i) {
+      sprintf(buf, "row %d", i);
+      p1(r1) = i;
+      p2(r1) = buf;
+      p3(r1) = c4_Bytes(buf, 100+(i * 37) % 4000);
+      v1.Add(r1);
+
+      c4_View v2 = p4(v1[i]);
+      for (int j = 0; j < i % 10; ++j)
+        v2.Add(p1[i * j]);
+    }
+
+    s1.Commit();
+  }
+
+  c4_CountingStrategy cs;
+  cs.DataOpen(file_, 1);
+  A(cs.IsValid());
+
+  c4_Storage s1(cs, false, 1);
+  A(s1.ParallelCommit(threads_) == 0);
+  c4_View v1 = s1.View("a");
+  A(v1.GetSize() == 2000);
+
+  // change a spread of rows, then commit twice, to reuse the workers
+  for (int k = 0; k < 2; ++k) {
+    for (int i = k; i < 2000; i += 7) {
+      p1(v1[i]) = - i;
+      p2(v1[i]) = "changed";
+      p3(v1[i]) = c4_Bytes(buf, 200+(i * 53) % 4500);
+      c4_View v2 = p4(v1[i]);
+      v2.Add(p1[i]);
+    }
+
+    cs._writes = 0;
+    double t = Seconds();
+    A(s1.Commit());
+    secs_ += Seconds() - t;
+  }
+  return cs._writes;
+}
+
+// compare two files byte by byte
+static bool SameFiles(const char *file1_, const char *file2_) {
+  FILE *fp1 = fopen(file1_, "rb");
+  FILE *fp2 = fopen(file2_, "rb");
+  A(fp1 && fp2);
+
+  int c1, c2;
+  do {
+    c1 = fgetc(fp1);
+    c2 = fgetc(fp2);
+  } while (c1 == c2 && c1 != EOF);
+
+  fclose(fp1);
+  fclose(fp2);
+  return c1 == c2;
+}
+
+static long FileLength(const char *file_) {
+  FILE *fp = fopen(file_, "rb");
+  A(fp);
+
+  fseek(fp, 0, SEEK_END);
+  long n = ftell(fp);
+  fclose(fp);
+  return n;
+}
+
+// copy a file, optionally adding some garbage at the end
+static void CopyWithJunk(const char *from_, const char *to_, int junk_) {
+  FILE *fp1 = fopen(from_, "rb");
+  FILE *fp2 = fopen(to_, "wb");
+  A(fp1 && fp2);
+
+  char buf[4096];
+  int n;
+  while ((n = fread(buf, 1, sizeof buf, fp1)) > 0)
+    fwrite(buf, 1, n, fp2);
+
+  memset(buf, 0x55, junk_);
+  fwrite(buf, 1, junk_, fp2);
+
+  fclose(fp1);
+  fclose(fp2);
+}
+
+// time a series of small commits, done through the given strategy
+static double StrategyBench(const char *file_, c4_FileStrategy &strat_) {
+  c4_IntProp p1("p1");
+  c4_StringProp p2("p2");
+  c4_BytesProp p3("p3");
+
+  char buf[1000];
+  memset(buf, 'y', sizeof buf);
+
+  strat_.DataOpen(file_, 1);
+  A(strat_.IsValid());
+
+  c4_Storage s1(strat_, false, 1);
+  s1.SetStructure("a[p1:I,p2:S,p3:B]");
+  c4_View v1 = s1.View("a");
+
+  double t = Seconds();
+  for (int i = 0; i < 200; ++i) {
+    for (int j = 0; j < 25; ++j) {
+      int k = i * 25+j;
+      sprintf(buf, "row %d", k);
+      v1.Add(p1[k] + p2[buf] + p3[c4_Bytes(buf, 10+k % 900)]);
+    }
+    A(s1.Commit());
+  }
+  return Seconds() - t;
+}
+
 void TestStores5() {
   B(s40, LoadFrom after commit, 0)W(s40a);
    {
@@ -356,4 +536,206 @@ void TestStores5() {
   D(s50a);
   R(s50a);
   E;
+  B(s51, Parallel commit, 0)W(s51a);
+  W(s51b);
+   {
+    double t1 = 0, t2 = 0;
+    int n1 = CommitBench("s51a", 0, t1);
+    int n2 = CommitBench("s51b", 4, t2);
+
+    // both modes produce the same file, but parallel mode coalesces writes,
+    // the times vary too much between runs to be checked, only reported
+    A(SameFiles("s51a", "s51b"));
+    A(n2 < n1);
+    fprintf(stderr, "\ts51: commit %.3fs serial, %.3fs parallel, %d and %d"
+      " writes\n", t1, t2, n1, n2);
+
+    c4_IntProp p1("p1");
+    c4_StringProp p2("p2");
+    c4_BytesProp p3("p3");
+    c4_ViewProp p4("p4");
+
+    c4_Storage s1("s51b", 0);
+    c4_View v1 = s1.View("a");
+    A(v1.GetSize() == 2000);
+
+    for (int i = 0; i < 2000; ++i) {
+      bool changed = i % 7 <= 1;
+      A(p1(v1[i]) == (changed ? - i : i));
+      A(p3(v1[i]).GetSize() == (changed ? 200+(i * 53) % 4500 : 100+(i * 37) %
+        4000));
+      if (changed)
+        A(p2(v1[i]) == (c4_String)"changed");
+      c4_View v2 = p4(v1[i]);
+      A(v2.GetSize() == i % 10 + changed);
+    }
+  }
+  R(s51a);
+  R(s51b);
+  E;
+  B(s52, Write-ahead log strategy, 0)W(s52a);
+  W(s52a-log);
+  W(s52b);
+  W(s52b-log);
+  W(s52c);
+  W(s52c-log);
+  W(s52d);
+  W(s52d-log);
+   {
+    c4_IntProp p1("p1");
+    c4_StringProp p2("p2");
+
+     {
+      c4_LogStrategy ls;
+      ls.DataOpen("s52a", 1);
+      A(ls.IsValid());
+
+      c4_Storage s1(ls, false, 1);
+      s1.SetStructure("a[p1:I,p2:S]");
+      c4_View v1 = s1.View("a");
+
+      for (int i = 0; i < 100; ++i) {
+        v1.Add(p1[i] + p2["abc"]);
+        A(s1.Commit());
+      }
+
+      // so far, all changes only went to the log
+      A(FileLength("s52a") == 0);
+      A(FileLength("s52a-log") > 8);
+
+      // simulate a crash in the middle of appending the next commit
+      CopyWithJunk("s52a", "s52b", 0);
+      CopyWithJunk("s52a-log", "s52b-log", 37);
+
+      p2(v1[5]) = "five";
+      A(s1.Commit());
+      A(p1(v1[99]) == 99);
+      A(p2(v1[5]) == (c4_String)"five");
+    }
+    // closing folds the log into the datafile
+    A(FileLength("s52a") > 0);
+    A(FileLength("s52a-log") == 8);
+     {
+      c4_Storage s1("s52a", 0);
+      c4_View v1 = s1.View("a");
+      A(v1.GetSize() == 100);
+      A(p1(v1[42]) == 42);
+      A(p2(v1[5]) == (c4_String)"five");
+    }
+     {
+      // a read-only open replays the log without altering any file
+      c4_LogStrategy ls;
+      ls.DataOpen("s52b", 0);
+      c4_Storage s1(ls, false, 0);
+      c4_View v1 = s1.View("a");
+      A(v1.GetSize() == 100);
+      A(p1(v1[99]) == 99);
+      A(p2(v1[5]) == (c4_String)"abc");
+      A(FileLength("s52b") == 0);
+    }
+     {
+      // a writable open checkpoints at once, also after each commit here
+      c4_LogStrategy ls;
+      ls._checkpointSize = 0;
+      ls.DataOpen("s52b", 1);
+      A(FileLength("s52b") > 0);
+      A(FileLength("s52b-log") == 8);
+
+      c4_Storage s1(ls, false, 1);
+      c4_View v1 = s1.View("a");
+      A(v1.GetSize() == 100);
+      v1.Add(p1[100] + p2["def"]);
+      A(s1.Commit());
+      A(FileLength("s52b-log") == 8);
+    }
+     {
+      c4_Storage s1("s52b", 0);
+      c4_View v1 = s1.View("a");
+      A(v1.GetSize() == 101);
+      A(p1(v1[100]) == 100);
+    }
+    for (int k = 0; k < 2; ++k) {
+      // a failed commit must leave nothing behind, not even in free space
+      c4_FailingLogStrategy ls;
+      ls.DataOpen(k ? "s52d" : "s52c", 1);
+
+      c4_Storage s1(ls, false, 1);
+      s1.SetStructure("a[p1:I,p2:S]");
+      c4_View v1 = s1.View("a");
+      for (int i = 0; i < 10; ++i)
+        v1.Add(p1[i] + p2["abc"]);
+      A(s1.Commit());
+
+      if (k) {
+        for (int j = 0; j < 1000; ++j)
+          v1.Add(p1[j] + p2["a longer string than before"]);
+        ls._armed = true;
+        A(!s1.Commit());
+        A(ls._failure != 0);
+      }
+    }
+    A(FileLength("s52d-log") == 8);
+    A(SameFiles("s52c", "s52d"));
+  }
+  D(s52a);
+  D(s52b);
+  R(s52a);
+  R(s52a-log);
+  R(s52b);
+  R(s52b-log);
+  R(s52c);
+  R(s52c-log);
+  R(s52d);
+  R(s52d-log);
+  E;
+  B(s53, Positioned I/O strategy, 0)W(s53a);
+  W(s53b);
+  W(s53c);
+   {
+    double t1, t2, t3;
+     {
+      c4_FileStrategy fs;
+      t1 = StrategyBench("s53a", fs);
+    }
+     {
+      c4_PosixStrategy ps;
+      ps._syncCommits = false;
+      t2 = StrategyBench("s53b", ps);
+    }
+     {
+      c4_PosixStrategy ps;
+      t3 = StrategyBench("s53c", ps);
+    }
+
+    // the strategy only changes how bytes get to the file, not which ones
+    A(FileLength("s53a") == FileLength("s53b"));
+    A(FileLength("s53a") == FileLength("s53c"));
+
+    c4_IntProp p1("p1");
+    c4_StringProp p2("p2");
+    c4_BytesProp p3("p3");
+
+    c4_PosixStrategy ps;
+    ps.DataOpen("s53c", 0);
+    c4_Storage s1("s53a", 0);
+    c4_Storage s2(ps, false, 0);
+    c4_View v1 = s1.View("a");
+    c4_View v2 = s2.View("a");
+    A(v1.GetSize() == 5000);
+    A(v2.GetSize() == 5000);
+
+    for (int i = 0; i < 5000; ++i) {
+      A(p1(v1[i]) == i);
+      A(p1(v2[i]) == i);
+      A(p2(v1[i]) == p2(v2[i]));
+      A(p3(v1[i]) == p3(v2[i]));
+    }
+
+    fprintf(stderr, "\ts53: 200 commits %.3fs stdio, %.3fs pwrite, %.3fs synced\n",
+      t1, t2, t3);
+  }
+  R(s53a);
+  R(s53b);
+  R(s53c);
+  E;
 }
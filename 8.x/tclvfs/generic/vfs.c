@@ -27,6 +27,7 @@
 /* Required to access the 'stat' structure fields, and TclInExit() */
 #include "tclInt.h"
 #include "tclPort.h"
+#include "vfs.h"
 
 /*
  * Windows needs to know which symbols to export.  Unix does not.
@@ -55,10 +56,14 @@
 #endif
 
 /*
- * Only the _Init function is exported.
+ * Only the _Init function and the driver registration functions
+ * declared in vfs.h are exported.
  */
 
 EXTERN int Vfs_Init _ANSI_ARGS_((Tcl_Interp*));
+#ifdef VFS_TEST_DRIVER
+EXTERN int Vfstest_Init _ANSI_ARGS_((Tcl_Interp*));
+#endif
 
 /* 
  * Functions to add and remove a volume from the list of volumes.
@@ -67,6 +72,64 @@ EXTERN int Vfs_Init _ANSI_ARGS_((Tcl_Interp*));
 static void Vfs_AddVolume    _ANSI_ARGS_((Tcl_Obj*));
 static int  Vfs_RemoveVolume _ANSI_ARGS_((Tcl_Obj*));
 
+/*
+ * struct VfsCache --
+ * 
+ * The results of stat, access and matchindirectory for the files in a
+ * mount made with 'vfs::filesystem mount -cache ttl', so that Tcl's
+ * repeated checks of the same paths (when sourcing and loading files,
+ * searching for packages or normalizing paths) do not each call the
+ * mount's handler.  Failures are kept as well as successes.  Entries
+ * expire 'ttl' milliseconds after they were stored, or never if 'ttl'
+ * is 0.
+ * 
+ * The cache is meant for mounts whose contents do not change behind
+ * tclvfs' back, such as the executable of a tclkit.  As soon as a file
+ * in the mount is modified through tclvfs, the cache is emptied and
+ * the mount is considered writable, which means it is not cached any
+ * more.  'vfs::filesystem invalidate' empties the cache explicitly.
+ *
+ * A mount made with '-liststat' but without '-cache' has a 'listOnly'
+ * cache instead, which only keeps the stat results its handler
+ * reported along with a directory listing, for VFS_LISTSTAT_TTL ms,
+ * to answer the stats which usually follow a glob.  It is emptied,
+ * but not disabled, when a file in the mount is modified.
+ */
+
+typedef struct VfsCache {
+    long ttl;                 /* Lifetime of entries in ms, or 0. */
+    int writable;             /* Set once a file has been modified,
+                               * the cache is then bypassed. */
+    int listOnly;             /* Only stats from listings are kept. */
+    int numEntries;           /* The number of entries in both tables. */
+    Tcl_HashTable paths;      /* Relative path to VfsCacheEntry. */
+    Tcl_HashTable listings;   /* Key built by VfsMatchInDirectory to
+                               * VfsCacheListing. */
+    long hits;                /* Calls answered from the cache. */
+    long misses;              /* Calls passed on to the handler. */
+} VfsCache;
+
+typedef struct VfsCacheEntry {
+    Tcl_Time stored;          /* When the entry was created. */
+    int statErrno;            /* -1 if no stat result is known, else
+                               * 0 or the posix error of the stat. */
+    Tcl_StatBuf statBuf;      /* The result of a successful stat. */
+    int accessKnown;          /* Bit (1 << mode) is set for each access
+                               * mode whose result is known, */
+    int accessFailed;         /* and also here if access failed. */
+} VfsCacheEntry;
+
+typedef struct VfsCacheListing {
+    Tcl_Time stored;
+    Tcl_Obj *listPtr;         /* The paths the handler returned. */
+} VfsCacheListing;
+
+/* The cache of a mount is emptied when it grows beyond this */
+#define VFS_CACHE_MAX_ENTRIES 10000
+
+/* The lifetime in ms of the stats kept by a 'listOnly' cache */
+#define VFS_LISTSTAT_TTL 1000
+
 /*
  * struct Vfs_InterpCmd --
  * 
@@ -84,6 +147,12 @@ static int  Vfs_RemoveVolume _ANSI_ARGS_((Tcl_Obj*));
  * internal representation also do not need to add to any refCounts,
  * because if this object disappears, all internal representations will
  * be made invalid.
+ * 
+ * A mount made with 'vfs::filesystem mount -native' has a 'driver',
+ * whose procedures are called directly instead.  Its 'mountCmd' is
+ * then the driver name and mount arguments, which is only used to
+ * report the mount, and 'interp' is only used to remove the mount
+ * when the interpreter is deleted.
  */
 
 typedef struct Vfs_InterpCmd {
@@ -92,6 +161,17 @@ typedef struct Vfs_InterpCmd {
                            * file. */
     Tcl_Interp *interp;   /* The Tcl interpreter in which the above
                            * command will be evaluated. */
+    CONST Vfs_Driver *driver;
+                          /* The compiled driver of a native mount,
+                           * or NULL. */
+    ClientData driverData;
+                          /* The data the driver's mountProc returned
+                           * for this mount. */
+    VfsCache *cache;      /* The cache of a mount made with -cache
+                           * or -liststat, or NULL. */
+    int listStat;         /* The mount was made with -liststat, its
+                           * command lists directories with 'liststat'
+                           * instead of 'matchindirectory'. */
 } Vfs_InterpCmd;
 
 /*
@@ -170,6 +250,9 @@ static Tcl_FSStatProc VfsStat;
 static Tcl_FSAccessProc VfsAccess;
 static Tcl_FSOpenFileChannelProc VfsOpenFileChannel;
 static Tcl_FSMatchInDirectoryProc VfsMatchInDirectory;
+static Tcl_FSStatProc VfsHandlerStat;
+static Tcl_FSAccessProc VfsHandlerAccess;
+static Tcl_FSMatchInDirectoryProc VfsHandlerMatchInDirectory;
 static Tcl_FSDeleteFileProc VfsDeleteFile;
 static Tcl_FSCreateDirectoryProc VfsCreateDirectory;
 static Tcl_FSRemoveDirectoryProc VfsRemoveDirectory; 
@@ -236,7 +319,8 @@ static Tcl_Filesystem vfsFilesystem = {
  * 
  * Each filesystem mount point which is registered will result in
  * the allocation of one of these structures.  They are stored
- * in a linked list whose head is 'listOfMounts'.
+ * in a linked list whose head is 'listOfMounts', and are also
+ * indexed by mount point in 'mountTable'.
  */
 
 typedef struct VfsMount {
@@ -264,21 +348,55 @@ typedef struct VfsMount {
  * a tclvfs implementation.  This is most useful for debugging.
  *
  * When it is not NULL we keep a refCount on it.
+ *
+ * mountTable maps each mount point to the most recent VfsMount for it,
+ * and mountLens[n] counts the mounts with a mount point of n bytes, so
+ * that looking up the prefixes of a path, as VfsPathInFilesystem does
+ * for all paths, even native ones, does not depend on the number of
+ * mounts, and is mostly skipped for prefix lengths which no mount has.
  */
 
 typedef struct ThreadSpecificData {
     VfsMount *listOfMounts;
     Tcl_Obj *vfsVolumes;
     Tcl_Obj *internalErrorScript;
+    int mountTableInit;
+    Tcl_HashTable mountTable;
+    int *mountLens;
+    int mountLensSize;
 } ThreadSpecificData;
 static Tcl_ThreadDataKey dataKey;
 
+/*
+ * The registered compiled drivers, by name.  Unlike mounts they are
+ * shared by all threads, so the table is protected by a mutex.
+ */
+
+static Tcl_HashTable driverTable;
+static int driverTableInit = 0;
+TCL_DECLARE_MUTEX(driverMutex)
+
+static CONST VfsStubs vfsStubs = {
+    VFS_STUBS_MAGIC,
+    Vfs_RegisterDriver,
+    Vfs_UnregisterDriver
+};
+
 /* We might wish to consider exporting these in the future */
 
 static int             Vfs_AddMount(Tcl_Obj* mountPoint, int isVolume, 
-				    Tcl_Interp *interp, Tcl_Obj* mountCmd);
+				    Tcl_Interp *interp, Tcl_Obj* mountCmd,
+				    CONST Vfs_Driver *driver, 
+				    ClientData driverData, long cacheTtl,
+				    int listStat);
 static int             Vfs_RemoveMount(Tcl_Obj* mountPoint, Tcl_Interp* interp);
 static Vfs_InterpCmd*  Vfs_FindMount(Tcl_Obj *pathMount, int mountLen);
+static CONST Vfs_Driver* Vfs_FindDriver(CONST char *name);
+static int             VfsMountNative(Tcl_Interp *interp, Tcl_Obj *mountPoint,
+				      int isVolume, long cacheTtl, int objc, 
+				      Tcl_Obj *CONST objv[]);
+static void            Vfs_UnindexMount(ThreadSpecificData *tsdPtr, 
+					VfsMount *mount);
 static Tcl_Obj*        Vfs_ListMounts(void);
 static void            Vfs_UnregisterWithInterp _ANSI_ARGS_((ClientData, 
 							     Tcl_Interp*));
@@ -287,6 +405,27 @@ static void            Vfs_RegisterWithInterp _ANSI_ARGS_((Tcl_Interp*));
 /* Some private helper procedures */
 
 static VfsNativeRep*   VfsGetNativePath(Tcl_Obj* pathPtr);
+static Vfs_InterpCmd*  VfsGetDriver(Tcl_Obj* pathPtr, 
+				    CONST char **relativePtr);
+static CONST char*     VfsRelativePath(VfsNativeRep* nativeRep, 
+				       Tcl_Obj* pathPtr);
+static VfsCache*       VfsCacheNew(long ttl);
+static void            VfsCacheFlush(VfsCache *cache);
+static void            VfsCacheFree(VfsCache *cache);
+static VfsCache*       VfsCacheFor(Tcl_Obj* pathPtr, 
+				   CONST char **relativePtr);
+static VfsCacheEntry*  VfsCacheEntryFor(VfsCache *cache, 
+					CONST char *relative);
+static int             VfsCacheExpired(VfsCache *cache, Tcl_Time *stored);
+static void            VfsCacheWrite(Tcl_Obj* pathPtr);
+static Tcl_Obj*        VfsCacheStats(VfsCache *cache);
+static void            VfsCacheListStat(Tcl_Obj* pathPtr, 
+					Tcl_StatBuf *bufPtr);
+static int             VfsParseStat(Tcl_Interp *interp, Tcl_Obj *statPtr,
+				    Tcl_StatBuf *bufPtr);
+static Tcl_Obj*        VfsListStatResult(Tcl_Interp *interp, 
+					 Tcl_Obj *resultPtr, int type);
+static int             VfsGlobType(int mode);
 static Tcl_CloseProc   VfsCloseProc;
 static void            VfsExitProc(ClientData clientData);
 static void            VfsThreadExitProc(ClientData clientData);
@@ -349,7 +488,8 @@ Vfs_Init(interp)
     /* keep in sync with actual version */
 #define PACKAGE_VERSION "1.4"
 #endif
-    if (Tcl_PkgProvide(interp, "vfs", PACKAGE_VERSION) == TCL_ERROR) {
+    if (Tcl_PkgProvideEx(interp, "vfs", PACKAGE_VERSION, 
+	    (ClientData) &vfsStubs) == TCL_ERROR) {
         return TCL_ERROR;
     }
 
@@ -361,6 +501,17 @@ Vfs_Init(interp)
     Tcl_CreateObjCommand(interp, "vfs::filesystem", VfsFilesystemObjCmd, 
 	    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
     Vfs_RegisterWithInterp(interp);
+
+#ifdef VFS_TEST_DRIVER
+    /*
+     * In a test build, the test driver of vfsTest.c is in this library
+     * too, but the same file can't be loaded again for it, so offer it
+     * as a static package, for 'load {} Vfstest'.
+     */
+
+    Tcl_StaticPackage((Tcl_Interp *) NULL, "Vfstest", Vfstest_Init,
+	    (Tcl_PackageInitProc *) NULL);
+#endif
     return TCL_OK;
 }
 
@@ -448,6 +599,11 @@ Vfs_UnregisterWithInterp(dummy, interp)
  *	This command must not be called unless 'interp' has already
  *	been registered with 'Vfs_RegisterWithInterp' above.  This 
  *	usually happens automatically with a 'package require vfs'.
+ *	
+ *	If 'driver' is not NULL, the mount is handled by that compiled
+ *	driver, with the given 'driverData', instead of by mountCmd.
+ *	If 'cacheTtl' is not negative, the mount gets a VfsCache.
+ *	If 'listStat' is set, its command is asked for 'liststat'.
  *
  * Results:
  *	TCL_OK unless the inputs are bad or a memory allocation
@@ -462,14 +618,19 @@ Vfs_UnregisterWithInterp(dummy, interp)
  *----------------------------------------------------------------------
  */
 static int 
-Vfs_AddMount(mountPoint, isVolume, interp, mountCmd)
+Vfs_AddMount(mountPoint, isVolume, interp, mountCmd, driver, driverData,
+	     cacheTtl, listStat)
     Tcl_Obj* mountPoint;
     int isVolume;
     Tcl_Interp* interp;
     Tcl_Obj* mountCmd;
+    CONST Vfs_Driver *driver;
+    ClientData driverData;
+    long cacheTtl;
+    int listStat;
 {
     char *strRep;
-    int len;
+    int len, isNew;
     VfsMount *newMount;
     ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
     
@@ -501,12 +662,40 @@ Vfs_AddMount(mountPoint, isVolume, interp, mountCmd)
     strcpy((char*)newMount->mountPoint, strRep);
     newMount->interpCmd.mountCmd = mountCmd;
     newMount->interpCmd.interp = interp;
+    newMount->interpCmd.driver = driver;
+    newMount->interpCmd.driverData = driverData;
+    newMount->interpCmd.listStat = listStat;
+    if (cacheTtl >= 0) {
+	newMount->interpCmd.cache = VfsCacheNew(cacheTtl);
+    } else if (listStat) {
+	newMount->interpCmd.cache = VfsCacheNew(VFS_LISTSTAT_TTL);
+	newMount->interpCmd.cache->listOnly = 1;
+    } else {
+	newMount->interpCmd.cache = NULL;
+    }
     newMount->isVolume = isVolume;
     Tcl_IncrRefCount(mountCmd);
     
     newMount->nextMount = tsdPtr->listOfMounts;
     tsdPtr->listOfMounts = newMount;
 
+    /* Index it, the newest mount for a path hides any older ones */
+    if (!tsdPtr->mountTableInit) {
+	Tcl_InitHashTable(&tsdPtr->mountTable, TCL_STRING_KEYS);
+	tsdPtr->mountTableInit = 1;
+    }
+    Tcl_SetHashValue(Tcl_CreateHashEntry(&tsdPtr->mountTable, 
+	    newMount->mountPoint, &isNew), (ClientData) newMount);
+    if (len >= tsdPtr->mountLensSize) {
+	int oldSize = tsdPtr->mountLensSize;
+	tsdPtr->mountLensSize = 2 * len + 16;
+	tsdPtr->mountLens = (int*) ckrealloc((char*)tsdPtr->mountLens, 
+		tsdPtr->mountLensSize * sizeof(int));
+	memset(tsdPtr->mountLens + oldSize, 0, 
+		(tsdPtr->mountLensSize - oldSize) * sizeof(int));
+    }
+    tsdPtr->mountLens[len]++;
+
     if (isVolume) {
 	Vfs_AddVolume(mountPoint);
     }
@@ -535,7 +724,8 @@ Vfs_AddMount(mountPoint, isVolume, interp, mountCmd)
  *	(as returned by 'file volumes').  A vfs may be removed from
  *	the filesystem.  If successful, Tcl will be informed that
  *	the list of current mounts has changed, and all cached file
- *	representations will be made invalid.
+ *	representations will be made invalid.  The driver of a native
+ *	mount is told to release the mount.
  *
  *----------------------------------------------------------------------
  */
@@ -570,6 +760,7 @@ Vfs_RemoveMount(mountPoint, interp)
 	    } else {
 		lastMount->nextMount = mountIter->nextMount;
 	    }
+	    Vfs_UnindexMount(tsdPtr, mountIter);
 	    /* Free the allocated memory */
 	    if (mountIter->isVolume) {
 		if (mountPoint == NULL) {
@@ -582,6 +773,14 @@ Vfs_RemoveMount(mountPoint, interp)
 		    Vfs_RemoveVolume(mountPoint);
 		}
 	    }
+	    if (mountIter->interpCmd.driver != NULL 
+		    && mountIter->interpCmd.driver->unmountProc != NULL) {
+		mountIter->interpCmd.driver->unmountProc(
+			mountIter->interpCmd.driverData);
+	    }
+	    if (mountIter->interpCmd.cache != NULL) {
+		VfsCacheFree(mountIter->interpCmd.cache);
+	    }
 	    ckfree((char*)mountIter->mountPoint);
 	    Tcl_DecrRefCount(mountIter->interpCmd.mountCmd);
 	    ckfree((char*)mountIter);
@@ -623,6 +822,7 @@ Vfs_FindMount(pathMount, mountLen)
 {
     VfsMount *mountIter;
     char *mountStr;
+    Tcl_HashEntry *entryPtr;
     ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
     
     if (pathMount == NULL) {
@@ -635,16 +835,65 @@ Vfs_FindMount(pathMount, mountLen)
 	mountStr = Tcl_GetString(pathMount);
     }
 
-    mountIter = tsdPtr->listOfMounts;
-    while (mountIter != NULL) {
-	if (mountIter->mountLen == mountLen && 
-	  !strncmp(mountIter->mountPoint, mountStr, (size_t)mountLen)) {
-	    Vfs_InterpCmd *ret = &mountIter->interpCmd;
-	    return ret;
+    if (mountLen >= tsdPtr->mountLensSize || !tsdPtr->mountLens[mountLen]) {
+	return NULL;
+    }
+    if (mountStr[mountLen] == '\0') {
+	entryPtr = Tcl_FindHashEntry(&tsdPtr->mountTable, mountStr);
+    } else {
+	/* Hash keys are null-terminated, look up a copy of the prefix */
+	Tcl_DString prefix;
+
+	Tcl_DStringInit(&prefix);
+	Tcl_DStringAppend(&prefix, mountStr, mountLen);
+	entryPtr = Tcl_FindHashEntry(&tsdPtr->mountTable, 
+				     Tcl_DStringValue(&prefix));
+	Tcl_DStringFree(&prefix);
+    }
+    if (entryPtr == NULL) {
+	return NULL;
+    }
+    mountIter = (VfsMount*) Tcl_GetHashValue(entryPtr);
+    return &mountIter->interpCmd;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Vfs_UnindexMount --
+ *
+ *	Removes a mount, which has just been taken out of the list of
+ *	mounts, from the mount index.  If an older mount exists for the
+ *	same path, the index then refers to that one.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+Vfs_UnindexMount(tsdPtr, mount)
+    ThreadSpecificData *tsdPtr;
+    VfsMount *mount;
+{
+    Tcl_HashEntry *entryPtr;
+    VfsMount *mountIter;
+
+    if (!tsdPtr->mountTableInit) {
+	/* The thread is exiting, and the index is already gone */
+	return;
+    }
+    tsdPtr->mountLens[mount->mountLen]--;
+    entryPtr = Tcl_FindHashEntry(&tsdPtr->mountTable, mount->mountPoint);
+    if (entryPtr == NULL || Tcl_GetHashValue(entryPtr) != (ClientData) mount) {
+	return;
+    }
+    for (mountIter = tsdPtr->listOfMounts; mountIter != NULL; 
+	    mountIter = mountIter->nextMount) {
+	if (mountIter->mountLen == mount->mountLen 
+		&& !strcmp(mountIter->mountPoint, mount->mountPoint)) {
+	    Tcl_SetHashValue(entryPtr, (ClientData) mountIter);
+	    return;
 	}
-	mountIter = mountIter->nextMount;
     }
-    return NULL;
+    Tcl_DeleteHashEntry(entryPtr);
 }
 
 
@@ -676,6 +925,103 @@ Vfs_ListMounts(void)
     return res;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Vfs_RegisterDriver --
+ *
+ *	Makes a compiled vfs driver available to all threads, under
+ *	the driver's name, for 'vfs::filesystem mount -native'.  A
+ *	driver registered earlier with the same name is replaced,
+ *	but existing mounts keep using it.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if the driver has no name or is of an
+ *	unknown version.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+Vfs_RegisterDriver(driver)
+    CONST Vfs_Driver *driver;
+{
+    int isNew;
+
+    if (driver == NULL || driver->name == NULL 
+	    || driver->version != VFS_DRIVER_VERSION_1) {
+	return TCL_ERROR;
+    }
+    Tcl_MutexLock(&driverMutex);
+    if (!driverTableInit) {
+	Tcl_InitHashTable(&driverTable, TCL_STRING_KEYS);
+	driverTableInit = 1;
+    }
+    Tcl_SetHashValue(Tcl_CreateHashEntry(&driverTable, driver->name, 
+	    &isNew), (ClientData) driver);
+    Tcl_MutexUnlock(&driverMutex);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Vfs_UnregisterDriver --
+ *
+ *	Removes a driver registered with Vfs_RegisterDriver, so no new
+ *	mounts can use it.  The caller must make sure all mounts using
+ *	it have been removed before the driver itself goes away.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if the driver was not registered.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+Vfs_UnregisterDriver(driver)
+    CONST Vfs_Driver *driver;
+{
+    Tcl_HashEntry *entryPtr = NULL;
+    int retVal = TCL_ERROR;
+
+    if (driver == NULL || driver->name == NULL) {
+	return TCL_ERROR;
+    }
+    Tcl_MutexLock(&driverMutex);
+    if (driverTableInit) {
+	entryPtr = Tcl_FindHashEntry(&driverTable, driver->name);
+    }
+    if (entryPtr != NULL && Tcl_GetHashValue(entryPtr) == (ClientData) driver) {
+	Tcl_DeleteHashEntry(entryPtr);
+	retVal = TCL_OK;
+    }
+    Tcl_MutexUnlock(&driverMutex);
+    return retVal;
+}
+
+/* Returns the registered driver with the given name, or NULL */
+static CONST Vfs_Driver*
+Vfs_FindDriver(CONST char *name)
+{
+    Tcl_HashEntry *entryPtr;
+    CONST Vfs_Driver *driver = NULL;
+
+    Tcl_MutexLock(&driverMutex);
+    if (driverTableInit) {
+	entryPtr = Tcl_FindHashEntry(&driverTable, name);
+	if (entryPtr != NULL) {
+	    driver = (CONST Vfs_Driver*) Tcl_GetHashValue(entryPtr);
+	}
+    }
+    Tcl_MutexUnlock(&driverMutex);
+    return driver;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -706,13 +1052,13 @@ VfsFilesystemObjCmd(dummy, interp, objc, objv)
 
     static CONST char *optionStrings[] = {
 	"info", "internalerror", "mount", "unmount", 
-	"fullynormalize", "posixerror", 
+	"fullynormalize", "posixerror", "invalidate", "cachestats",
 	NULL
     };
     
     enum options {
 	VFS_INFO, VFS_INTERNAL_ERROR, VFS_MOUNT, VFS_UNMOUNT, 
-	VFS_NORMALIZE, VFS_POSIXERROR
+	VFS_NORMALIZE, VFS_POSIXERROR, VFS_INVALIDATE, VFS_CACHESTATS
     };
 
     if (objc < 2) {
@@ -788,29 +1134,128 @@ VfsFilesystemObjCmd(dummy, interp, objc, objv)
 	    }
 	}
         case VFS_MOUNT: {
-	    if (objc < 4 || objc > 5) {
-		Tcl_WrongNumArgs(interp, 1, objv, "mount ?-volume? path cmd");
+	    int i = 2, isVolume = 0, isNative = 0, listStat = 0;
+	    long cacheTtl = -1;
+	    if (objc < 4) {
+		Tcl_WrongNumArgs(interp, 1, objv, 
+		    "mount ?-volume? ?-cache ttl? ?-liststat? ?-native? path cmd ?arg ...?");
 		return TCL_ERROR;
 	    }
-	    if (objc == 5) {
-		char *option = Tcl_GetString(objv[2]);
-		if (strcmp("-volume", option)) {
+	    while (objc - i > 2) {
+		char *option = Tcl_GetString(objv[i]);
+		if (!strcmp("-volume", option)) {
+		    isVolume = 1;
+		} else if (!strcmp("-native", option)) {
+		    isNative = 1;
+		} else if (!strcmp("-liststat", option)) {
+		    listStat = 1;
+		} else if (!strcmp("-cache", option)) {
+		    if (Tcl_GetLongFromObj(interp, objv[++i], &cacheTtl) 
+			    != TCL_OK) {
+			return TCL_ERROR;
+		    }
+		    if (cacheTtl < 0) {
+			Tcl_AppendStringsToObj(Tcl_GetObjResult(interp),
+				"bad cache ttl \"", Tcl_GetString(objv[i]),
+				"\": must be 0 or more", (char *) NULL);
+			return TCL_ERROR;
+		    }
+		} else if (isNative) {
+		    /* The remaining words are the driver's arguments */
+		    break;
+		} else {
 		    Tcl_AppendStringsToObj(Tcl_GetObjResult(interp),
 			    "bad option \"", option,
-			    "\": must be -volume", (char *) NULL);
+			    "\": must be -cache, -liststat, -native or -volume", 
+			    (char *) NULL);
 		    return TCL_ERROR;
 		}
-		return Vfs_AddMount(objv[3], 1, interp, objv[4]);
+		i++;
+	    }
+	    if (isNative && listStat) {
+		Tcl_SetResult(interp, "-liststat mounts cannot be -native", 
+			TCL_STATIC);
+		return TCL_ERROR;
+	    }
+	    if (isNative) {
+		return VfsMountNative(interp, objv[i], isVolume, cacheTtl,
+				      objc - i - 1, objv + i + 1);
+	    }
+	    if (objc - i != 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, 
+		    "mount ?-volume? ?-cache ttl? ?-liststat? ?-native? path cmd ?arg ...?");
+		return TCL_ERROR;
+	    }
+	    if (isVolume) {
+		return Vfs_AddMount(objv[i], 1, interp, objv[i+1], 
+				    NULL, NULL, cacheTtl, listStat);
 	    } else {
 		Tcl_Obj *path;
 		int retVal;
-		path = VfsFullyNormalizePath(interp, objv[2]);
-		retVal = Vfs_AddMount(path, 0, interp, objv[3]);
+		path = VfsFullyNormalizePath(interp, objv[i]);
+		retVal = Vfs_AddMount(path, 0, interp, objv[i+1], 
+				      NULL, NULL, cacheTtl, listStat);
 		if (path != NULL) { Tcl_DecrRefCount(path); }
 		return retVal;
 	    }
 	    break;
 	}
+	case VFS_INVALIDATE:
+	case VFS_CACHESTATS: {
+	    Vfs_InterpCmd *val = NULL;
+	    if (objc > 3) {
+		Tcl_WrongNumArgs(interp, 2, objv, "?path?");
+		return TCL_ERROR;
+	    }
+	    if (objc == 3) {
+		val = Vfs_FindMount(objv[2], -1);
+		if (val == NULL) {
+		    Tcl_Obj *path;
+		    path = VfsFullyNormalizePath(interp, objv[2]);
+		    val = Vfs_FindMount(path, -1);
+		    Tcl_DecrRefCount(path);
+		    if (val == NULL) {
+			Tcl_AppendStringsToObj(Tcl_GetObjResult(interp),
+				"no such mount \"", Tcl_GetString(objv[2]), 
+				"\"", (char *) NULL);
+			return TCL_ERROR;
+		    }
+		}
+		if (val->cache != NULL) {
+		    if (index == VFS_INVALIDATE) {
+			VfsCacheFlush(val->cache);
+		    } else {
+			Tcl_SetObjResult(interp, VfsCacheStats(val->cache));
+		    }
+		}
+	    } else {
+		/* All mounts, the statistics are summed up */
+		VfsMount *mountIter;
+		VfsCache total;
+		int numCaches = 0;
+
+		memset(&total, 0, sizeof(VfsCache));
+		for (mountIter = tsdPtr->listOfMounts; mountIter != NULL; 
+			mountIter = mountIter->nextMount) {
+		    VfsCache *cache = mountIter->interpCmd.cache;
+		    if (cache == NULL) {
+			continue;
+		    }
+		    if (index == VFS_INVALIDATE) {
+			VfsCacheFlush(cache);
+		    }
+		    total.numEntries += cache->numEntries;
+		    total.hits += cache->hits;
+		    total.misses += cache->misses;
+		    total.writable += cache->writable;
+		    numCaches++;
+		}
+		if (index == VFS_CACHESTATS && numCaches > 0) {
+		    Tcl_SetObjResult(interp, VfsCacheStats(&total));
+		}
+	    }
+	    return TCL_OK;
+	}
 	case VFS_INFO: {
 	    if (objc > 3) {
 		Tcl_WrongNumArgs(interp, 2, objv, "path");
@@ -862,6 +1307,78 @@ VfsFilesystemObjCmd(dummy, interp, objc, objv)
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsMountNative --
+ *
+ *	Implements 'vfs::filesystem mount -native'.  objv[0] is the
+ *	name of a registered driver, the remaining words are passed
+ *	to the driver's mountProc.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Adds a mount handled by the driver.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+VfsMountNative(interp, mountPoint, isVolume, cacheTtl, objc, objv)
+    Tcl_Interp *interp;
+    Tcl_Obj *mountPoint;
+    int isVolume;
+    long cacheTtl;
+    int objc;
+    Tcl_Obj *CONST objv[];
+{
+    CONST Vfs_Driver *driver;
+    ClientData driverData = NULL;
+    Tcl_Obj *path, *mountCmd;
+    int retVal;
+
+    driver = Vfs_FindDriver(Tcl_GetString(objv[0]));
+    if (driver == NULL) {
+	Tcl_AppendStringsToObj(Tcl_GetObjResult(interp),
+		"unknown vfs driver \"", Tcl_GetString(objv[0]), 
+		"\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+    if (driver->mountProc == NULL && objc > 1) {
+	Tcl_AppendStringsToObj(Tcl_GetObjResult(interp),
+		"vfs driver \"", driver->name, 
+		"\" takes no arguments", (char *) NULL);
+	return TCL_ERROR;
+    }
+
+    if (isVolume) {
+	path = mountPoint;
+	Tcl_IncrRefCount(path);
+    } else {
+	path = VfsFullyNormalizePath(interp, mountPoint);
+	if (path == NULL) {
+	    return TCL_ERROR;
+	}
+    }
+    if (driver->mountProc != NULL && driver->mountProc(interp, path, 
+	    objc - 1, objv + 1, &driverData) != TCL_OK) {
+	Tcl_DecrRefCount(path);
+	return TCL_ERROR;
+    }
+
+    mountCmd = Tcl_NewListObj(objc, objv);
+    Tcl_IncrRefCount(mountCmd);
+    retVal = Vfs_AddMount(path, isVolume, interp, mountCmd, 
+			  driver, driverData, cacheTtl, 0);
+    if (retVal != TCL_OK && driver->unmountProc != NULL) {
+	driver->unmountProc(driverData);
+    }
+    Tcl_DecrRefCount(mountCmd);
+    Tcl_DecrRefCount(path);
+    return retVal;
+}
+
 /* Handle an error thrown by a tcl vfs implementation */
 static void
 VfsInternalError(Tcl_Interp* interp)
@@ -1057,6 +1574,46 @@ VfsGetNativePath(Tcl_Obj* pathPtr) {
     return (VfsNativeRep*) Tcl_FSGetInternalRep(pathPtr, &vfsFilesystem);
 }
 
+/* 
+ * If the path is in a native mount, return the mount and set
+ * '*relativePtr' to the part of the normalized path inside it, as
+ * VfsBuildCommandForPath does for Tcl mounts.  Returns NULL for paths
+ * in a Tcl mount, or outside the vfs.
+ */
+static Vfs_InterpCmd*
+VfsGetDriver(Tcl_Obj* pathPtr, CONST char **relativePtr) {
+    VfsNativeRep *nativeRep = VfsGetNativePath(pathPtr);
+
+    if (nativeRep == NULL || nativeRep->fsCmd->driver == NULL) {
+	return NULL;
+    }
+    *relativePtr = VfsRelativePath(nativeRep, pathPtr);
+    return nativeRep->fsCmd;
+}
+
+/* 
+ * Return the part of the normalized path which lies inside the mount,
+ * the 'relative' argument of VfsBuildCommandForPath.
+ */
+static CONST char*
+VfsRelativePath(VfsNativeRep* nativeRep, Tcl_Obj* pathPtr) {
+    int len, splitPosition;
+    char *normedString;
+
+    splitPosition = nativeRep->splitPosition;
+    normedString = Tcl_GetStringFromObj(
+	    Tcl_FSGetNormalizedPath(NULL, pathPtr), &len);
+    if (splitPosition == len) {
+	return "";
+    } else if ((normedString[splitPosition] != VFS_SEPARATOR) 
+	    || (VFS_SEPARATOR ==':')) {
+	/* This will occur if we mount 'ftp://' */
+	return normedString + splitPosition;
+    } else {
+	return normedString + splitPosition + 1;
+    }
+}
+
 static void 
 VfsFreeInternalRep(ClientData clientData) {
     VfsNativeRep *nativeRep = (VfsNativeRep*)clientData;
@@ -1093,16 +1650,395 @@ VfsFilesystemSeparator(Tcl_Obj* pathPtr) {
     return Tcl_NewStringObj(&sep,1);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsStat, VfsAccess, VfsMatchInDirectory --
+ *
+ *	Answer the call from the mount's cache, if it has one which
+ *	knows the result, otherwise call the mount's handler, through
+ *	VfsHandlerStat etc., and keep the result in the cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
 static int
 VfsStat(pathPtr, bufPtr)
     Tcl_Obj *pathPtr;		/* Path of file to stat (in current CP). */
     Tcl_StatBuf *bufPtr;	/* Filled with results of stat call. */
+{
+    VfsCache *cache;
+    VfsCacheEntry *entry;
+    CONST char *relative;
+    int returnVal;
+
+    cache = VfsCacheFor(pathPtr, &relative);
+    if (cache == NULL) {
+	return VfsHandlerStat(pathPtr, bufPtr);
+    }
+    if (cache->listOnly) {
+	/* Only use a stat which came with a recent listing */
+	Tcl_HashEntry *entryPtr = Tcl_FindHashEntry(&cache->paths, relative);
+	if (entryPtr != NULL) {
+	    entry = (VfsCacheEntry*) Tcl_GetHashValue(entryPtr);
+	    if (entry->statErrno == 0 
+		    && !VfsCacheExpired(cache, &entry->stored)) {
+		cache->hits++;
+		*bufPtr = entry->statBuf;
+		return TCL_OK;
+	    }
+	}
+	cache->misses++;
+	return VfsHandlerStat(pathPtr, bufPtr);
+    }
+    entry = VfsCacheEntryFor(cache, relative);
+    if (entry->statErrno == 0) {
+	cache->hits++;
+	*bufPtr = entry->statBuf;
+	return TCL_OK;
+    } else if (entry->statErrno > 0) {
+	cache->hits++;
+	Tcl_SetErrno(entry->statErrno);
+	return TCLVFS_POSIXERROR;
+    }
+    cache->misses++;
+    returnVal = VfsHandlerStat(pathPtr, bufPtr);
+
+    /* 
+     * The handler may have modified or even unmounted the mount, so
+     * look the cache and the entry up again.
+     */
+    cache = VfsCacheFor(pathPtr, &relative);
+    if (cache == NULL) {
+	return returnVal;
+    }
+    entry = VfsCacheEntryFor(cache, relative);
+    if (returnVal == TCL_OK) {
+	entry->statErrno = 0;
+	entry->statBuf = *bufPtr;
+    } else {
+	entry->statErrno = Tcl_GetErrno();
+	if (entry->statErrno <= 0) {
+	    entry->statErrno = ENOENT;
+	}
+    }
+    return returnVal;
+}
+
+static int
+VfsAccess(pathPtr, mode)
+    Tcl_Obj *pathPtr;		/* Path of file to access (in current CP). */
+    int mode;                   /* Permission setting. */
+{
+    VfsCache *cache;
+    VfsCacheEntry *entry;
+    CONST char *relative;
+    int returnVal, bit = 1 << (mode & 7);
+
+    cache = VfsCacheFor(pathPtr, &relative);
+    if (cache == NULL || cache->listOnly) {
+	return VfsHandlerAccess(pathPtr, mode);
+    }
+    entry = VfsCacheEntryFor(cache, relative);
+    if (entry->accessKnown & bit) {
+	cache->hits++;
+	if (entry->accessFailed & bit) {
+	    Tcl_SetErrno(ENOENT);
+	    return TCLVFS_POSIXERROR;
+	}
+	return TCL_OK;
+    }
+    cache->misses++;
+    returnVal = VfsHandlerAccess(pathPtr, mode);
+    cache = VfsCacheFor(pathPtr, &relative);
+    if (cache == NULL) {
+	return returnVal;
+    }
+    entry = VfsCacheEntryFor(cache, relative);
+    entry->accessKnown |= bit;
+    if (returnVal != TCL_OK) {
+	entry->accessFailed |= bit;
+    }
+    return returnVal;
+}
+
+static int
+VfsMatchInDirectory(
+    Tcl_Interp *cmdInterp,	/* Interpreter to receive error msgs. */
+    Tcl_Obj *returnPtr,		/* Object to receive results. */
+    Tcl_Obj *dirPtr,	        /* Contains path to directory to search. */
+    CONST char *pattern,	/* Pattern to match against. */
+    Tcl_GlobTypeData *types)	/* Object containing list of acceptable types.
+				 * May be NULL. */
+{
+    VfsCache *cache;
+    VfsCacheListing *listing;
+    Tcl_HashEntry *entryPtr;
+    CONST char *relative;
+    Tcl_DString key;
+    Tcl_Obj *listPtr;
+    char typeString[TCL_INTEGER_SPACE + 2];
+    int returnVal, isNew;
+
+    if ((types != NULL) && (types->type & TCL_GLOB_TYPE_MOUNT)) {
+	return VfsHandlerMatchInDirectory(cmdInterp, returnPtr, dirPtr, 
+					  pattern, types);
+    }
+    cache = VfsCacheFor(dirPtr, &relative);
+    if (cache == NULL || cache->listOnly) {
+	return VfsHandlerMatchInDirectory(cmdInterp, returnPtr, dirPtr, 
+					  pattern, types);
+    }
+
+    /* 
+     * The result consists of paths joined to dirPtr as given, so the
+     * key has to include that as well as the normalized path.
+     */
+    sprintf(typeString, "%d%c", (types == NULL) ? 0 : types->type, 
+	    (pattern == NULL) ? 'n' : 'p');
+    Tcl_DStringInit(&key);
+    Tcl_DStringAppendElement(&key, typeString);
+    Tcl_DStringAppendElement(&key, (pattern == NULL) ? "" : pattern);
+    Tcl_DStringAppendElement(&key, relative);
+    Tcl_DStringAppendElement(&key, Tcl_GetString(dirPtr));
+
+    entryPtr = Tcl_FindHashEntry(&cache->listings, Tcl_DStringValue(&key));
+    if (entryPtr != NULL) {
+	listing = (VfsCacheListing*) Tcl_GetHashValue(entryPtr);
+	if (!VfsCacheExpired(cache, &listing->stored)) {
+	    cache->hits++;
+	    Tcl_DStringFree(&key);
+	    return Tcl_ListObjAppendList(cmdInterp, returnPtr, 
+					 listing->listPtr);
+	}
+    }
+
+    cache->misses++;
+    listPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(listPtr);
+    returnVal = VfsHandlerMatchInDirectory(cmdInterp, listPtr, dirPtr, 
+					   pattern, types);
+    cache = VfsCacheFor(dirPtr, &relative);
+    if (returnVal == TCL_OK) {
+	if (cache != NULL && cache->numEntries >= VFS_CACHE_MAX_ENTRIES) {
+	    VfsCacheFlush(cache);
+	}
+	if (cache != NULL) {
+	    entryPtr = Tcl_CreateHashEntry(&cache->listings, 
+					   Tcl_DStringValue(&key), &isNew);
+	    if (isNew) {
+		listing = (VfsCacheListing*) ckalloc(sizeof(VfsCacheListing));
+		Tcl_SetHashValue(entryPtr, (ClientData) listing);
+		cache->numEntries++;
+	    } else {
+		listing = (VfsCacheListing*) Tcl_GetHashValue(entryPtr);
+		Tcl_DecrRefCount(listing->listPtr);
+	    }
+	    Tcl_GetTime(&listing->stored);
+	    listing->listPtr = listPtr;
+	    Tcl_IncrRefCount(listPtr);
+	}
+	returnVal = Tcl_ListObjAppendList(cmdInterp, returnPtr, listPtr);
+    }
+    Tcl_DecrRefCount(listPtr);
+    Tcl_DStringFree(&key);
+    return returnVal;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsCacheNew, VfsCacheFlush, VfsCacheFree --
+ *
+ *	Create, empty and delete the cache of a mount.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static VfsCache*
+VfsCacheNew(long ttl)
+{
+    VfsCache *cache = (VfsCache*) ckalloc(sizeof(VfsCache));
+
+    memset(cache, 0, sizeof(VfsCache));
+    cache->ttl = ttl;
+    Tcl_InitHashTable(&cache->paths, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&cache->listings, TCL_STRING_KEYS);
+    return cache;
+}
+
+static void
+VfsCacheFlush(VfsCache *cache)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+
+    for (entryPtr = Tcl_FirstHashEntry(&cache->paths, &search); 
+	    entryPtr != NULL; entryPtr = Tcl_NextHashEntry(&search)) {
+	ckfree((char*) Tcl_GetHashValue(entryPtr));
+    }
+    for (entryPtr = Tcl_FirstHashEntry(&cache->listings, &search); 
+	    entryPtr != NULL; entryPtr = Tcl_NextHashEntry(&search)) {
+	VfsCacheListing *listing = (VfsCacheListing*) Tcl_GetHashValue(entryPtr);
+	Tcl_DecrRefCount(listing->listPtr);
+	ckfree((char*) listing);
+    }
+    Tcl_DeleteHashTable(&cache->paths);
+    Tcl_DeleteHashTable(&cache->listings);
+    Tcl_InitHashTable(&cache->paths, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&cache->listings, TCL_STRING_KEYS);
+    cache->numEntries = 0;
+}
+
+static void
+VfsCacheFree(VfsCache *cache)
+{
+    VfsCacheFlush(cache);
+    Tcl_DeleteHashTable(&cache->paths);
+    Tcl_DeleteHashTable(&cache->listings);
+    ckfree((char*) cache);
+}
+
+/* 
+ * Return the cache of the mount of a path, and the part of the path
+ * inside the mount, or NULL if the mount is not cached (any more).
+ */
+static VfsCache*
+VfsCacheFor(Tcl_Obj* pathPtr, CONST char **relativePtr) {
+    VfsNativeRep *nativeRep = VfsGetNativePath(pathPtr);
+
+    if (nativeRep == NULL || nativeRep->fsCmd->cache == NULL 
+	    || nativeRep->fsCmd->cache->writable) {
+	return NULL;
+    }
+    *relativePtr = VfsRelativePath(nativeRep, pathPtr);
+    return nativeRep->fsCmd->cache;
+}
+
+/* 
+ * Return the entry for a path, which is created, or reset if it has
+ * expired, as needed.
+ */
+static VfsCacheEntry*
+VfsCacheEntryFor(VfsCache *cache, CONST char *relative) {
+    Tcl_HashEntry *entryPtr;
+    VfsCacheEntry *entry;
+    int isNew;
+
+    entryPtr = Tcl_FindHashEntry(&cache->paths, relative);
+    if (entryPtr != NULL) {
+	entry = (VfsCacheEntry*) Tcl_GetHashValue(entryPtr);
+	if (!VfsCacheExpired(cache, &entry->stored)) {
+	    return entry;
+	}
+    } else {
+	if (cache->numEntries >= VFS_CACHE_MAX_ENTRIES) {
+	    VfsCacheFlush(cache);
+	}
+	entryPtr = Tcl_CreateHashEntry(&cache->paths, relative, &isNew);
+	entry = (VfsCacheEntry*) ckalloc(sizeof(VfsCacheEntry));
+	Tcl_SetHashValue(entryPtr, (ClientData) entry);
+	cache->numEntries++;
+    }
+    Tcl_GetTime(&entry->stored);
+    entry->statErrno = -1;
+    entry->accessKnown = 0;
+    entry->accessFailed = 0;
+    return entry;
+}
+
+static int
+VfsCacheExpired(VfsCache *cache, Tcl_Time *stored) {
+    Tcl_Time now;
+
+    if (cache->ttl == 0) {
+	return 0;
+    }
+    Tcl_GetTime(&now);
+    return (now.sec - stored->sec) * 1000 
+	    + (now.usec - stored->usec) / 1000 >= cache->ttl;
+}
+
+/* 
+ * A file in the mount of pathPtr is about to be modified, so its
+ * cache is emptied, and not used any more, unless it only keeps the
+ * stats of recent listings.
+ */
+static void
+VfsCacheWrite(Tcl_Obj* pathPtr) {
+    VfsNativeRep *nativeRep = VfsGetNativePath(pathPtr);
+
+    if (nativeRep != NULL && nativeRep->fsCmd->cache != NULL 
+	    && !nativeRep->fsCmd->cache->writable) {
+	VfsCacheFlush(nativeRep->fsCmd->cache);
+	if (!nativeRep->fsCmd->cache->listOnly) {
+	    nativeRep->fsCmd->cache->writable = 1;
+	}
+    }
+}
+
+/* 
+ * Keep the stat of a path which the handler reported in a listing,
+ * if its mount is cached.
+ */
+static void
+VfsCacheListStat(Tcl_Obj* pathPtr, Tcl_StatBuf *bufPtr) {
+    VfsCache *cache;
+    VfsCacheEntry *entry;
+    CONST char *relative;
+
+    cache = VfsCacheFor(pathPtr, &relative);
+    if (cache == NULL) {
+	return;
+    }
+    entry = VfsCacheEntryFor(cache, relative);
+    if (cache->listOnly) {
+	/* The stat is fresh, whatever else the entry held */
+	Tcl_GetTime(&entry->stored);
+    }
+    entry->statErrno = 0;
+    entry->statBuf = *bufPtr;
+}
+
+/* Return the statistics reported by 'vfs::filesystem cachestats' */
+static Tcl_Obj*
+VfsCacheStats(VfsCache *cache) {
+    Tcl_Obj *res = Tcl_NewObj();
+
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("hits", -1));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewLongObj(cache->hits));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("misses", -1));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewLongObj(cache->misses));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("entries", -1));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewIntObj(cache->numEntries));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("writable", -1));
+    Tcl_ListObjAppendElement(NULL, res, Tcl_NewIntObj(cache->writable));
+    return res;
+}
+
+static int
+VfsHandlerStat(pathPtr, bufPtr)
+    Tcl_Obj *pathPtr;		/* Path of file to stat (in current CP). */
+    Tcl_StatBuf *bufPtr;	/* Filled with results of stat call. */
 {
     Tcl_Obj *mountCmd = NULL;
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->statProc == NULL) {
+	    Tcl_SetErrno(ENOENT);
+	    return TCLVFS_POSIXERROR;
+	}
+	memset(bufPtr, 0, sizeof(Tcl_StatBuf));
+	return native->driver->statProc(native->driverData, relative, 
+					pathPtr, bufPtr);
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "stat", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1113,118 +2049,7 @@ VfsStat(pathPtr, bufPtr)
     returnVal = Tcl_EvalObjEx(interp, mountCmd, 
 			      TCL_EVAL_GLOBAL | TCL_EVAL_DIRECT);
     if (returnVal == TCL_OK) {
-	int statListLength;
-	Tcl_Obj* resPtr = Tcl_GetObjResult(interp);
-	if (Tcl_ListObjLength(interp, resPtr, &statListLength) == TCL_ERROR) {
-	    returnVal = TCL_ERROR;
-	} else if (statListLength & 1) {
-	    /* It is odd! */
-	    returnVal = TCL_ERROR;
-	} else {
-	    /* 
-	     * The st_mode field is set part by the 'mode'
-	     * and part by the 'type' stat fields.
-	     */
-	    bufPtr->st_mode = 0;
-	    while (statListLength > 0) {
-		Tcl_Obj *field, *val;
-		char *fieldName;
-		statListLength -= 2;
-		Tcl_ListObjIndex(interp, resPtr, statListLength, &field);
-		Tcl_ListObjIndex(interp, resPtr, statListLength+1, &val);
-		fieldName = Tcl_GetString(field);
-		if (!strcmp(fieldName,"dev")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_dev = v;
-		} else if (!strcmp(fieldName,"ino")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_ino = (unsigned short)v;
-		} else if (!strcmp(fieldName,"mode")) {
-		    int v;
-		    if (Tcl_GetIntFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_mode |= v;
-		} else if (!strcmp(fieldName,"nlink")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_nlink = (short)v;
-		} else if (!strcmp(fieldName,"uid")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_uid = (short)v;
-		} else if (!strcmp(fieldName,"gid")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_gid = (short)v;
-		} else if (!strcmp(fieldName,"size")) {
-		    Tcl_WideInt v;
-		    if (Tcl_GetWideIntFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_size = v;
-		} else if (!strcmp(fieldName,"atime")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_atime = v;
-		} else if (!strcmp(fieldName,"mtime")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_mtime = v;
-		} else if (!strcmp(fieldName,"ctime")) {
-		    long v;
-		    if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
-			returnVal = TCL_ERROR;
-			break;
-		    }
-		    bufPtr->st_ctime = v;
-		} else if (!strcmp(fieldName,"type")) {
-		    char *str;
-		    str = Tcl_GetString(val);
-		    if (!strcmp(str,"directory")) {
-			bufPtr->st_mode |= S_IFDIR;
-		    } else if (!strcmp(str,"file")) {
-			bufPtr->st_mode |= S_IFREG;
-#ifdef S_ISLNK
-		    } else if (!strcmp(str,"link")) {
-			bufPtr->st_mode |= S_IFLNK;
-#endif
-		    } else {
-			/* 
-			 * Do nothing.  This means we do not currently
-			 * support anything except files and directories
-			 */
-		    }
-		} else {
-		    /* Ignore additional stat arguments */
-		}
-	    }
-	}
+	returnVal = VfsParseStat(interp, Tcl_GetObjResult(interp), bufPtr);
     }
     
     if (returnVal != TCL_OK && returnVal != TCLVFS_POSIXERROR) {
@@ -1242,8 +2067,144 @@ VfsStat(pathPtr, bufPtr)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsParseStat --
+ *
+ *	Fills in 'bufPtr' from a stat result in the format of the
+ *	'stat' handler command, a list of field names and values.
+ *
+ * Results:
+ *	A standard Tcl result, with an error message in 'interp' if
+ *	a field has a bad value.
+ *
+ *----------------------------------------------------------------------
+ */
 static int
-VfsAccess(pathPtr, mode)
+VfsParseStat(interp, resPtr, bufPtr)
+    Tcl_Interp *interp;
+    Tcl_Obj *resPtr;
+    Tcl_StatBuf *bufPtr;
+{
+    int returnVal = TCL_OK;
+    int statListLength;
+
+    if (Tcl_ListObjLength(interp, resPtr, &statListLength) == TCL_ERROR) {
+	returnVal = TCL_ERROR;
+    } else if (statListLength & 1) {
+	/* It is odd! */
+	returnVal = TCL_ERROR;
+    } else {
+	/* 
+	 * The st_mode field is set part by the 'mode'
+	 * and part by the 'type' stat fields.
+	 */
+	bufPtr->st_mode = 0;
+	while (statListLength > 0) {
+	    Tcl_Obj *field, *val;
+	    char *fieldName;
+	    statListLength -= 2;
+	    Tcl_ListObjIndex(interp, resPtr, statListLength, &field);
+	    Tcl_ListObjIndex(interp, resPtr, statListLength+1, &val);
+	    fieldName = Tcl_GetString(field);
+	    if (!strcmp(fieldName,"dev")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_dev = v;
+	    } else if (!strcmp(fieldName,"ino")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_ino = (unsigned short)v;
+	    } else if (!strcmp(fieldName,"mode")) {
+		int v;
+		if (Tcl_GetIntFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_mode |= v;
+	    } else if (!strcmp(fieldName,"nlink")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_nlink = (short)v;
+	    } else if (!strcmp(fieldName,"uid")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_uid = (short)v;
+	    } else if (!strcmp(fieldName,"gid")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_gid = (short)v;
+	    } else if (!strcmp(fieldName,"size")) {
+		Tcl_WideInt v;
+		if (Tcl_GetWideIntFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_size = v;
+	    } else if (!strcmp(fieldName,"atime")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_atime = v;
+	    } else if (!strcmp(fieldName,"mtime")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_mtime = v;
+	    } else if (!strcmp(fieldName,"ctime")) {
+		long v;
+		if (Tcl_GetLongFromObj(interp, val, &v) != TCL_OK) {
+		    returnVal = TCL_ERROR;
+		    break;
+		}
+		bufPtr->st_ctime = v;
+	    } else if (!strcmp(fieldName,"type")) {
+		char *str;
+		str = Tcl_GetString(val);
+		if (!strcmp(str,"directory")) {
+		    bufPtr->st_mode |= S_IFDIR;
+		} else if (!strcmp(str,"file")) {
+		    bufPtr->st_mode |= S_IFREG;
+#ifdef S_ISLNK
+		} else if (!strcmp(str,"link")) {
+		    bufPtr->st_mode |= S_IFLNK;
+#endif
+		} else {
+		    /* 
+		     * Do nothing.  This means we do not currently
+		     * support anything except files and directories
+		     */
+		}
+	    } else {
+		/* Ignore additional stat arguments */
+	    }
+	}
+    }
+    return returnVal;
+}
+
+static int
+VfsHandlerAccess(pathPtr, mode)
     Tcl_Obj *pathPtr;		/* Path of file to access (in current CP). */
     int mode;                   /* Permission setting. */
 {
@@ -1251,7 +2212,19 @@ VfsAccess(pathPtr, mode)
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->accessProc == NULL) {
+	    Tcl_SetErrno(ENOENT);
+	    return TCLVFS_POSIXERROR;
+	}
+	return native->driver->accessProc(native->driverData, relative, 
+					  pathPtr, mode);
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "access", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1310,7 +2283,29 @@ VfsOpenFileChannel(cmdInterp, pathPtr, mode, permissions)
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    if (mode & (O_WRONLY | O_RDWR)) {
+	VfsCacheWrite(pathPtr);
+    }
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->openFileChannelProc == NULL) {
+	    Tcl_SetErrno(ENOENT);
+	} else {
+	    chan = native->driver->openFileChannelProc(native->driverData, 
+		    relative, pathPtr, mode, permissions);
+	}
+	if (chan == NULL && cmdInterp != NULL) {
+	    Tcl_ResetResult(cmdInterp);
+	    Tcl_AppendResult(cmdInterp, "couldn't open \"", 
+			     Tcl_GetString(pathPtr), "\": ",
+			     Tcl_PosixError(cmdInterp), (char *) NULL);
+	}
+	return chan;
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "open", pathPtr);
     if (mountCmd == NULL) {
 	return NULL;
@@ -1491,7 +2486,7 @@ VfsCloseProc(ClientData clientData) {
 }
 
 static int
-VfsMatchInDirectory(
+VfsHandlerMatchInDirectory(
     Tcl_Interp *cmdInterp,	/* Interpreter to receive error msgs. */
     Tcl_Obj *returnPtr,		/* Object to receive results. */
     Tcl_Obj *dirPtr,	        /* Contains path to directory to search. */
@@ -1536,18 +2531,34 @@ VfsMatchInDirectory(
 	Tcl_SavedResult savedResult;
 	int returnVal;
 	Tcl_Interp* interp;
-	int type = 0;
+	int type = 0, listStat;
 	Tcl_Obj *vfsResultPtr = NULL;
+	Vfs_InterpCmd *native;
+	VfsNativeRep *nativeRep;
+	CONST char *relative;
 	
-	mountCmd = VfsBuildCommandForPath(&interp, "matchindirectory", dirPtr);
-	if (mountCmd == NULL) {
-	    return TCLVFS_POSIXERROR;
-	}
-
 	if (types != NULL) {
 	    type = types->type;
 	}
 
+	native = VfsGetDriver(dirPtr, &relative);
+	if (native != NULL) {
+	    if (native->driver->matchInDirectoryProc == NULL) {
+		Tcl_SetErrno(ENOENT);
+		return TCLVFS_POSIXERROR;
+	    }
+	    return native->driver->matchInDirectoryProc(native->driverData, 
+		    relative, dirPtr, returnPtr, pattern, type);
+	}
+
+	nativeRep = VfsGetNativePath(dirPtr);
+	listStat = (nativeRep != NULL && nativeRep->fsCmd->listStat);
+	mountCmd = VfsBuildCommandForPath(&interp, 
+		listStat ? "liststat" : "matchindirectory", dirPtr);
+	if (mountCmd == NULL) {
+	    return TCLVFS_POSIXERROR;
+	}
+
 	if (pattern == NULL) {
 	    Tcl_ListObjAppendElement(interp, mountCmd, Tcl_NewObj());
 	} else {
@@ -1559,7 +2570,15 @@ VfsMatchInDirectory(
 	/* Now we execute this mount point's callback. */
 	returnVal = Tcl_EvalObjEx(interp, mountCmd, 
 				  TCL_EVAL_GLOBAL | TCL_EVAL_DIRECT);
-	if (returnVal != TCLVFS_POSIXERROR) {
+	if (returnVal == TCL_OK && listStat) {
+	    /* Pick the paths of the right type out of the path/stat pairs */
+	    vfsResultPtr = VfsListStatResult(interp, 
+		    Tcl_GetObjResult(interp), type);
+	    if (vfsResultPtr == NULL) {
+		returnVal = TCL_ERROR;
+	    }
+	}
+	if (returnVal != TCLVFS_POSIXERROR && vfsResultPtr == NULL) {
 	    vfsResultPtr = Tcl_DuplicateObj(Tcl_GetObjResult(interp));
 	}
 	Tcl_RestoreResult(interp, &savedResult);
@@ -1582,6 +2601,96 @@ VfsMatchInDirectory(
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsListStatResult --
+ *
+ *	Converts the result of a 'liststat' handler command, a list of
+ *	paths each followed by its stat, to the list of those paths
+ *	which have one of the glob 'type's (or all of them if 'type'
+ *	is 0), as 'matchindirectory' would have returned.  All of the
+ *	stats are kept in the mount's cache, for the stats which follow.
+ *
+ * Results:
+ *	A list with a refCount of zero, or NULL with an error message
+ *	in 'interp' if the result is malformed.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Obj*
+VfsListStatResult(interp, resultPtr, type)
+    Tcl_Interp *interp;
+    Tcl_Obj *resultPtr;
+    int type;
+{
+    Tcl_Obj **elemv, *listPtr = NULL;
+    Tcl_StatBuf buf;
+    int elemc, i;
+
+    /* Setting an error message in interp may free the result */
+    Tcl_IncrRefCount(resultPtr);
+    if (Tcl_ListObjGetElements(interp, resultPtr, &elemc, &elemv) != TCL_OK) {
+	goto done;
+    }
+    if (elemc & 1) {
+	Tcl_SetResult(interp, "liststat must return paths and their stats",
+		TCL_STATIC);
+	goto done;
+    }
+    listPtr = Tcl_NewObj();
+    for (i = 0; i < elemc; i += 2) {
+	memset(&buf, 0, sizeof(Tcl_StatBuf));
+	if (VfsParseStat(interp, elemv[i+1], &buf) != TCL_OK) {
+	    Tcl_ResetResult(interp);
+	    Tcl_AppendResult(interp, "bad stat for \"", 
+		    Tcl_GetString(elemv[i]), "\" in liststat result", 
+		    (char *) NULL);
+	    Tcl_DecrRefCount(listPtr);
+	    listPtr = NULL;
+	    goto done;
+	}
+	VfsCacheListStat(elemv[i], &buf);
+	if (type == 0 || (type & VfsGlobType(buf.st_mode))) {
+	    Tcl_ListObjAppendElement(NULL, listPtr, elemv[i]);
+	}
+    }
+  done:
+    Tcl_DecrRefCount(resultPtr);
+    return listPtr;
+}
+
+/* Return the Tcl_GlobTypeData type bit of a file mode */
+static int
+VfsGlobType(int mode) {
+    if (S_ISDIR(mode)) {
+	return TCL_GLOB_TYPE_DIR;
+    } else if (S_ISREG(mode)) {
+	return TCL_GLOB_TYPE_FILE;
+#ifdef S_ISLNK
+    } else if (S_ISLNK(mode)) {
+	return TCL_GLOB_TYPE_LINK;
+#endif
+#ifdef S_ISBLK
+    } else if (S_ISBLK(mode)) {
+	return TCL_GLOB_TYPE_BLOCK;
+#endif
+#ifdef S_ISCHR
+    } else if (S_ISCHR(mode)) {
+	return TCL_GLOB_TYPE_CHAR;
+#endif
+#ifdef S_ISFIFO
+    } else if (S_ISFIFO(mode)) {
+	return TCL_GLOB_TYPE_PIPE;
+#endif
+#ifdef S_ISSOCK
+    } else if (S_ISSOCK(mode)) {
+	return TCL_GLOB_TYPE_SOCK;
+#endif
+    }
+    return 0;
+}
+
 static int
 VfsDeleteFile(
     Tcl_Obj *pathPtr)		/* Pathname of file to be removed */
@@ -1590,7 +2699,19 @@ VfsDeleteFile(
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    VfsCacheWrite(pathPtr);
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->deleteFileProc == NULL) {
+	    Tcl_SetErrno(EROFS);
+	    return TCLVFS_POSIXERROR;
+	}
+	return native->driver->deleteFileProc(native->driverData, relative, pathPtr);
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "deletefile", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1616,7 +2737,19 @@ VfsCreateDirectory(
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    VfsCacheWrite(pathPtr);
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->createDirectoryProc == NULL) {
+	    Tcl_SetErrno(EROFS);
+	    return TCLVFS_POSIXERROR;
+	}
+	return native->driver->createDirectoryProc(native->driverData, relative, pathPtr);
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "createdirectory", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1648,7 +2781,26 @@ VfsRemoveDirectory(
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    VfsCacheWrite(pathPtr);
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->removeDirectoryProc == NULL) {
+	    Tcl_SetErrno(EROFS);
+	    returnVal = TCLVFS_POSIXERROR;
+	} else {
+	    returnVal = native->driver->removeDirectoryProc(
+		    native->driverData, relative, pathPtr, recursive);
+	}
+	if (returnVal != TCL_OK && errorPtr != NULL) {
+	    *errorPtr = pathPtr;
+	    Tcl_IncrRefCount(*errorPtr);
+	}
+	return returnVal;
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "removedirectory", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1685,7 +2837,20 @@ VfsFileAttrStrings(pathPtr, objPtrRef)
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->fileAttrStringsProc == NULL) {
+	    *objPtrRef = NULL;
+	} else {
+	    *objPtrRef = native->driver->fileAttrStringsProc(
+		    native->driverData, relative, pathPtr);
+	}
+	return NULL;
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "fileattributes", pathPtr);
     if (mountCmd == NULL) {
 	*objPtrRef = NULL;
@@ -1720,7 +2885,27 @@ VfsFileAttrsGet(cmdInterp, index, pathPtr, objPtrRef)
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->fileAttrsGetProc == NULL) {
+	    Tcl_SetErrno(ENOENT);
+	    returnVal = TCLVFS_POSIXERROR;
+	} else {
+	    returnVal = native->driver->fileAttrsGetProc(cmdInterp, 
+		    native->driverData, relative, pathPtr, index, objPtrRef);
+	}
+	if (returnVal == TCLVFS_POSIXERROR && cmdInterp != NULL) {
+	    Tcl_ResetResult(cmdInterp);
+	    Tcl_AppendResult(cmdInterp, "couldn't read attributes for \"", 
+			     Tcl_GetString(pathPtr), "\": ",
+			     Tcl_PosixError(cmdInterp), (char *) NULL);
+	}
+	return returnVal;
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "fileattributes", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1776,7 +2961,28 @@ VfsFileAttrsSet(cmdInterp, index, pathPtr, objPtr)
     int returnVal;
     Tcl_Interp* interp;
     Tcl_Obj *errorPtr = NULL;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    VfsCacheWrite(pathPtr);
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->fileAttrsSetProc == NULL) {
+	    Tcl_SetErrno(EROFS);
+	    returnVal = TCLVFS_POSIXERROR;
+	} else {
+	    returnVal = native->driver->fileAttrsSetProc(cmdInterp, 
+		    native->driverData, relative, pathPtr, index, objPtr);
+	}
+	if (returnVal == TCLVFS_POSIXERROR && cmdInterp != NULL) {
+	    Tcl_ResetResult(cmdInterp);
+	    Tcl_AppendResult(cmdInterp, "couldn't set attributes for \"", 
+			     Tcl_GetString(pathPtr), "\": ",
+			     Tcl_PosixError(cmdInterp), (char *) NULL);
+	}
+	return returnVal;
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "fileattributes", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -1823,7 +3029,20 @@ VfsUtime(pathPtr, tval)
     Tcl_SavedResult savedResult;
     int returnVal;
     Tcl_Interp* interp;
+    Vfs_InterpCmd *native;
+    CONST char *relative;
     
+    VfsCacheWrite(pathPtr);
+    native = VfsGetDriver(pathPtr, &relative);
+    if (native != NULL) {
+	if (native->driver->utimeProc == NULL) {
+	    Tcl_SetErrno(EROFS);
+	    return TCLVFS_POSIXERROR;
+	}
+	return native->driver->utimeProc(native->driverData, relative, 
+					 pathPtr, tval);
+    }
+
     mountCmd = VfsBuildCommandForPath(&interp, "utime", pathPtr);
     if (mountCmd == NULL) {
 	return TCLVFS_POSIXERROR;
@@ -2045,6 +3264,12 @@ static void
 VfsExitProc(ClientData clientData)
 {
     Tcl_FSUnregister(&vfsFilesystem);
+    Tcl_MutexLock(&driverMutex);
+    if (driverTableInit) {
+	Tcl_DeleteHashTable(&driverTable);
+	driverTableInit = 0;
+    }
+    Tcl_MutexUnlock(&driverMutex);
 }
 
 static void
@@ -2064,4 +3289,13 @@ VfsThreadExitProc(ClientData clientData)
 	Tcl_DecrRefCount(tsdPtr->internalErrorScript);
 	tsdPtr->internalErrorScript = NULL;
     }
+    if (tsdPtr->mountTableInit) {
+	Tcl_DeleteHashTable(&tsdPtr->mountTable);
+	tsdPtr->mountTableInit = 0;
+    }
+    if (tsdPtr->mountLens != NULL) {
+	ckfree((char*)tsdPtr->mountLens);
+	tsdPtr->mountLens = NULL;
+	tsdPtr->mountLensSize = 0;
+    }
 }
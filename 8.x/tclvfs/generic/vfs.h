@@ -0,0 +1,159 @@
+/*
+ * vfs.h --
+ *
+ *	Declarations for virtual filesystem drivers implemented in C.
+ *
+ *	A vfs implemented in Tcl is a command prefix, which vfs.c
+ *	evaluates for every filesystem operation.  A compiled driver
+ *	instead fills in a Vfs_Driver structure and registers it with
+ *	Vfs_RegisterDriver, after which it can be mounted with
+ *
+ *	    vfs::filesystem mount ?-volume? -native path driver ?arg ...?
+ *
+ *	and all operations inside 'path' call the driver's procedures
+ *	directly, without building or evaluating any Tcl command.
+ *
+ *	Drivers which are loaded as separate shared libraries should
+ *	define USE_VFS_STUBS, define the variable 'vfsStubsPtr' and
+ *	call Vfs_InitStubs before registering, so they do not need to
+ *	link against the vfs library itself.
+ *
+ * Copyright (c) 2001-2004 Vince Darley.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef _VFS_H
+#define _VFS_H
+
+#include <tcl.h>
+
+#ifdef BUILD_vfs
+#undef TCL_STORAGE_CLASS
+#define TCL_STORAGE_CLASS DLLEXPORT
+#endif /* BUILD_vfs */
+
+#define VFS_DRIVER_VERSION_1	((Tcl_FSVersion) 0x1)
+
+/*
+ * All file operations of a driver are passed the 'mountData' its
+ * mountProc returned, the part of the normalized path which lies
+ * inside the mount ("" for the mount point itself, and never with
+ * a leading separator), and the original, possibly relative, path
+ * object, as in the 'relative' and 'actualpath' arguments of a Tcl
+ * vfs command.
+ *
+ * Like the procedures of a Tcl_Filesystem, they return TCL_OK, or -1
+ * after setting the posix error with Tcl_SetErrno.  A NULL entry in
+ * the driver means the operation is not supported, vfs.c reports
+ * EROFS for modifying operations and ENOENT for the others.
+ */
+
+typedef int  (Vfs_MountProc) _ANSI_ARGS_((Tcl_Interp *interp,
+	Tcl_Obj *mountPoint, int objc, Tcl_Obj *CONST objv[],
+	ClientData *mountDataPtr));
+typedef void (Vfs_UnmountProc) _ANSI_ARGS_((ClientData mountData));
+typedef int  (Vfs_StatProc) _ANSI_ARGS_((ClientData mountData,
+	CONST char *relative, Tcl_Obj *pathPtr, Tcl_StatBuf *bufPtr));
+typedef int  (Vfs_AccessProc) _ANSI_ARGS_((ClientData mountData,
+	CONST char *relative, Tcl_Obj *pathPtr, int mode));
+typedef Tcl_Channel (Vfs_OpenFileChannelProc) _ANSI_ARGS_((
+	ClientData mountData, CONST char *relative, Tcl_Obj *pathPtr,
+	int mode, int permissions));
+typedef int  (Vfs_MatchInDirectoryProc) _ANSI_ARGS_((ClientData mountData,
+	CONST char *relative, Tcl_Obj *dirPtr, Tcl_Obj *returnPtr,
+	CONST char *pattern, int types));
+typedef int  (Vfs_PathProc) _ANSI_ARGS_((ClientData mountData,
+	CONST char *relative, Tcl_Obj *pathPtr));
+typedef int  (Vfs_RemoveDirectoryProc) _ANSI_ARGS_((ClientData mountData,
+	CONST char *relative, Tcl_Obj *pathPtr, int recursive));
+typedef int  (Vfs_UtimeProc) _ANSI_ARGS_((ClientData mountData,
+	CONST char *relative, Tcl_Obj *pathPtr, struct utimbuf *tval));
+typedef Tcl_Obj* (Vfs_FileAttrStringsProc) _ANSI_ARGS_((
+	ClientData mountData, CONST char *relative, Tcl_Obj *pathPtr));
+typedef int  (Vfs_FileAttrsGetProc) _ANSI_ARGS_((Tcl_Interp *interp,
+	ClientData mountData, CONST char *relative, Tcl_Obj *pathPtr,
+	int index, Tcl_Obj **objPtrRef));
+typedef int  (Vfs_FileAttrsSetProc) _ANSI_ARGS_((Tcl_Interp *interp,
+	ClientData mountData, CONST char *relative, Tcl_Obj *pathPtr,
+	int index, Tcl_Obj *objPtr));
+
+/*
+ * struct Vfs_Driver --
+ *
+ * A compiled vfs driver.  The structure is not copied, so it must
+ * remain valid for as long as the driver is registered or mounted,
+ * which usually means it is static.  Drivers are shared by all
+ * threads, but each mount only calls them in the thread which
+ * mounted it.
+ *
+ * The mountProc is called by 'vfs::filesystem mount -native' with
+ * the normalized mount point and the arguments following the driver
+ * name, and stores the data for the new mount in *mountDataPtr.  It
+ * returns TCL_ERROR, with a message in interp, to refuse the mount.
+ * If it is NULL, the mount takes no arguments and has NULL data.
+ *
+ * The unmountProc is called when the mount is removed, either by
+ * 'vfs::filesystem unmount' or because the interpreter which
+ * mounted it is deleted.
+ *
+ * The matchInDirectoryProc appends the full paths of the matching
+ * entries (joined to dirPtr) to returnPtr; 'types' is the type mask
+ * of Tcl_GlobTypeData, or 0.  The fileAttrStringsProc returns a list
+ * of attribute names with a refCount of zero, or NULL.
+ */
+
+typedef struct Vfs_Driver {
+    CONST char *name;		/* Name used in 'vfs::filesystem mount'. */
+    Tcl_FSVersion version;	/* VFS_DRIVER_VERSION_1. */
+    Vfs_MountProc *mountProc;
+    Vfs_UnmountProc *unmountProc;
+    Vfs_StatProc *statProc;
+    Vfs_AccessProc *accessProc;
+    Vfs_OpenFileChannelProc *openFileChannelProc;
+    Vfs_MatchInDirectoryProc *matchInDirectoryProc;
+    Vfs_PathProc *deleteFileProc;
+    Vfs_PathProc *createDirectoryProc;
+    Vfs_RemoveDirectoryProc *removeDirectoryProc;
+    Vfs_UtimeProc *utimeProc;
+    Vfs_FileAttrStringsProc *fileAttrStringsProc;
+    Vfs_FileAttrsGetProc *fileAttrsGetProc;
+    Vfs_FileAttrsSetProc *fileAttrsSetProc;
+} Vfs_Driver;
+
+/*
+ * The exported functions.  'package require vfs' returns a table of
+ * them as its client data, see Vfs_InitStubs below.
+ */
+
+EXTERN int Vfs_RegisterDriver _ANSI_ARGS_((CONST Vfs_Driver *driver));
+EXTERN int Vfs_UnregisterDriver _ANSI_ARGS_((CONST Vfs_Driver *driver));
+
+#define VFS_STUBS_MAGIC		((int) 0x56465331)	/* "VFS1" */
+
+typedef struct VfsStubs {
+    int magic;
+    int (*vfs_RegisterDriver) _ANSI_ARGS_((CONST Vfs_Driver *driver));
+    int (*vfs_UnregisterDriver) _ANSI_ARGS_((CONST Vfs_Driver *driver));
+} VfsStubs;
+
+#ifdef USE_VFS_STUBS
+extern CONST VfsStubs *vfsStubsPtr;
+
+#undef Vfs_RegisterDriver
+#define Vfs_RegisterDriver (vfsStubsPtr->vfs_RegisterDriver)
+#undef Vfs_UnregisterDriver
+#define Vfs_UnregisterDriver (vfsStubsPtr->vfs_UnregisterDriver)
+
+/* Returns the version of vfs, or NULL with an error message in interp */
+#define Vfs_InitStubs(interp, version) \
+    ((Tcl_PkgRequireEx((interp), "vfs", (version), 0, \
+	    (ClientData *) &vfsStubsPtr) == NULL || vfsStubsPtr == NULL \
+	    || vfsStubsPtr->magic != VFS_STUBS_MAGIC) ? NULL : (version))
+#endif /* USE_VFS_STUBS */
+
+#undef TCL_STORAGE_CLASS
+#define TCL_STORAGE_CLASS DLLIMPORT
+
+#endif /* _VFS_H */
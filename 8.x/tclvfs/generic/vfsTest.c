@@ -0,0 +1,424 @@
+/*
+ * vfsTest.c --
+ *
+ *	A small compiled vfs driver, used by the test suite to check
+ *	the native mounts of vfs.c.  It serves a fixed, read-only tree
+ *	of a few files and directories from memory:
+ *
+ *	    a.txt  lib/  lib/b.tcl  lib/c.txt  lib/sub/
+ *
+ *	It is only built into the vfs library by a test build, with
+ *	'configure --enable-testdriver' or 'nmake TESTDRIVER=1', which
+ *	define VFS_TEST_DRIVER.  It is registered by the separate
+ *	'Vfstest' package, which Vfs_Init then offers as a static
+ *	package, so the tests load it with
+ *
+ *	    load {} Vfstest
+ *
+ *	after which "vfstest" can be mounted with 'vfs::filesystem mount
+ *	-native'.  The command 'vfstest::mounts' returns the number of
+ *	mounts which have not been unmounted yet.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifdef HAVE_SYS_STAT_H
+#  include <sys/stat.h>
+#endif
+#include <tcl.h>
+/* Required for the open modes and access flags */
+#include "tclInt.h"
+#include "tclPort.h"
+#include "vfs.h"
+
+#ifdef BUILD_vfs
+#undef TCL_STORAGE_CLASS
+#define TCL_STORAGE_CLASS DLLEXPORT
+#endif /* BUILD_vfs */
+
+EXTERN int Vfstest_Init _ANSI_ARGS_((Tcl_Interp*));
+
+/*
+ * The tree served by every mount, parents before their children.
+ * Directories have no contents.
+ */
+
+typedef struct VfsTestEntry {
+    CONST char *relative;
+    CONST char *contents;
+} VfsTestEntry;
+
+static CONST VfsTestEntry vfsTestEntries[] = {
+    { "", NULL },
+    { "a.txt", "hello" },
+    { "lib", NULL },
+    { "lib/b.tcl", "set b 42" },
+    { "lib/c.txt", "line 1\nline 2\n" },
+    { "lib/sub", NULL },
+    { NULL, NULL }
+};
+
+#define VFSTEST_MTIME 1000000000
+
+static int vfsTestMounts = 0;
+static int vfsTestChannels = 0;
+TCL_DECLARE_MUTEX(vfsTestMutex)
+
+/*
+ * An open file, read from the contents of its entry.
+ */
+
+typedef struct VfsTestChannel {
+    CONST char *data;
+    int length;
+    int position;
+} VfsTestChannel;
+
+static Vfs_MountProc		VfsTestMount;
+static Vfs_UnmountProc		VfsTestUnmount;
+static Vfs_StatProc		VfsTestStat;
+static Vfs_AccessProc		VfsTestAccess;
+static Vfs_OpenFileChannelProc	VfsTestOpen;
+static Vfs_MatchInDirectoryProc	VfsTestMatch;
+
+static Tcl_DriverCloseProc	VfsTestChannelClose;
+static Tcl_DriverInputProc	VfsTestChannelInput;
+static Tcl_DriverOutputProc	VfsTestChannelOutput;
+static Tcl_DriverSeekProc	VfsTestChannelSeek;
+static Tcl_DriverWatchProc	VfsTestChannelWatch;
+static Tcl_DriverGetHandleProc	VfsTestChannelGetHandle;
+
+static CONST Vfs_Driver vfsTestDriver = {
+    "vfstest",			/* name */
+    VFS_DRIVER_VERSION_1,	/* version */
+    VfsTestMount,		/* mountProc */
+    VfsTestUnmount,		/* unmountProc */
+    VfsTestStat,		/* statProc */
+    VfsTestAccess,		/* accessProc */
+    VfsTestOpen,		/* openFileChannelProc */
+    VfsTestMatch,		/* matchInDirectoryProc */
+    NULL,			/* deleteFileProc */
+    NULL,			/* createDirectoryProc */
+    NULL,			/* removeDirectoryProc */
+    NULL,			/* utimeProc */
+    NULL,			/* fileAttrStringsProc */
+    NULL,			/* fileAttrsGetProc */
+    NULL			/* fileAttrsSetProc */
+};
+
+static Tcl_ChannelType vfsTestChannelType = {
+    "vfstest",			/* typeName */
+    TCL_CHANNEL_VERSION_2,	/* version */
+    VfsTestChannelClose,	/* closeProc */
+    VfsTestChannelInput,	/* inputProc */
+    VfsTestChannelOutput,	/* outputProc */
+    VfsTestChannelSeek,		/* seekProc */
+    NULL,			/* setOptionProc */
+    NULL,			/* getOptionProc */
+    VfsTestChannelWatch,	/* watchProc */
+    VfsTestChannelGetHandle,	/* getHandleProc */
+    NULL,			/* close2Proc */
+    NULL,			/* blockModeProc */
+    NULL,			/* flushProc */
+    NULL,			/* handlerProc */
+};
+
+/* Returns the entry of the given relative path, or NULL */
+static CONST VfsTestEntry*
+VfsTestFind(CONST char *relative)
+{
+    CONST VfsTestEntry *entry;
+
+    for (entry = vfsTestEntries; entry->relative != NULL; entry++) {
+	if (strcmp(entry->relative, relative) == 0) {
+	    return entry;
+	}
+    }
+    return NULL;
+}
+
+static int
+VfsTestMount(interp, mountPoint, objc, objv, mountDataPtr)
+    Tcl_Interp *interp;
+    Tcl_Obj *mountPoint;
+    int objc;
+    Tcl_Obj *CONST objv[];
+    ClientData *mountDataPtr;
+{
+    if (objc != 0) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"vfstest mounts take no arguments", -1));
+	return TCL_ERROR;
+    }
+    Tcl_MutexLock(&vfsTestMutex);
+    vfsTestMounts++;
+    Tcl_MutexUnlock(&vfsTestMutex);
+    *mountDataPtr = (ClientData) vfsTestEntries;
+    return TCL_OK;
+}
+
+static void
+VfsTestUnmount(mountData)
+    ClientData mountData;
+{
+    Tcl_MutexLock(&vfsTestMutex);
+    vfsTestMounts--;
+    Tcl_MutexUnlock(&vfsTestMutex);
+}
+
+static int
+VfsTestStat(mountData, relative, pathPtr, bufPtr)
+    ClientData mountData;
+    CONST char *relative;
+    Tcl_Obj *pathPtr;
+    Tcl_StatBuf *bufPtr;
+{
+    CONST VfsTestEntry *entry = VfsTestFind(relative);
+
+    if (entry == NULL) {
+	Tcl_SetErrno(ENOENT);
+	return -1;
+    }
+    memset(bufPtr, 0, sizeof(Tcl_StatBuf));
+    if (entry->contents == NULL) {
+	bufPtr->st_mode = S_IFDIR | 0555;
+    } else {
+	bufPtr->st_mode = S_IFREG | 0444;
+	bufPtr->st_size = (Tcl_WideInt) strlen(entry->contents);
+    }
+    bufPtr->st_nlink = 1;
+    bufPtr->st_mtime = VFSTEST_MTIME;
+    bufPtr->st_atime = VFSTEST_MTIME;
+    bufPtr->st_ctime = VFSTEST_MTIME;
+    return TCL_OK;
+}
+
+static int
+VfsTestAccess(mountData, relative, pathPtr, mode)
+    ClientData mountData;
+    CONST char *relative;
+    Tcl_Obj *pathPtr;
+    int mode;
+{
+    if (VfsTestFind(relative) == NULL) {
+	Tcl_SetErrno(ENOENT);
+	return -1;
+    }
+    if (mode & W_OK) {
+	Tcl_SetErrno(EROFS);
+	return -1;
+    }
+    return TCL_OK;
+}
+
+static Tcl_Channel
+VfsTestOpen(mountData, relative, pathPtr, mode, permissions)
+    ClientData mountData;
+    CONST char *relative;
+    Tcl_Obj *pathPtr;
+    int mode;
+    int permissions;
+{
+    CONST VfsTestEntry *entry = VfsTestFind(relative);
+    VfsTestChannel *chan;
+    char name[32];
+
+    if (mode & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC | O_APPEND)) {
+	Tcl_SetErrno(EROFS);
+	return NULL;
+    }
+    if (entry == NULL || entry->contents == NULL) {
+	Tcl_SetErrno(entry == NULL ? ENOENT : EISDIR);
+	return NULL;
+    }
+
+    chan = (VfsTestChannel*) ckalloc(sizeof(VfsTestChannel));
+    chan->data = entry->contents;
+    chan->length = (int) strlen(entry->contents);
+    chan->position = 0;
+
+    Tcl_MutexLock(&vfsTestMutex);
+    sprintf(name, "vfstest%d", vfsTestChannels++);
+    Tcl_MutexUnlock(&vfsTestMutex);
+    return Tcl_CreateChannel(&vfsTestChannelType, name,
+	    (ClientData) chan, TCL_READABLE);
+}
+
+static int
+VfsTestMatch(mountData, relative, dirPtr, returnPtr, pattern, types)
+    ClientData mountData;
+    CONST char *relative;
+    Tcl_Obj *dirPtr;
+    Tcl_Obj *returnPtr;
+    CONST char *pattern;
+    int types;
+{
+    CONST VfsTestEntry *entry;
+    int len = (int) strlen(relative);
+
+    for (entry = vfsTestEntries; entry->relative != NULL; entry++) {
+	CONST char *tail = entry->relative;
+	int type = entry->contents == NULL
+		? TCL_GLOB_TYPE_DIR : TCL_GLOB_TYPE_FILE;
+
+	if (types != 0 && !(types & type)) {
+	    continue;
+	}
+
+	/* without a pattern, only dirPtr itself may match */
+	if (pattern == NULL) {
+	    if (strcmp(tail, relative) == 0) {
+		Tcl_ListObjAppendElement(NULL, returnPtr, dirPtr);
+	    }
+	    continue;
+	}
+
+	/* direct children of relative, whose names match the pattern */
+	if (len > 0) {
+	    if (strncmp(tail, relative, (size_t) len) != 0
+		    || tail[len] != '/') {
+		continue;
+	    }
+	    tail += len + 1;
+	}
+	if (*tail != '\0' && strchr(tail, '/') == NULL
+		&& Tcl_StringCaseMatch(tail, pattern, 0)) {
+	    Tcl_Obj *tailObj = Tcl_NewStringObj(tail, -1);
+	    Tcl_ListObjAppendElement(NULL, returnPtr,
+		    Tcl_FSJoinToPath(dirPtr, 1, &tailObj));
+	}
+    }
+    return TCL_OK;
+}
+
+static int
+VfsTestChannelClose(instanceData, interp)
+    ClientData instanceData;
+    Tcl_Interp *interp;
+{
+    ckfree((char*) instanceData);
+    return 0;
+}
+
+static int
+VfsTestChannelInput(instanceData, buf, toRead, errorCodePtr)
+    ClientData instanceData;
+    char *buf;
+    int toRead;
+    int *errorCodePtr;
+{
+    VfsTestChannel *chan = (VfsTestChannel*) instanceData;
+
+    if (toRead > chan->length - chan->position) {
+	toRead = chan->length - chan->position;
+    }
+    if (toRead <= 0) {
+	return 0;
+    }
+    memcpy(buf, chan->data + chan->position, (size_t) toRead);
+    chan->position += toRead;
+    return toRead;
+}
+
+static int
+VfsTestChannelOutput(instanceData, buf, toWrite, errorCodePtr)
+    ClientData instanceData;
+    CONST char *buf;
+    int toWrite;
+    int *errorCodePtr;
+{
+    *errorCodePtr = EROFS;
+    return -1;
+}
+
+static int
+VfsTestChannelSeek(instanceData, offset, seekMode, errorCodePtr)
+    ClientData instanceData;
+    long offset;
+    int seekMode;
+    int *errorCodePtr;
+{
+    VfsTestChannel *chan = (VfsTestChannel*) instanceData;
+
+    switch (seekMode) {
+	case SEEK_CUR: offset += chan->position; break;
+	case SEEK_END: offset += chan->length; break;
+    }
+    if (offset < 0 || offset > chan->length) {
+	*errorCodePtr = EINVAL;
+	return -1;
+    }
+    chan->position = (int) offset;
+    return chan->position;
+}
+
+static void
+VfsTestChannelWatch(instanceData, mask)
+    ClientData instanceData;
+    int mask;
+{
+}
+
+static int
+VfsTestChannelGetHandle(instanceData, direction, handlePtr)
+    ClientData instanceData;
+    int direction;
+    ClientData *handlePtr;
+{
+    return TCL_ERROR;
+}
+
+static int
+VfsTestMountsObjCmd(dummy, interp, objc, objv)
+    ClientData dummy;
+    Tcl_Interp *interp;
+    int objc;
+    Tcl_Obj *CONST objv[];
+{
+    int mounts;
+
+    if (objc != 1) {
+	Tcl_WrongNumArgs(interp, 1, objv, NULL);
+	return TCL_ERROR;
+    }
+    Tcl_MutexLock(&vfsTestMutex);
+    mounts = vfsTestMounts;
+    Tcl_MutexUnlock(&vfsTestMutex);
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(mounts));
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Vfstest_Init --
+ *
+ *	Registers the "vfstest" driver and creates 'vfstest::mounts'.
+ *	The vfs package is required first, as with a driver in a
+ *	separate library.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Adds a driver and a command.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Vfstest_Init(interp)
+    Tcl_Interp *interp;		/* Interpreter for application. */
+{
+    if (Tcl_InitStubs(interp, "8.4", 0) == NULL) {
+	return TCL_ERROR;
+    }
+    if (Tcl_PkgRequire(interp, "vfs", "1.4", 0) == NULL
+	    || Vfs_RegisterDriver(&vfsTestDriver) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    Tcl_CreateObjCommand(interp, "vfstest::mounts", VfsTestMountsObjCmd,
+	    (ClientData) NULL, (Tcl_CmdDeleteProc *) NULL);
+    return Tcl_PkgProvide(interp, "vfstest", "1.0");
+}
@@ -43,7 +43,14 @@ namespace eval vfs::mk4 {
 	  set mkfile [file normalize $mkfile]
 	}
 	set db [eval [list ::mk4vfs::_mount $mkfile] $args]
-	::vfs::filesystem mount $local [list ::vfs::mk4::handler $db]
+	# the files of a read-only mount never change, cache their status
+	if {$::mk4vfs::v::mode($db) eq "readonly"} {
+	    ::vfs::filesystem mount -cache 0 -liststat $local \
+		[list ::vfs::mk4::handler $db]
+	} else {
+	    ::vfs::filesystem mount -liststat $local \
+		[list ::vfs::mk4::handler $db]
+	}
 	::vfs::RegisterMount $local [list ::vfs::mk4::Unmount $db]
 	return $db
     }
@@ -103,7 +110,7 @@ namespace eval vfs::mk4 {
     
     proc handler {db cmd root relative actualpath args} {
 	#puts stderr "handler: $db - $cmd - $root - $relative - $actualpath - $args"
-	if {$cmd == "matchindirectory"} {
+	if {$cmd == "matchindirectory" || $cmd == "liststat"} {
 	    eval [list $cmd $db $relative $actualpath] $args
 	} elseif {$cmd == "fileattributes"} {
 	    eval [list $cmd $db $root $relative] $args
@@ -138,6 +145,23 @@ namespace eval vfs::mk4 {
 	return $newres
     }
 
+    # like matchindirectory, but each path is followed by its stat
+    proc liststat {db path actualpath pattern type} {
+	if {![string length $pattern]} {
+	    if {[catch {stat $db $path} sb]} {
+		return {}
+	    }
+	    return [list $actualpath $sb]
+	}
+	set res [list]
+	foreach name [::mk4vfs::getdir $db $path $pattern] {
+	    if {![catch {stat $db [file join $path $name]} sb]} {
+		lappend res [file join $actualpath $name] $sb
+	    }
+	}
+	return $res
+    }
+
     proc stat {db name} {
 	::mk4vfs::stat $db $name sb
 
@@ -302,6 +326,7 @@ namespace eval mk4vfs {
     variable flush    5000  ;# Auto-Commit frequency
     variable direct   0	    ;# read through a memchan, or from Mk4tcl if zero
     variable zstreamed 0    ;# decompress on the fly (needs zlib 1.1)
+    variable threads  1     ;# compress large files with vfs::zcompress
 
     namespace eval v {
 	variable seq      0
@@ -309,8 +334,11 @@ namespace eval mk4vfs {
 	             	     # (readwrite/translucent/readonly)
 	variable timer	    ;# array key is db, set to afterid, periodicCommit
 
+	variable index	    ;# array key is db, value is hashed dirs view
+
 	array set cache {}
 	array set fcache {}
+	array set hfiles {}
 
 	array set mode {exe translucent}
     }
@@ -347,10 +375,121 @@ namespace eval mk4vfs {
 		periodicCommit $db
 	    }
 	    set v::mode($db) [lindex {readwrite readonly translucent} $mode]
+	    openindex $db
 	}
 	return $db
     }
 
+    # The optional path index consists of two views stored in the datafile:
+    # "dirs_H" hashes the dirs view on (name, parent), and "files_H" has one
+    # row per directory, with its file count at the time of indexing and a
+    # hash map of its files on name.  Any change made through this driver
+    # drops the index, a directory whose file count differs is scanned.
+
+    proc index {db} {
+	closeindex $db
+	mk::view layout $db.dirs_H {_H:I _R:I}
+	mk::view layout $db.files_H {count:I {map {_H:I _R:I}}}
+	mk::view size $db.dirs_H 0
+	mk::view size $db.files_H 0
+
+	set n [mk::view size $db.dirs]
+	mk::view size $db.files_H $n
+	makehash $db.dirs $db.dirs_H 2
+	for {set i 0} {$i < $n} {incr i} {
+	    mk::set $db.files_H!$i count [mk::view size $db.dirs!$i.files]
+	    makehash $db.dirs!$i.files $db.files_H!$i.map 1
+	}
+	openindex $db
+    }
+
+    proc unindex {db} {
+	if {[info exists v::index($db)]} {
+	    closeindex $db
+	    mk::view size $db.dirs_H 0
+	    mk::view size $db.files_H 0
+	}
+    }
+
+    proc makehash {path map nkeys} {
+	set v [mk::view open $path]
+	set m [mk::view open $map]
+	set h [$v view hash $m $nkeys]
+	$v close
+	$m close
+	return $h
+    }
+
+    proc openindex {db} {
+	if {[lsearch -exact [mk::file views $db] files_H] >= 0
+	    && [mk::view size $db.dirs_H] > 0
+	    && [mk::view size $db.files_H] == [mk::view size $db.dirs]} {
+	    set v::index($db) [makehash $db.dirs $db.dirs_H 2]
+	}
+    }
+
+    proc closeindex {db} {
+	if {[info exists v::index($db)]} {
+	    $v::index($db) close
+	    unset v::index($db)
+	}
+	foreach {key h} [array get v::hfiles $db,*] {
+	    $h close
+	}
+	array unset v::hfiles $db,*
+    }
+
+    # return the row of a directory, or "" if there is none
+    proc finddir {db parent name} {
+	if {[info exists v::index($db)]} {
+	    if {![catch {$v::index($db) find name $name parent $parent} row]} {
+		return $row
+	    }
+	    # dirs added since indexing are not in the hash map
+	    if {[mk::view size $db.files_H] == [mk::view size $db.dirs]} {
+		return ""
+	    }
+	}
+	mk::select $db.dirs -count 1 parent $parent name $name
+    }
+
+    # return the row of a file in a directory, or -1 if there is none
+    proc findfile {db parent name} {
+	set fview $db.dirs!$parent.files
+	if {[info exists v::index($db)]
+	    && $parent < [mk::view size $db.files_H]
+	    && [mk::get $db.files_H!$parent count] == [mk::view size $fview]} {
+	    if {![info exists v::hfiles($db,$parent)]} {
+		# cache only a limited number of directories
+		if {[array size v::hfiles] >= 100} {
+		    foreach {key h} [array get v::hfiles] {
+			$h close
+		    }
+		    array unset v::hfiles *
+		}
+		set v::hfiles($db,$parent) \
+		    [makehash $fview $db.files_H!$parent.map 1]
+	    }
+	    if {[catch {$v::hfiles($db,$parent) find name $name} row]} {
+		return -1
+	    }
+	    return $row
+	}
+
+	# create a name cache of files in this directory
+	if {![info exists v::fcache($fview)]} {
+	    # cache only a limited number of directories
+	    if {[array size v::fcache] >= 10} {
+		array unset v::fcache *
+	    }
+	    set v::fcache($fview) {}
+	    mk::loop c $fview {
+		lappend v::fcache($fview) [mk::get $c name]
+	    }
+	}
+	lsearch -exact $v::fcache($fview) $name
+    }
+
     proc periodicCommit {db} {
 	variable flush
 	set v::timer($db) [after $flush [list ::mk4vfs::periodicCommit $db]]
@@ -360,6 +499,7 @@ namespace eval mk4vfs {
 
     proc _umount {db args} {
 	catch {after cancel $v::timer($db)}
+	closeindex $db
 	array unset v::mode $db
 	array unset v::timer $db
 	array unset v::cache $db,*
@@ -379,7 +519,7 @@ namespace eval mk4vfs {
 	    if {[info exists v::cache($db,$parent,$ele)]} {
 		set parent $v::cache($db,$parent,$ele)
 	    } else {
-		set row [mk::select $view -count 1 parent $parent name $ele]
+		set row [finddir $db $parent $ele]
 		if { $row == "" } {
 		    vfs::filesystem posixerror $::vfs::posix(ENOENT)
 		}
@@ -399,27 +539,13 @@ namespace eval mk4vfs {
 	    set row $v::cache($db,$parent,$tail)
 	} else {
 	    # File?
-	    set fview $view!$parent.files
-	    # create a name cache of files in this directory
-	    if {![info exists v::fcache($fview)]} {
-		# cache only a limited number of directories
-		if {[array size v::fcache] >= 10} {
-		    array unset v::fcache *
-		}
-		set v::fcache($fview) {}
-		mk::loop c $fview {
-		    lappend v::fcache($fview) [mk::get $c name]
-		}
-	    }
-	    set row [lsearch -exact $v::fcache($fview) $tail]
-	    #set row [mk::select $fview -count 1 name $tail]
-	    #if {$row == ""} { set row -1 }
+	    set row [findfile $db $parent $tail]
 	    if { $row != -1 } {
 		set type file
 		set view $view!$parent.files
 	    } else {
 		# Directory?
-		set row [mk::select $view -count 1 parent $parent name $tail]
+		set row [finddir $db $parent $tail]
 		if { $row != "" } {
 		    set v::cache($db,$parent,$tail) $row
 		} else { 
@@ -476,7 +602,11 @@ namespace eval mk4vfs {
 	    fconfigure $fd -translation binary
 	    seek $fd 0
 	    set data [read $fd]
-	    set cdata [vfs::zip -mode compress $data]
+	    if {$mk4vfs::threads > 1 && [llength [info commands vfs::zcompress]]} {
+		set cdata [vfs::zcompress compress $data -1 $mk4vfs::threads]
+	    } else {
+		set cdata [vfs::zip -mode compress $data]
+	    }
 	    set len [string length $data]
 	    set clen [string length $cdata]
 	    if { $clen < $len } {
@@ -493,6 +623,7 @@ namespace eval mk4vfs {
     }
 
     proc setupCommits {db} {
+	unindex $db
 	if {$v::mode($db) eq "readwrite" && ![info exists v::timer($db)]} {
 	    periodicCommit $db
 	    mk::file autocommit $db
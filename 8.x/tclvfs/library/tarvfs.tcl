@@ -24,7 +24,8 @@ namespace eval vfs::tar {}
 
 proc vfs::tar::Mount {tarfile local} {
     set fd [vfs::tar::_open [::file normalize $tarfile]]
-    vfs::filesystem mount $local [list ::vfs::tar::handler $fd]
+    # the archive is read-only, cache the status of its files
+    vfs::filesystem mount -cache 0 $local [list ::vfs::tar::handler $fd]
     # Register command to unmount
     vfs::RegisterMount $local [list ::vfs::tar::Unmount $fd]
     return $fd
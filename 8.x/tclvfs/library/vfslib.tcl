@@ -1,6 +1,6 @@
 # Remnants of what used to be VFS init. This uses either the 8.6 core zlib
 # command or the tclkit zlib package with rechan to provide a memory channel
-# and a streaming decompression channel transform.
+# and a streaming decompression channel transform (unless tclkit has one).
 
 package require Tcl 8.4; # vfs is all new for 8.4
 package provide vfslib 1.4
@@ -29,10 +29,12 @@ if {[llength [info command zlib]] || ![catch {load "" zlib}]} {
     }
 }
 
-# Use 8.6 reflected channels or the rechan package in earlier versions to
-# provide a memory channel implementation.
+# Use the vfsmemchan package of tclkit, or else 8.6 reflected channels or the
+# rechan package in earlier versions to provide a memory channel implementation.
 #
-if {[info command ::chan] ne {}} {
+if {![catch {load "" vfsmemchan}]} {
+    # vfs::memchan is now defined
+} elseif {[info command ::chan] ne {}} {
 
     # As the core zlib channel stacking make non-seekable channels we cannot
     # implement vfs::zstream and this feature is disabled in tclkit boot.tcl
@@ -200,7 +202,11 @@ if {[info command ::chan] ne {}} {
     }
 }
 
-if {[info command rechan] ne "" || ![catch {load "" rechan}]} {
+# The zstream package of tclkit implements vfs::zstream as a channel in C,
+# otherwise it is emulated with rechan and the streaming zlib commands.
+if {![catch {load "" zstream}]} {
+    # vfs::zstream is now defined
+} elseif {[info command rechan] ne "" || ![catch {load "" rechan}]} {
     proc vfs::zstream_handler {zcmd ifd clen ilen imode cmd fd {a1 ""} {a2 ""}} {
 	#puts stderr "z $zcmd $ifd $ilen $cmd $fd $a1 $a2"
 	upvar ::vfs::_zstream_pos($fd) pos
@@ -20,7 +20,8 @@ proc vfs::zip::Execute {zipfile} {
 
 proc vfs::zip::Mount {zipfile local} {
     set fd [::zip::open [::file normalize $zipfile]]
-    vfs::filesystem mount $local [list ::vfs::zip::handler $fd]
+    # the archive is read-only, cache the status of its files
+    vfs::filesystem mount -cache 0 $local [list ::vfs::zip::handler $fd]
     # Register command to unmount
     vfs::RegisterMount $local [list ::vfs::zip::Unmount $fd]
     return $fd
@@ -114,6 +115,34 @@ proc vfs::zip::open {zipfd name mode permissions} {
                 vfs::filesystem posixerror $::vfs::posix(EISDIR)
             }
 
+	    # the native index knows where the data starts and how large it
+	    # is, also for ZIP64 archives whose local headers lack the sizes
+	    if {[info exists ::zip::_index($zipfd)]} {
+		seek $zipfd [$::zip::_index($zipfd) offset $name] start
+		if {$sb(method) == 8 && [package provide zstream] ne ""} {
+		    return [list [vfs::zstream inflate $zipfd \
+				      $sb(csize) $sb(size) -keepopen 1]]
+		}
+		if {$sb(method) == 0 && $sb(size) >= 1048576} {
+		    return [list [::zip::rawstream $zipfd $sb(size)]]
+		}
+		set data [read $zipfd $sb(csize)]
+		switch -- $sb(method) {
+		    0 {}
+		    8 { set data [vfs::zip -mode decompress -nowrap 1 $data] }
+		    default {
+			return -code error "unsupported compression method\
+			    \"$sb(method)\" used for \"$name\""
+		    }
+		}
+		set nfd [vfs::memchan]
+		fconfigure $nfd -translation binary
+		puts -nonewline $nfd $data
+		fconfigure $nfd -translation auto
+		seek $nfd 0
+		return [list $nfd]
+	    }
+
 #	    set nfd [vfs::memchan]
 #	    fconfigure $nfd -translation binary
 
@@ -544,6 +573,14 @@ proc zip::TOC {fd arr} {
 proc zip::open {path} {
     #vfs::log [list open $path]
     set fd [::open $path]
+
+    # use the native index if present, if it cannot find the end of the
+    # archive in the last 64K the code below searches the whole file
+    if {[info commands ::vfs::zipindex] ne ""
+	    && ![catch {vfs::zipindex $fd} cmd]} {
+	set ::zip::_index($fd) $cmd
+	return $fd
+    }
     
     if {[catch {
 	upvar #0 zip::$fd cb
@@ -603,6 +640,8 @@ proc zip::exists {fd path} {
     #::vfs::log "$fd $path"
     if {$path == ""} {
 	return 1
+    } elseif {[info exists ::zip::_index($fd)]} {
+	$::zip::_index($fd) exists $path
     } else {
 	upvar #0 zip::$fd.toc toc
 	info exists toc([string tolower $path])
@@ -620,6 +659,8 @@ proc zip::stat {fd path arr} {
 	    type directory mtime 0 size 0 mode 0777 
 	    ino -1 depth 0 name ""
 	}
+    } elseif {[info exists ::zip::_index($fd)]} {
+	array set sb [$::zip::_index($fd) stat $path]
     } elseif {![info exists toc($name)] } {
 	return -code error "could not read \"$path\": no such file or directory"
     } else {
@@ -640,6 +681,9 @@ proc zip::getdir {fd path {pat *}} {
     upvar #0 zip::$fd.toc toc
     upvar #0 zip::$fd.dir cbdir
 
+    if {[info exists ::zip::_index($fd)]} {
+	return [$::zip::_index($fd) getdir $path $pat]
+    }
     if { $path == "." || $path == "" } {
 	set path ""
     }  else  {
@@ -670,6 +714,13 @@ proc zip::getdir {fd path {pat *}} {
 }
 
 proc zip::_close {fd} {
+    variable _index
+    if {[info exists _index($fd)]} {
+	rename $_index($fd) {}
+	unset _index($fd)
+	::close $fd
+	return
+    }
     variable $fd
     variable $fd.toc
     variable $fd.dir
@@ -787,7 +838,19 @@ proc zip::eventPost {fd} {
     }
 }
 
+# tclkit has a native decompressing channel in its zstream package
+if {![catch {load "" zstream}]} {
+    set ::zip::useStreaming 1
+}
+
+# and a native version of the table of contents in its zipindex package
+catch {load "" zipindex}
+
 proc ::zip::zstream {ifd clen ilen} {
+    if {[package provide zstream] ne ""} {
+	# the archive channel is shared, so it must stay open
+	return [vfs::zstream inflate $ifd $clen $ilen -keepopen 1]
+    }
     set start [tell $ifd]
     set cmd [list ::zip::zstream_handler $start $ifd $clen $ilen]
     if {[catch {
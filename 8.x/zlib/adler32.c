@@ -9,6 +9,11 @@
 
 local uLong adler32_combine_ OF((uLong adler1, uLong adler2, z_off64_t len2));
 
+#ifdef X86_SIMD
+#  include <immintrin.h>
+   local uLong adler32_ssse3 OF((uLong adler, const Bytef *buf, z_size_t len));
+#endif
+
 #define BASE 65521U     /* largest prime smaller than 65536 */
 #define NMAX 5552
 /* NMAX is the largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1 */
@@ -99,6 +104,21 @@ uLong ZEXPORT adler32_z(adler, buf, len)
         return adler | (sum2 << 16);
     }
 
+#ifdef X86_SIMD
+    /* do 32-byte blocks with vector sums, if available */
+    if (len >= 64 && (x86_cpu_features() & X86_SSSE3)) {
+        z_size_t done = len & ~(z_size_t)31;
+
+        adler = adler32_ssse3(adler | (sum2 << 16), buf, done);
+        buf += done;
+        len -= done;
+        if (len == 0)
+            return adler;
+        sum2 = (adler >> 16) & 0xffff;
+        adler &= 0xffff;
+    }
+#endif /* X86_SIMD */
+
     /* do length NMAX blocks -- requires just one modulo operation */
     while (len >= NMAX) {
         len -= NMAX;
@@ -130,6 +150,72 @@ uLong ZEXPORT adler32_z(adler, buf, len)
     return adler | (sum2 << 16);
 }
 
+#ifdef X86_SIMD
+
+/* =========================================================================
+   Sum 32 bytes per step in vector registers: _mm_sad_epu8 adds the bytes
+   for adler, _mm_maddubs_epi16 weighs them by 32..1 for sum2, and each
+   step also adds 32 times the previous adler to sum2.  As in adler32_z(),
+   NMAX bytes are summed between modulos.  len must be a multiple of 32.
+ */
+X86_TARGET("ssse3")
+local uLong adler32_ssse3(adler, buf, len)
+    uLong adler;
+    const Bytef *buf;
+    z_size_t len;
+{
+    unsigned long sum2 = (adler >> 16) & 0xffff;
+    unsigned long blocks = (unsigned long)(len / 32);
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                       24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                       8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i v_ps, v_s1, v_s2, bytes1, bytes2;
+    unsigned n;
+
+    adler &= 0xffff;
+    while (blocks) {
+        n = NMAX / 32;
+        if (n > blocks)
+            n = (unsigned)blocks;
+        blocks -= n;
+
+        /* v_ps collects the adler values before each step, times 32 later */
+        v_ps = _mm_setr_epi32(0, 0, 0, (int)(adler * n));
+        v_s2 = _mm_setr_epi32(0, 0, 0, (int)sum2);
+        v_s1 = zero;
+        do {
+            bytes1 = _mm_loadu_si128((const __m128i *)buf);
+            bytes2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+                                    _mm_maddubs_epi16(bytes1, tap1), ones));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+                                    _mm_maddubs_epi16(bytes2, tap2), ones));
+            buf += 32;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* add up the lanes */
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, 0xb1));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, 0x4e));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, 0xb1));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, 0x4e));
+        adler += (unsigned long)(unsigned)_mm_cvtsi128_si32(v_s1);
+        sum2 = (unsigned long)(unsigned)_mm_cvtsi128_si32(v_s2);
+        MOD(adler);
+        MOD(sum2);
+    }
+
+    return adler | (sum2 << 16);
+}
+
+#endif /* X86_SIMD */
+
 /* ========================================================================= */
 uLong ZEXPORT adler32(adler, buf, len)
     uLong adler;
@@ -50,6 +50,12 @@ local unsigned long gf2_matrix_times OF((unsigned long *mat,
 local void gf2_matrix_square OF((unsigned long *square, unsigned long *mat));
 local uLong crc32_combine_ OF((uLong crc1, uLong crc2, z_off64_t len2));
 
+#ifdef X86_SIMD
+#  include <immintrin.h>
+   local z_crc_t crc32_pclmul OF((z_crc_t crc, const unsigned char FAR *buf,
+                                  z_size_t len));
+#endif
+
 
 #ifdef DYNAMIC_CRC_TABLE
 
@@ -211,6 +217,20 @@ unsigned long ZEXPORT crc32_z(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#ifdef X86_SIMD
+    /* fold the bulk of the data with carry-less multiplies, if available */
+    if (len >= 64 && (x86_cpu_features() & (X86_SSE41 | X86_PCLMUL)) ==
+                                          (X86_SSE41 | X86_PCLMUL)) {
+        z_size_t n = len & ~(z_size_t)15;
+
+        crc = crc32_pclmul((z_crc_t)crc ^ 0xffffffffUL, buf, n) ^ 0xffffffffUL;
+        buf += n;
+        len -= n;
+        if (len == 0)
+            return crc;
+    }
+#endif /* X86_SIMD */
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         z_crc_t endian;
@@ -340,6 +360,100 @@ local unsigned long crc32_big(crc, buf, len)
 
 #define GF2_DIM 32      /* dimension of GF(2) vectors (length of CRC) */
 
+#ifdef X86_SIMD
+
+/* =========================================================================
+   Fold four 128-bit lanes at a time with carry-less multiplication, then
+   reduce to 32 bits with Barrett reduction, as described in "Fast CRC
+   Computation for Generic Polynomials Using PCLMULQDQ Instruction" by Gopal
+   et al. (Intel, 2009).  The constants are for the bit-reflected polynomial
+   0xedb88320.  len must be at least 64 and a multiple of 16, crc is the
+   pre-conditioned (inverted) crc, and the result is not post-conditioned.
+ */
+X86_TARGET("sse4.1,pclmul")
+local z_crc_t crc32_pclmul(crc, buf, len)
+    z_crc_t crc;
+    const unsigned char FAR *buf;
+    z_size_t len;
+{
+    __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    buf += 64;
+    len -= 64;
+
+    /* fold 512 bits at a time */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold 128 bits at a time */
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (z_crc_t)_mm_extract_epi32(x1, 1);
+}
+
+#endif /* X86_SIMD */
+
 /* ========================================================================= */
 local unsigned long gf2_matrix_times(mat, vec)
     unsigned long *mat;
@@ -47,6 +47,7 @@ void test_sync          OF((Byte *compr, uLong comprLen,
 void test_dict_deflate  OF((Byte *compr, uLong comprLen));
 void test_dict_inflate  OF((Byte *compr, uLong comprLen,
                             Byte *uncompr, uLong uncomprLen));
+void test_checksums     OF((Byte *buf, uLong bufLen));
 int  main               OF((int argc, char *argv[]));
 
 
@@ -538,6 +539,90 @@ void test_dict_inflate(compr, comprLen, uncompr, uncomprLen)
     }
 }
 
+/* ===========================================================================
+ * Bit at a time versions of crc32() and adler32(), to check those against
+ */
+static uLong slow_crc32(crc, buf, len)
+    uLong crc;
+    const Byte *buf;
+    uLong len;
+{
+    int k;
+
+    crc = ~crc & 0xffffffffUL;
+    while (len--) {
+        crc ^= *buf++;
+        for (k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320UL : crc >> 1;
+    }
+    return ~crc & 0xffffffffUL;
+}
+
+static uLong slow_adler32(adler, buf, len)
+    uLong adler;
+    const Byte *buf;
+    uLong len;
+{
+    uLong a = adler & 0xffff, b = adler >> 16;
+
+    while (len--) {
+        a = (a + *buf++) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* ===========================================================================
+ * Test crc32() and adler32() at all alignments and odd lengths.  Lengths
+ * below 64 and the tails of longer buffers use the table driven code,
+ * the bulk of longer ones the SIMD code if this processor supports it.
+ */
+void test_checksums(buf, bufLen)
+    Byte *buf;
+    uLong bufLen;
+{
+    static const uLong lens[] = { 64, 65, 127, 255, 1001, 5551, 5553, 11105 };
+    uLong seed = 1, len, i, k;
+    int fill, off;
+
+    for (fill = 0; fill < 2; fill++) {
+        /* pseudo random bytes, then all 0xff, for the largest sums */
+        for (i = 0; i < bufLen; i++) {
+            seed = (seed * 1103515245UL + 12345) & 0xffffffffUL;
+            buf[i] = fill ? 0xff : (Byte)(seed >> 16);
+        }
+
+        for (off = 0; off < 16; off++) {
+            for (k = 0; k < 300 + sizeof(lens) / sizeof(lens[0]) + 1; k++) {
+                len = k < 300 ? k :
+                      k < 300 + sizeof(lens) / sizeof(lens[0]) ?
+                      lens[k - 300] : bufLen - 16;
+                if (crc32(0L, buf + off, (uInt)len) !=
+                        slow_crc32(0L, buf + off, len) ||
+                    adler32(1L, buf + off, (uInt)len) !=
+                        slow_adler32(1L, buf + off, len)) {
+                    fprintf(stderr, "bad checksum, offset %d length %lu\n",
+                            off, len);
+                    exit(1);
+                }
+
+                /* the same in two parts, split at an odd place */
+                if (len > 7 &&
+                    (crc32(crc32(0L, buf + off, 7), buf + off + 7,
+                           (uInt)len - 7) != slow_crc32(0L, buf + off, len) ||
+                     adler32(adler32(1L, buf + off, 7), buf + off + 7,
+                             (uInt)len - 7) !=
+                        slow_adler32(1L, buf + off, len))) {
+                    fprintf(stderr, "bad split checksum, offset %d length %lu\n",
+                            off, len);
+                    exit(1);
+                }
+            }
+        }
+    }
+    printf("crc32(), adler32(): OK\n");
+}
+
 /* ===========================================================================
  * Usage:  example [output.gz  [input.gz]]
  */
@@ -595,6 +680,8 @@ int main(argc, argv)
     test_dict_deflate(compr, comprLen);
     test_dict_inflate(compr, comprLen, uncompr, uncomprLen);
 
+    test_checksums(compr, comprLen);
+
     free(compr);
     free(uncompr);
 
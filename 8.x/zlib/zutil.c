@@ -323,3 +323,36 @@ void ZLIB_INTERNAL zcfree (opaque, ptr)
 #endif /* MY_ZCALLOC */
 
 #endif /* !Z_SOLO */
+
+#ifdef X86_SIMD
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#else
+#  include <cpuid.h>
+#endif
+
+/* the X86_* flags of the features of this processor, probed on first use */
+int ZLIB_INTERNAL x86_cpu_features()
+{
+    static volatile int features = -1;
+    unsigned int ecx = 0;
+
+    if (features < 0) {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        ecx = (unsigned int)info[2];
+#else
+        unsigned int eax, ebx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            ecx = 0;
+#endif
+        features = (ecx & (1 << 9) ? X86_SSSE3 : 0) |
+                   (ecx & (1 << 19) ? X86_SSE41 : 0) |
+                   (ecx & (1 << 1) ? X86_PCLMUL : 0);
+    }
+    return features;
+}
+
+#endif /* X86_SIMD */
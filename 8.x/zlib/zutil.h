@@ -268,4 +268,24 @@ extern z_const char * const z_errmsg[10]; /* indexed by 2-zlib_error */
 #define ZSWAP32(q) ((((q) >> 24) & 0xff) + (((q) >> 8) & 0xff00) + \
                     (((q) & 0xff00) << 8) + (((q) & 0xff) << 24))
 
+/* SIMD versions of crc32() and adler32() on x86, chosen at run time when
+   the processor supports them -- define NO_SIMD to leave them out */
+#if !defined(NO_SIMD) && \
+    (defined(__x86_64__) || defined(__i386__) || \
+     defined(_M_X64) || defined(_M_IX86)) && \
+    (defined(_MSC_VER) || defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || \
+                            (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#  define X86_SIMD
+#  define X86_SSSE3  1
+#  define X86_SSE41  2
+#  define X86_PCLMUL 4
+#  ifdef _MSC_VER
+#    define X86_TARGET(t)
+#  else
+#    define X86_TARGET(t) __attribute__((target(t)))
+#  endif
+   int ZLIB_INTERNAL x86_cpu_features OF((void));
+#endif
+
 #endif /* ZUTIL_H */
@@ -0,0 +1,124 @@
+# benchmark.tcl -
+#
+# Timings for the native channels and commands of TclKit, run as
+#
+#	./tclkit-cli ../../benchmark.tcl ?name ...?
+#
+# from the build directory, with the names of the benchmarks to run, or
+# without any to run them all.  Times are wall clock, in milliseconds.
+#
+
+catch {load "" zstream}
+
+# text of about n Mb, with a different line at each position
+proc benchData {n} {
+    expr {srand(42)}
+    set parts {}
+    for {set i 0} {$i < $n * 50000} {incr i} {
+	lappend parts "line $i [expr {int(rand() * 1e9)}]"
+    }
+    join $parts \n
+}
+
+proc ms {script} {
+    set t [clock microseconds]
+    uplevel 1 $script
+    expr {([clock microseconds] - $t) / 1000}
+}
+
+# random reads in an inflate channel, with and without a full read first
+proc bench-seek {} {
+    if {![llength [info commands vfs::zstream]]} {
+	return "no vfs::zstream"
+    }
+    set data [benchData 90]
+    set ilen [string length $data]
+    set file [file join [pwd] benchmark.tmp]
+    set offs {}
+    for {set i 0} {$i < 50} {incr i} {
+	lappend offs [expr {int(rand() * ($ilen - 100))}]
+    }
+    set r {}
+    foreach {out in} {deflate inflate compress decompress} {
+	set f [open $file w+]
+	fconfigure $f -translation binary
+	set z [vfs::zstream $out $f -keepopen 1]
+	fconfigure $z -translation binary
+	puts -nonewline $z $data
+	close $z
+	set clen [tell $f]
+	set bad 0
+	foreach warm {1 0} {
+	    seek $f 0
+	    set z [vfs::zstream $in $f $clen $ilen -keepopen 1]
+	    fconfigure $z -translation binary -buffersize 4096
+	    if {$warm} {
+		lappend r "$in read [ms {set all [read $z]}]"
+		if {$all ne $data} { incr bad }
+	    }
+	    lappend r "[lindex {cold warm} $warm] seeks [ms {
+		foreach o $offs {
+		    seek $z $o
+		    if {[read $z 100] ne [string range $data $o [expr {$o + 99}]]} {
+			incr bad
+		    }
+		}
+	    }]"
+	    close $z
+	}
+	close $f
+	if {$bad} { lappend r "$bad BAD" }
+    }
+    file delete $file
+    return "[expr {$ilen >> 20}] Mb, 50 reads: [join $r {, }]"
+}
+
+# inflate the startup scripts without their size and with it, up to 64K as
+# the boot code passes it, and create child interps, which run the boot path
+proc bench-boot {} {
+    set scripts {}
+    set size 0
+    foreach file [glob -directory [info library] *.tcl] {
+	set f [open $file]
+	fconfigure $f -translation binary
+	set s [read $f]
+	close $f
+	set len [string length $s]
+	lappend scripts [expr {$len > 65536 ? 65536 : $len}] [zlib compress $s]
+	incr size $len
+    }
+    set n 200
+    set guess [time {
+	foreach {len s} $scripts { zlib decompress $s }
+    } $n]
+    set sized [time {
+	foreach {len s} $scripts { zlib decompress $s $len }
+    } $n]
+    set interp [time {interp delete [interp create]} 20]
+    set r "[expr {[llength $scripts] / 2}] scripts, [expr {$size >> 10}] Kb"
+    append r [format ", inflate %.2f, with size %.2f, child interp %.2f" \
+		  [expr {[lindex $guess 0] / 1000.0}] \
+		  [expr {[lindex $sized 0] / 1000.0}] \
+		  [expr {[lindex $interp 0] / 1000.0}]]
+}
+
+# throughput of the checksums, in Mb/s, on 1 Mb at an odd offset
+proc bench-checksum {} {
+    set data [string range [benchData 2] 1 1048576]
+    set r {}
+    foreach sum {crc32 adler32} {
+	set t [lindex [time {zlib $sum $data} 200] 0]
+	lappend r "$sum [expr {int(1e6 / $t)}]"
+    }
+    join $r {, }
+}
+
+set names $argv
+if {![llength $names]} {
+    foreach cmd [lsort [info procs bench-*]] {
+	lappend names [string range $cmd 6 end]
+    }
+}
+foreach name $names {
+    puts "$name : [bench-$name]"
+}
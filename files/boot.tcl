@@ -1,3 +1,79 @@
+# with TCLKIT_TRACE set, also trace each call of the VFS handler and each
+# search for a package, see ::tcl::boottrace in kitInit.c
+proc ::tcl::TraceCall {name index cmd args} {
+    if {[lindex $args end] eq "enter"} {
+        ::tcl::boottrace begin "$name [lindex $cmd 2]" [lindex $cmd $index]
+    } else {
+        ::tcl::boottrace end
+    }
+}
+
+proc ::tcl::TracePkgUnknown {handler args} {
+    ::tcl::boottrace begin "package unknown" [lindex $args 0]
+    set code [catch {uplevel 1 $handler $args} result]
+    ::tcl::boottrace end
+    return -code $code $result
+}
+
+# lib/pkgIndex.kit has the package index scripts of the kit, evaluate those
+# instead of searching the kit for pkgIndex.tcl files, and only scan the rest
+# of auto_path, unless files were added to the kit after it was built
+proc ::tcl::KitPkgUnknown {handler args} {
+    global auto_path
+    variable kitPkgLib
+    variable kitPkgDirs
+    variable kitPkgIndex
+    variable kitPkgValid
+
+    if {![info exists kitPkgValid]} {
+        set kitPkgValid 1
+        foreach {d names} $kitPkgDirs {
+            set dir [file join $kitPkgLib $d]
+            if {[lsort [glob -nocomplain -tails -directory $dir *]] ne $names} {
+                set kitPkgValid 0
+            }
+        }
+    }
+    if {!$kitPkgValid} {
+        return [uplevel 1 $handler $args]
+    }
+
+    # the handler itself is autoloaded, so read the tclIndex files while the
+    # kit is still on auto_path
+    catch {auto_load_index}
+    set saved $auto_path
+    set auto_path {}
+    foreach dir $saved {
+        set covered 0
+        foreach {d names} $kitPkgDirs {
+            if {$dir eq [file join $kitPkgLib $d]} { set covered 1 }
+        }
+        if {!$covered} { lappend auto_path $dir }
+    }
+    set stripped $auto_path
+
+    foreach {d script} $kitPkgIndex {
+        KitPkgIndex [file join $kitPkgLib $d] $script
+    }
+    set code [catch {uplevel 1 $handler $args} result]
+
+    # keep directories which the index scripts added to auto_path
+    if {$auto_path ne $stripped} {
+        foreach dir $auto_path {
+            if {[lsearch -exact $saved $dir] < 0} { lappend saved $dir }
+        }
+    }
+    set auto_path $saved
+    return -code $code $result
+}
+
+# evaluate a package index script, as tclPkgUnknown does with pkgIndex.tcl
+proc ::tcl::KitPkgIndex {dir script} {
+    if {[catch $script msg] == 1} {
+        tclLog "error reading package index file $dir/pkgIndex.tcl: $msg"
+    }
+}
+
 proc tclInit {} {
     rename tclInit {}
 
@@ -28,25 +104,50 @@ proc tclInit {} {
             set d [mk::select exe.dirs parent 0 name lib]
             set d [mk::select exe.dirs parent $d -glob name vfs1*]
             
+            # the decompressed scripts are kept for later threads
             foreach x {vfsUtils vfslib mk4vfs} {
-                set n [mk::select exe.dirs!$d.files name $x.tcl]
-                if {[llength $n] != 1} { error "$x: cannot find startup script"}
-                
-                set s [mk::get exe.dirs!$d.files!$n contents]
-                catch {set s [zlib decompress $s]}
+                ::tcl::boottrace begin source $x.tcl
+                set s [::tcl::bootscript $x.tcl]
+                if {$s eq ""} {
+                    set n [mk::select exe.dirs!$d.files name $x.tcl]
+                    if {[llength $n] != 1} { error "$x: cannot find startup script"}
+
+                    foreach {size s} [mk::get exe.dirs!$d.files!$n size contents] break
+                    # as first buffer size, in the range the 8.6 core takes
+                    set size [expr {$size < 16 ? 16 : $size > 65536 ? 65536 : $size}]
+                    ::tcl::boottrace begin decompress $x.tcl
+                    catch {set s [zlib decompress $s $size]}
+                    ::tcl::boottrace end
+                    ::tcl::bootscript $x.tcl $s
+                }
                 uplevel #0 $s
+                ::tcl::boottrace end
             }
 
             # use on-the-fly decompression, if mk4vfs understands that
-            # Note: 8.6 core zlib does not support this for mk4vfs
-            if {![package vsatisfies [package require Tcl] 8.6]} {
+            # Note: 8.6 core zlib does not support this for mk4vfs, it needs
+            # the native vfs::zstream channels of the zstream package
+            if {[package provide zstream] ne ""
+                || ![package vsatisfies [package require Tcl] 8.6]} {
                 set mk4vfs::zstreamed 1
             }
+
+            # the native read-only driver in Mk4tcl avoids evaluating Tcl
+            # scripts for each file access, select it with TCLKIT_VFS=native
+            # (it needs the 8.6 core zlib to read compressed files)
+            if {[info exists ::env(TCLKIT_VFS)] && $::env(TCLKIT_VFS) eq "native"
+                && [llength [info commands mk::vfs]]
+                && [package vsatisfies [package require Tcl] 8.6]} {
+                set driver native
+            }
         } else {
             set driver mkcl
 
             # use raw Vlerq calls if Mk4tcl is not available
             # $::vlerq::starkit_root is set in the init script in kitInit.c
+            if {![info exists ::vlerq::starkit_root]} {
+                set ::vlerq::starkit_root [vlerq open $::tcl::kitpath]
+            }
             set rootv [vlerq get $::vlerq::starkit_root 0 dirs]
             set dname [vlerq get $rootv * name]
             set prows [vlerq get $rootv * parent]
@@ -68,9 +169,19 @@ proc tclInit {} {
                 set n [lsearch $names $f]
                 if {$n < 0} { error "$d/$f: cannot find startup script"}
                 
-                set s [vlerq get $files $n contents]
-                catch {set s [zlib decompress $s]}
+                ::tcl::boottrace begin source $f
+                set s [::tcl::bootscript $f]
+                if {$s eq ""} {
+                    set s [vlerq get $files $n contents]
+                    set size [vlerq get $files $n size]
+                    set size [expr {$size < 16 ? 16 : $size > 65536 ? 65536 : $size}]
+                    ::tcl::boottrace begin decompress $f
+                    catch {set s [zlib decompress $s $size]}
+                    ::tcl::boottrace end
+                    ::tcl::bootscript $f $s
+                }
                 uplevel #0 $s
+                ::tcl::boottrace end
             }
 
             # hack the mkcl info so it will know this mount point as "exe"
@@ -79,10 +190,29 @@ proc tclInit {} {
             set vfs::mkcl::v::prows(exe) $prows
         }
 
+        # the executable does not change, so its file status is cached,
+        # and mk4vfs reports the status of files along with directory lists
+        set mountopts {-cache 0}
+        if {$driver eq "mk4"} {
+            lappend mountopts -liststat
+        }
+
         # mount the executable, i.e. make all runtime files available
-        vfs::filesystem mount $noe [list ::vfs::${driver}::handler exe]
+        ::tcl::boottrace begin mount $noe
+        if {$driver eq "native"} {
+            mk::vfs mount exe $noe
+        } else {
+            eval vfs::filesystem mount $mountopts \
+                [list $noe [list ::vfs::${driver}::handler exe]]
+            if {[::tcl::boottrace]} {
+                trace add execution ::vfs::${driver}::handler {enter leave} \
+                    [list ::tcl::TraceCall vfs 5]
+            }
+        }
+        ::tcl::boottrace end
 
         # alter path to find encodings
+        set enc [encoding system]
         if {[info tclversion] eq "8.4"} {
             load {} pwb
             librarypath [info library]
@@ -105,23 +235,65 @@ proc tclInit {} {
             }
         }
 
-        # now remount the executable with the correct encoding
-        vfs::filesystem unmount $noe
-        set noe $::tcl::kitpath
-        # resolve symlinks
-        set noe [file dirname [file normalize [file join $noe __dummy__]]]
+        # now remount the executable with the correct encoding, the system
+        # encoding is set for the process, so later threads can skip this
+        if {[encoding system] ne $enc} {
+            ::tcl::boottrace begin remount $noe
+            if {$driver eq "native"} {
+                mk::vfs unmount $noe
+            } else {
+                vfs::filesystem unmount $noe
+            }
+            set noe $::tcl::kitpath
+            # resolve symlinks
+            set noe [file dirname [file normalize [file join $noe __dummy__]]]
 
-        set tcl_library [file join $noe lib tcl$tcl_version]
-        set tcl_libPath [list $tcl_library [file join $noe lib]]
-        vfs::filesystem mount $noe [list ::vfs::${driver}::handler exe]
+            set tcl_library [file join $noe lib tcl$tcl_version]
+            set tcl_libPath [list $tcl_library [file join $noe lib]]
+            if {$driver eq "native"} {
+                mk::vfs mount exe $noe
+            } else {
+                eval vfs::filesystem mount $mountopts \
+                    [list $noe [list ::vfs::${driver}::handler exe]]
+            }
+            ::tcl::boottrace end
+        }
     }
     
     # load config settings file if present
     namespace eval ::vfs { variable tclkit_version 1 }
+    ::tcl::boottrace begin source config.tcl
     catch { uplevel #0 [list source [file join $noe config.tcl]] }
+    ::tcl::boottrace end
 
+    ::tcl::boottrace begin source init.tcl
     uplevel #0 [list source [file join $tcl_library init.tcl]]
+    ::tcl::boottrace end
     
     # reset auto_path, so that init.tcl's search outside of tclkit is cancelled
     set auto_path $tcl_libPath
+
+    # use the package index of the kit, it is read once for all threads
+    set s [::tcl::bootscript pkgIndex.kit]
+    if {$s eq "" && ![catch {open [file join $noe lib pkgIndex.kit]} f]} {
+        fconfigure $f -encoding utf-8
+        set s [::tcl::bootscript pkgIndex.kit [read $f]]
+        close $f
+    }
+    if {$s ne "" && [package unknown] ne ""} {
+        namespace eval ::tcl $s
+        set ::tcl::kitPkgLib [file join $noe lib]
+        package unknown [list ::tcl::KitPkgUnknown [package unknown]]
+    } else {
+        rename ::tcl::KitPkgUnknown {}
+        rename ::tcl::KitPkgIndex {}
+    }
+
+    # the auto_path scans happen later, in [package unknown]
+    if {[::tcl::boottrace] && [package unknown] ne ""} {
+        package unknown [list ::tcl::TracePkgUnknown [package unknown]]
+    } elseif {![::tcl::boottrace]} {
+        rename ::tcl::TraceCall {}
+        rename ::tcl::TracePkgUnknown {}
+    }
 }
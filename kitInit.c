@@ -32,6 +32,18 @@
 #endif
 #endif
 
+/* define this to use the zstream channels of zlib.c, also with Tcl 8.6
+ * (Makefile.vc only links zlib.c into kits for Tcl 8.5 and older) */
+#ifndef KIT_INCLUDES_ZSTREAM
+#if KIT_INCLUDES_ZLIB || !defined(_MSC_VER)
+#define KIT_INCLUDES_ZSTREAM 1
+#else
+#define KIT_INCLUDES_ZSTREAM 0
+#endif
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef _WIN32
@@ -49,7 +61,7 @@ extern void TclSetStartupScriptPath(Tcl_Obj*);
 #endif
 extern char* TclSetPreInitScript (char*);
 
-Tcl_AppInitProc	Pwb_Init, Rechan_Init, Vfs_Init;
+Tcl_AppInitProc	Pwb_Init, Rechan_Init, Vfsmemchan_Init, Vfs_Init, Zipindex_Init;
 #ifdef KIT_LITE
 Tcl_AppInitProc	Vlerq_Init, Vlerq_SafeInit;
 #else
@@ -61,6 +73,9 @@ Tcl_AppInitProc	Thread_Init;
 #if KIT_INCLUDES_ZLIB
 Tcl_AppInitProc	Zlib_Init;
 #endif
+#if KIT_INCLUDES_ZSTREAM
+Tcl_AppInitProc	Zstream_Init;
+#endif
 #ifdef KIT_INCLUDES_ITCL
 Tcl_AppInitProc	Itcl_Init;
 #endif
@@ -90,6 +105,10 @@ static void TclKit_InitStdChannels(void);
  *  guards in the boot.tcl to avoid re-initializing things than do not need
  *  it. This is required to make child interpreters and thread interps
  *  initialize properly.
+ *
+ *  The decompressed boot.tcl is kept for the whole process by the
+ *  ::tcl::bootscript command, so later interps only open the kit again
+ *  if it is not mounted yet in their thread.
  */
 
 static char preInitCmd[] = 
@@ -100,30 +119,51 @@ static char preInitCmd[] =
 #if KIT_INCLUDES_ZLIB
     "catch {load {} zlib}\n"
 #endif
+    "set s [::tcl::bootscript boot.tcl]\n"
+    "set mounted [expr {$s ne {} && [file isdirectory $::tcl::kitpath]}]\n"
 #ifdef KIT_LITE
     "load {} vlerq\n"
     "namespace eval ::vlerq {}\n"
-    "if {[catch { vlerq open $::tcl::kitpath } ::vlerq::starkit_root]} {\n"
+    "::tcl::boottrace begin {kit open} $::tcl::kitpath\n"
+    "if {$mounted} {\n"
+      "set n 0\n"
+    "} elseif {[catch { vlerq open $::tcl::kitpath } ::vlerq::starkit_root]} {\n"
       "set n -1\n"
     "} else {\n"
       "set files [vlerq get $::vlerq::starkit_root 0 dirs 0 files]\n"
       "set n [lsearch [vlerq get $files * name] boot.tcl]\n"
     "}\n"
+    "::tcl::boottrace end\n"
     "if {$n >= 0} {\n"
-        "array set a [vlerq get $files $n]\n"
+        "if {$s eq {}} { array set a [vlerq get $files $n] }\n"
 #else
     "load {} Mk4tcl\n"
-    "mk::file open exe $::tcl::kitpath -readonly\n"
-    "set n [mk::select exe.dirs!0.files name boot.tcl]\n"
+    "::tcl::boottrace begin {kit open} $::tcl::kitpath\n"
+    "if {$mounted} {\n"
+      "set n 0\n"
+    "} else {\n"
+      "mk::file open exe $::tcl::kitpath -readonly\n"
+      "set n [mk::select exe.dirs!0.files name boot.tcl]\n"
+    "}\n"
+    "::tcl::boottrace end\n"
     "if {[llength $n] == 1} {\n"
-        "array set a [mk::get exe.dirs!0.files!$n]\n"
+        "if {$s eq {}} { array set a [mk::get exe.dirs!0.files!$n] }\n"
 #endif
-        "if {![info exists a(contents)]} { error {no boot.tcl file} }\n"
-        "if {$a(size) != [string length $a(contents)]} {\n"
-        	"set a(contents) [zlib decompress $a(contents)]\n"
+        "if {$s eq {}} {\n"
+          "if {![info exists a(contents)]} { error {no boot.tcl file} }\n"
+          "if {$a(size) != [string length $a(contents)]} {\n"
+          	"::tcl::boottrace begin decompress boot.tcl\n"
+          	/* the 8.6 core takes at most 64K as first buffer size */
+          	"set a(contents) [zlib decompress $a(contents)"
+          	  " [expr {$a(size) > 65536 ? 65536 : $a(size)}]]\n"
+          	"::tcl::boottrace end\n"
+          "}\n"
+          "if {$a(contents) eq \"\"} { error {empty boot.tcl} }\n"
+          "set s [::tcl::bootscript boot.tcl $a(contents)]\n"
         "}\n"
-        "if {$a(contents) eq \"\"} { error {empty boot.tcl} }\n"
-        "uplevel #0 $a(contents)\n"
+        "::tcl::boottrace begin source boot.tcl\n"
+        "uplevel #0 $s\n"
+        "::tcl::boottrace end\n"
     "} elseif {[lindex $::argv 0] eq \"-init-\"} {\n"
         "uplevel #0 { source [lindex $::argv 1] }\n"
         "exit\n"
@@ -149,6 +189,40 @@ static const char initScript[] =
  */
 static char *tclKitPath = NULL;
 
+/*
+ * Decompressed boot scripts of the base kit, shared by all interpreters and
+ * threads.  They are kept as strings, since compiled scripts belong to the
+ * interpreter which compiled them.  Dropped when the kit path changes.
+ */
+TCL_DECLARE_MUTEX(bootMutex)
+static Tcl_HashTable bootScripts;
+static int bootScriptsInit = 0;
+
+static void TclKit_FreeBootScripts(ClientData dummy);
+
+/*
+ * Boot tracing, enabled by setting TCLKIT_TRACE to the name of a file.
+ * Begin and end events of the startup phases are collected from all
+ * interpreters and threads, and written to that file at exit in the
+ * Chrome trace format, for chrome://tracing or https://ui.perfetto.dev
+ */
+typedef struct {
+    char ph;			/* 'B' or 'E' */
+    Tcl_WideInt ts;		/* microseconds since tracing started */
+    Tcl_ThreadId tid;
+    char *name;			/* phase, and the file it is about, if any */
+    char *detail;
+} TraceEvent;
+
+TCL_DECLARE_MUTEX(traceMutex)
+static char *traceFile = NULL;
+static Tcl_WideInt traceStart;
+static TraceEvent *traceEvents = NULL;
+static int traceCount = 0, traceMax = 0;
+
+static void TclKit_Trace(char ph, const char *name, const char *detail);
+static void TclKit_WriteTrace(ClientData dummy);
+
 #ifdef WIN32
 __declspec(dllexport) int
 #else
@@ -156,10 +230,25 @@ extern int
 #endif
 TclKit_AppInit(Tcl_Interp *interp)
 {
+    const char *trace = getenv("TCLKIT_TRACE");
+
+    if (trace != NULL && *trace != '\0' && traceFile == NULL) {
+	Tcl_Time now;
+
+	Tcl_GetTime(&now);
+	traceStart = (Tcl_WideInt) now.sec * 1000000 + now.usec;
+	traceFile = (char *) ckalloc((unsigned) strlen(trace) + 1);
+	strcpy(traceFile, trace);
+	Tcl_CreateExitHandler(TclKit_WriteTrace, NULL);
+    }
+    TclKit_Trace('B', "TclKit_AppInit", NULL);
+
     /*
      * Ensure that std channels exist (creating them if necessary)
      */
+    TclKit_Trace('B', "TclKit_InitStdChannels", NULL);
     TclKit_InitStdChannels();
+    TclKit_Trace('E', NULL, NULL);
 
 #ifdef KIT_INCLUDES_ITCL
     Tcl_StaticPackage(0, "Itcl", Itcl_Init, NULL);
@@ -174,10 +263,15 @@ TclKit_AppInit(Tcl_Interp *interp)
 #endif
     Tcl_StaticPackage(0, "tclkitpath", TclKitPath_Init, NULL);
     Tcl_StaticPackage(0, "rechan", Rechan_Init, NULL);
+    Tcl_StaticPackage(0, "vfsmemchan", Vfsmemchan_Init, NULL);
     Tcl_StaticPackage(0, "vfs", Vfs_Init, NULL);
+    Tcl_StaticPackage(0, "zipindex", Zipindex_Init, NULL);
 #if KIT_INCLUDES_ZLIB
     Tcl_StaticPackage(0, "zlib", Zlib_Init, NULL);
 #endif
+#if KIT_INCLUDES_ZSTREAM
+    Tcl_StaticPackage(0, "zstream", Zstream_Init, NULL);
+#endif
 #ifdef TCL_THREADS
     Tcl_StaticPackage(0, "Thread", Thread_Init, Thread_SafeInit);
 #endif
@@ -216,14 +310,18 @@ TclKit_AppInit(Tcl_Interp *interp)
 #endif
 
     TclSetPreInitScript(preInitCmd);
+    TclKit_Trace('B', "Tcl_Init", NULL);
     if (Tcl_Init(interp) == TCL_ERROR)
         goto error;
+    TclKit_Trace('E', NULL, NULL);
 
 #if defined(KIT_INCLUDES_TK) && defined(_WIN32)
+    TclKit_Trace('B', "Tk_Init", NULL);
     if (Tk_Init(interp) == TCL_ERROR)
         goto error;
     if (Tk_CreateConsoleWindow(interp) == TCL_ERROR)
         goto error;
+    TclKit_Trace('E', NULL, NULL);
 #endif
 
     /* messy because TclSetStartupScriptPath is called slightly too late */
@@ -238,6 +336,7 @@ TclKit_AppInit(Tcl_Interp *interp)
 
     Tcl_SetVar(interp, "errorInfo", "", TCL_GLOBAL_ONLY);
     Tcl_ResetResult(interp);
+    TclKit_Trace('E', NULL, NULL);
     return TCL_OK;
 
 error:
@@ -267,6 +366,9 @@ TclKit_SetKitPath(const char *kitPath)
     if (kitPath) {
       	int len = (int)strlen(kitPath);
       	if (tclKitPath) {
+      	    if (strcmp(tclKitPath, kitPath) != 0) {
+      	    	TclKit_FreeBootScripts(NULL);
+      	    }
       	    ckfree(tclKitPath);
       	}
 
@@ -339,6 +441,194 @@ TclKitPathObjCmd(ClientData dummy, Tcl_Interp *interp, int objc, Tcl_Obj *const
     return TCL_OK;
 }
 
+static void
+TclKit_FreeBootScripts(ClientData dummy)
+{
+    Tcl_HashEntry *entry;
+    Tcl_HashSearch search;
+
+    Tcl_MutexLock(&bootMutex);
+    if (bootScriptsInit) {
+	for (entry = Tcl_FirstHashEntry(&bootScripts, &search);
+		entry != NULL; entry = Tcl_NextHashEntry(&search)) {
+	    ckfree((char *) Tcl_GetHashValue(entry));
+	}
+	Tcl_DeleteHashTable(&bootScripts);
+	Tcl_InitHashTable(&bootScripts, TCL_STRING_KEYS);
+    }
+    Tcl_MutexUnlock(&bootMutex);
+}
+
+/*
+ * Process-wide cache of the boot scripts, ::tcl::bootscript name ?contents?
+ * stores contents under name, and returns it, or "" if there is none yet.
+ */
+static int
+TclKitBootScriptObjCmd(ClientData dummy, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
+{
+    Tcl_HashEntry *entry;
+    const char *str;
+    char *copy;
+    int isNew, len;
+
+    if (objc != 2 && objc != 3) {
+	Tcl_WrongNumArgs(interp, 1, objv, "name ?contents?");
+	return TCL_ERROR;
+    }
+
+    Tcl_MutexLock(&bootMutex);
+    if (!bootScriptsInit) {
+	Tcl_InitHashTable(&bootScripts, TCL_STRING_KEYS);
+	Tcl_CreateExitHandler(TclKit_FreeBootScripts, NULL);
+	bootScriptsInit = 1;
+    }
+    if (objc == 3) {
+	str = Tcl_GetStringFromObj(objv[2], &len);
+	copy = (char *) ckalloc(len + 1);
+	memcpy(copy, str, len + 1);
+	entry = Tcl_CreateHashEntry(&bootScripts, Tcl_GetString(objv[1]), &isNew);
+	if (!isNew) {
+	    ckfree((char *) Tcl_GetHashValue(entry));
+	}
+	Tcl_SetHashValue(entry, copy);
+	Tcl_SetObjResult(interp, objv[2]);
+    } else {
+	entry = Tcl_FindHashEntry(&bootScripts, Tcl_GetString(objv[1]));
+	if (entry != NULL) {
+	    Tcl_SetObjResult(interp,
+		    Tcl_NewStringObj((char *) Tcl_GetHashValue(entry), -1));
+	}
+    }
+    Tcl_MutexUnlock(&bootMutex);
+    return TCL_OK;
+}
+
+static char *
+TclKit_TraceString(const char *str)
+{
+    return str ? strcpy((char *) ckalloc((unsigned) strlen(str) + 1), str)
+	       : NULL;
+}
+
+static void
+TclKit_Trace(char ph, const char *name, const char *detail)
+{
+    Tcl_Time now;
+    TraceEvent *ev;
+
+    if (traceFile == NULL) {
+	return;
+    }
+    Tcl_GetTime(&now);
+
+    Tcl_MutexLock(&traceMutex);
+    if (traceCount >= traceMax) {
+	traceMax = traceMax ? 2 * traceMax : 256;
+	traceEvents = (TraceEvent *) ckrealloc((char *) traceEvents,
+		traceMax * sizeof(TraceEvent));
+    }
+    ev = traceEvents + traceCount++;
+    ev->ph = ph;
+    ev->ts = (Tcl_WideInt) now.sec * 1000000 + now.usec - traceStart;
+    ev->tid = Tcl_GetCurrentThread();
+    ev->name = TclKit_TraceString(name);
+    ev->detail = TclKit_TraceString(detail);
+    Tcl_MutexUnlock(&traceMutex);
+}
+
+static void
+TclKit_TraceJson(FILE *fp, const char *str)
+{
+    putc('"', fp);
+    for (; *str; ++str) {
+	if (*str == '"' || *str == '\\') {
+	    fprintf(fp, "\\%c", *str);
+	} else if ((unsigned char) *str < 0x20) {
+	    fprintf(fp, "\\u%04x", *str);
+	} else {
+	    putc(*str, fp);
+	}
+    }
+    putc('"', fp);
+}
+
+static void
+TclKit_WriteTrace(ClientData dummy)
+{
+    FILE *fp;
+    int i;
+
+    fp = fopen(traceFile, "w");
+    if (fp != NULL) {
+	fprintf(fp, "{\"traceEvents\":[");
+	for (i = 0; i < traceCount; ++i) {
+	    TraceEvent *ev = traceEvents + i;
+	    fprintf(fp, "%s\n{\"ph\":\"%c\",\"ts\":%" TCL_LL_MODIFIER "d,"
+		    "\"pid\":1,\"tid\":%lu", i ? "," : "", ev->ph, ev->ts,
+		    (unsigned long) (size_t) ev->tid);
+	    if (ev->name != NULL) {
+		fprintf(fp, ",\"cat\":\"boot\",\"name\":");
+		TclKit_TraceJson(fp, ev->name);
+	    }
+	    if (ev->detail != NULL) {
+		fprintf(fp, ",\"args\":{\"path\":");
+		TclKit_TraceJson(fp, ev->detail);
+		putc('}', fp);
+	    }
+	    putc('}', fp);
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+    }
+
+    for (i = 0; i < traceCount; ++i) {
+	if (traceEvents[i].name != NULL) {
+	    ckfree(traceEvents[i].name);
+	}
+	if (traceEvents[i].detail != NULL) {
+	    ckfree(traceEvents[i].detail);
+	}
+    }
+    if (traceEvents != NULL) {
+	ckfree((char *) traceEvents);
+    }
+    ckfree(traceFile);
+    traceFile = NULL;
+}
+
+/*
+ * Boot tracing from scripts: ::tcl::boottrace returns whether tracing is
+ * on, ::tcl::boottrace begin name ?path? and ::tcl::boottrace end mark
+ * the start and end of a phase.
+ */
+static int
+TclKitBootTraceObjCmd(ClientData dummy, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
+{
+    static const char *options[] = { "begin", "end", NULL };
+    int index;
+
+    if (objc == 1) {
+	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(traceFile != NULL));
+	return TCL_OK;
+    }
+    if (Tcl_GetIndexFromObj(interp, objv[1], options, "option", 0,
+	    &index) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (index == 0 ? objc != 3 && objc != 4 : objc != 2) {
+	Tcl_WrongNumArgs(interp, 1, objv,
+		index == 0 ? "begin name ?path?" : "end");
+	return TCL_ERROR;
+    }
+    if (index == 0) {
+	TclKit_Trace('B', Tcl_GetString(objv[2]),
+		objc == 4 ? Tcl_GetString(objv[3]) : NULL);
+    } else {
+	TclKit_Trace('E', NULL, NULL);
+    }
+    return TCL_OK;
+}
+
 /*
  * Public entry point for ::tcl::kitpath.
  * Creates both link variable name and Tcl command ::tcl::kitpath.
@@ -347,6 +637,8 @@ static int
 TclKitPath_Init(Tcl_Interp *interp)
 {
     Tcl_CreateObjCommand(interp, "::tcl::kitpath", TclKitPathObjCmd, 0, 0);
+    Tcl_CreateObjCommand(interp, "::tcl::bootscript", TclKitBootScriptObjCmd, 0, 0);
+    Tcl_CreateObjCommand(interp, "::tcl::boottrace", TclKitBootTraceObjCmd, 0, 0);
     if (Tcl_LinkVar(interp, "::tcl::kitpath", (char *) &tclKitPath,
 		TCL_LINK_STRING | TCL_LINK_READ_ONLY) != TCL_OK) {
 	Tcl_ResetResult(interp);
@@ -0,0 +1,364 @@
+/* Written as part of Tclkit, placed in the public domain.
+ *
+ * In-memory channels for the VFS, replacing the vfs::memchan of vfslib.tcl
+ *
+ *   vfs::memchan ?filename?
+ *
+ * returns a readable and writable channel which keeps its data in memory,
+ * in chunks of at most MEMCHAN_CHUNK bytes, so appending to or overwriting
+ * part of a large buffer does not copy all of it.  Seeking past the end
+ * extends the data with zero bytes, like the vfs::memchan of vfslib.tcl.
+ * Truncating (Tcl 8.5 and later) can shorten or extend the data.  The read-only -length and -allocated options report
+ * the size of the data and of the memory used for it.
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef TCL_DECLARE_MUTEX
+#define TCL_DECLARE_MUTEX(v)
+#define Tcl_MutexLock(v)
+#define Tcl_MutexUnlock(v)
+#endif
+
+#ifndef EINVAL
+#define EINVAL 22
+#endif
+
+#ifndef CONST84
+#define CONST84
+#endif
+
+#define MEMCHAN_CHUNK 65536  /* all chunks have this size, except when */
+#define MEMCHAN_FIRST 256    /* there is only one, it then starts smaller */
+
+  static int memChanSeq = 0;
+  TCL_DECLARE_MUTEX(memchanMutex)
+
+typedef struct
+{
+  Tcl_Channel _chan;
+  int _watchMask;
+  Tcl_TimerToken _timer;
+  char** _chunks;
+  int _numChunks;
+  int _maxChunks;
+  Tcl_WideInt _length;     /* size of the data */
+  Tcl_WideInt _allocated;  /* total size of the chunks */
+  Tcl_WideInt _pos;
+} MemoryChannel;
+
+/* make room for at least size_ bytes, the new space is not cleared */
+static void
+mcReserve (MemoryChannel* chan_, Tcl_WideInt size_)
+{
+  if (size_ <= chan_->_allocated)
+    return;
+
+  /* a single chunk doubles in size until it is a full one */
+  if (chan_->_numChunks <= 1 && chan_->_allocated < MEMCHAN_CHUNK) {
+    int n = chan_->_allocated > 0 ? (int) chan_->_allocated : MEMCHAN_FIRST;
+    while (n < size_ && n < MEMCHAN_CHUNK)
+      n *= 2;
+    if (n > MEMCHAN_CHUNK)
+      n = MEMCHAN_CHUNK;
+
+    if (chan_->_numChunks == 0) {
+      chan_->_maxChunks = 4;
+      chan_->_chunks = (char**) Tcl_Alloc(chan_->_maxChunks * sizeof (char*));
+      chan_->_chunks[0] = Tcl_Alloc(n);
+      chan_->_numChunks = 1;
+    } else
+      chan_->_chunks[0] = Tcl_Realloc(chan_->_chunks[0], n);
+    chan_->_allocated = n;
+  }
+
+  while (chan_->_allocated < size_) {
+    if (chan_->_numChunks >= chan_->_maxChunks) {
+      chan_->_maxChunks *= 2;
+      chan_->_chunks = (char**) Tcl_Realloc((char*) chan_->_chunks,
+      				chan_->_maxChunks * sizeof (char*));
+    }
+    chan_->_chunks[chan_->_numChunks++] = Tcl_Alloc(MEMCHAN_CHUNK);
+    chan_->_allocated += MEMCHAN_CHUNK;
+  }
+}
+
+/* copy between the chunks and buf_, starting at offset pos_ */
+static void
+mcCopy (MemoryChannel* chan_, Tcl_WideInt pos_, char* buf_, int len_,
+	int toChunks_)
+{
+  while (len_ > 0) {
+    char* p = chan_->_chunks[pos_ / MEMCHAN_CHUNK] + pos_ % MEMCHAN_CHUNK;
+    int n = MEMCHAN_CHUNK - (int) (pos_ % MEMCHAN_CHUNK);
+    if (n > len_)
+      n = len_;
+
+    if (toChunks_ == 1)
+      memcpy(p, buf_, n);
+    else if (toChunks_ == 0)
+      memcpy(buf_, p, n);
+    else
+      memset(p, 0, n);
+
+    pos_ += n;
+    buf_ += n;
+    len_ -= n;
+  }
+}
+
+/* extend the data with zero bytes up to size_ */
+static void
+mcExtend (MemoryChannel* chan_, Tcl_WideInt size_)
+{
+  if (size_ > chan_->_length) {
+    mcReserve(chan_, size_);
+    while (chan_->_length < size_) {
+      Tcl_WideInt n = size_ - chan_->_length;
+      if (n > MEMCHAN_CHUNK)
+      	n = MEMCHAN_CHUNK;
+      mcCopy(chan_, chan_->_length, NULL, (int) n, -1);
+      chan_->_length += n;
+    }
+  }
+}
+
+static int
+mcClose (ClientData cd_, Tcl_Interp* interp)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+  int i;
+
+  if (chan->_timer != NULL)
+    Tcl_DeleteTimerHandler(chan->_timer);
+
+  for (i = 0; i < chan->_numChunks; ++i)
+    Tcl_Free(chan->_chunks[i]);
+  if (chan->_chunks != NULL)
+    Tcl_Free((char*) chan->_chunks);
+  Tcl_Free((char*) chan);
+
+  return TCL_OK;
+}
+
+static int
+mcInput (ClientData cd_, char* buf, int toRead, int* errorCodePtr)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+
+  if (toRead > chan->_length - chan->_pos)
+    toRead = chan->_pos < chan->_length ? (int) (chan->_length - chan->_pos)
+    					: 0;
+
+  mcCopy(chan, chan->_pos, buf, toRead, 0);
+  chan->_pos += toRead;
+  return toRead;
+}
+
+static int
+mcOutput (ClientData cd_, const char* buf, int toWrite, int* errorCodePtr)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+
+  /* overwrites in place, only the part beyond the end extends the data */
+  mcExtend(chan, chan->_pos);
+  mcReserve(chan, chan->_pos + toWrite);
+  mcCopy(chan, chan->_pos, (char*) buf, toWrite, 1);
+
+  chan->_pos += toWrite;
+  if (chan->_pos > chan->_length)
+    chan->_length = chan->_pos;
+  return toWrite;
+}
+
+static Tcl_WideInt
+mcWideSeek (ClientData cd_, Tcl_WideInt offset, int seekMode,
+	    int* errorCodePtr)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+  Tcl_WideInt pos = offset;
+
+  switch (seekMode) {
+    case SEEK_CUR: pos += chan->_pos; break;
+    case SEEK_END: pos += chan->_length; break;
+  }
+
+  if (pos < 0) {
+    *errorCodePtr = EINVAL;
+    return -1;
+  }
+
+  mcExtend(chan, pos);
+  chan->_pos = pos;
+  return pos;
+}
+
+/* only used by cores without wide seeks */
+static int
+mcSeek (ClientData cd_, long offset, int seekMode, int* errorCodePtr)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+  Tcl_WideInt pos = offset;
+
+  switch (seekMode) {
+    case SEEK_CUR: pos += chan->_pos; break;
+    case SEEK_END: pos += chan->_length; break;
+  }
+
+  if (pos != (long) pos) {
+    *errorCodePtr = EINVAL;
+    return -1;
+  }
+
+  return (long) mcWideSeek(cd_, pos, SEEK_SET, errorCodePtr);
+}
+
+/* set the size of the data, chunks which are no longer needed are freed */
+static int
+mcTruncate (ClientData cd_, Tcl_WideInt length)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+
+  if (length < 0)
+    return EINVAL;
+
+  if (length > chan->_length)
+    mcExtend(chan, length);
+  else {
+    /* the first chunk stays, there is no other place for the chunk list */
+    int keep = (int) ((length + MEMCHAN_CHUNK - 1) / MEMCHAN_CHUNK);
+    if (keep < 1)
+      keep = 1;
+    if (chan->_numChunks > keep) {
+      while (chan->_numChunks > keep)
+	Tcl_Free(chan->_chunks[--chan->_numChunks]);
+      chan->_allocated = (Tcl_WideInt) keep * MEMCHAN_CHUNK;
+    }
+    chan->_length = length;
+  }
+
+  /* stay within the data, the next seek would otherwise extend it again */
+  if (chan->_pos > length)
+    chan->_pos = length;
+  return 0;
+}
+
+static int
+mcGetOption (ClientData cd_, Tcl_Interp* interp, CONST84 char* optionName,
+	     Tcl_DString* dsPtr)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+  char buffer [TCL_INTEGER_SPACE * 2];
+
+  if (optionName == NULL || strcmp(optionName, "-length") == 0) {
+    if (optionName == NULL)
+      Tcl_DStringAppendElement(dsPtr, "-length");
+    sprintf(buffer, "%" TCL_LL_MODIFIER "d", (Tcl_WideInt) chan->_length);
+    Tcl_DStringAppendElement(dsPtr, buffer);
+    if (optionName != NULL)
+      return TCL_OK;
+  }
+
+  if (optionName == NULL || strcmp(optionName, "-allocated") == 0) {
+    if (optionName == NULL)
+      Tcl_DStringAppendElement(dsPtr, "-allocated");
+    sprintf(buffer, "%" TCL_LL_MODIFIER "d", (Tcl_WideInt) chan->_allocated);
+    Tcl_DStringAppendElement(dsPtr, buffer);
+    return TCL_OK;
+  }
+
+  return Tcl_BadChannelOption(interp, optionName, "length allocated");
+}
+
+static void
+mcTimerProc (ClientData cd_)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+
+  /* no re-arming here, Tcl calls mcWatchChannel again if still interested */
+  chan->_timer = NULL;
+  Tcl_NotifyChannel(chan->_chan, chan->_watchMask);
+}
+
+static void
+mcWatchChannel (ClientData cd_, int mask)
+{
+  MemoryChannel* chan = (MemoryChannel*) cd_;
+
+  /* always readable and writable, so report that as soon as possible */
+  chan->_watchMask = mask & (TCL_READABLE | TCL_WRITABLE);
+  if (chan->_watchMask && chan->_timer == NULL)
+    chan->_timer = Tcl_CreateTimerHandler(0, mcTimerProc, cd_);
+  else if (!chan->_watchMask && chan->_timer != NULL) {
+    Tcl_DeleteTimerHandler(chan->_timer);
+    chan->_timer = NULL;
+  }
+}
+
+static int
+mcGetFile (ClientData cd_, int direction, ClientData* handlePtr)
+{
+  return TCL_ERROR;
+}
+
+static Tcl_ChannelType memChannelType = {
+  "memchan",      /* Type name.                                    */
+#ifdef TCL_CHANNEL_VERSION_5
+  TCL_CHANNEL_VERSION_5, /* Version, for wide seeks and truncation */
+#else
+  0,              /* Set blocking/nonblocking behaviour. NULL'able */
+#endif
+  mcClose,        /* Close channel, clean instance data            */
+  mcInput,        /* Handle read request                           */
+  mcOutput,       /* Handle write request                          */
+  mcSeek,         /* Move location of access point.    NULL'able   */
+  0,              /* Set options.                      NULL'able   */
+  mcGetOption,    /* Get options.                      NULL'able   */
+  mcWatchChannel, /* Initialize notifier                           */
+  mcGetFile       /* Get OS handle from the channel.               */
+#ifdef TCL_CHANNEL_VERSION_5
+  ,
+  0,              /* Close with direction.             NULL'able   */
+  0,              /* Set blocking mode.                NULL'able   */
+  0,              /* Flush.                            NULL'able   */
+  0,              /* Handle events.                    NULL'able   */
+  mcWideSeek,     /* Move to a 64-bit position.        NULL'able   */
+  0,              /* Thread action.                    NULL'able   */
+  mcTruncate      /* Truncate.                         NULL'able   */
+#endif
+};
+
+static int
+cmd_memchan(ClientData cd_, Tcl_Interp* ip_, int objc_, Tcl_Obj*const* objv_)
+{
+  MemoryChannel *mc;
+  char buffer [20];
+
+  if (objc_ > 2) {
+    Tcl_WrongNumArgs(ip_, 1, objv_, "?filename?");
+    return TCL_ERROR;
+  }
+
+  Tcl_MutexLock(&memchanMutex);
+  sprintf(buffer, "memchan%d", ++memChanSeq);
+  Tcl_MutexUnlock(&memchanMutex);
+
+  mc = (MemoryChannel*) Tcl_Alloc(sizeof *mc);
+  memset(mc, 0, sizeof *mc);
+  mc->_chan = Tcl_CreateChannel(&memChannelType, buffer, (ClientData) mc,
+  				TCL_READABLE | TCL_WRITABLE);
+
+  Tcl_RegisterChannel(ip_, mc->_chan);
+  Tcl_SetResult(ip_, buffer, TCL_VOLATILE);
+  return TCL_OK;
+}
+
+DLLEXPORT int Vfsmemchan_Init(Tcl_Interp* interp)
+{
+  if (!Tcl_InitStubs(interp, "8.4", 0))
+    return TCL_ERROR;
+  Tcl_CreateObjCommand(interp, "vfs::memchan", cmd_memchan, 0, 0);
+  return Tcl_PkgProvide(interp, "vfsmemchan", "1.0");
+}
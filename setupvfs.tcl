@@ -377,6 +377,45 @@ proc vfscopy {argv} {
   }
 }
 
+# Merge the package index scripts of lib/ and lib/tcl8.x/ and of all their
+# subdirectories into lib/pkgIndex.kit, so that boot.tcl can register the
+# packages of the kit without searching the vfs for pkgIndex.tcl files.
+# The directory listings are stored too, to detect packages added later.
+proc mkpkgindex {lib tcldir} {
+    set dirs {}
+    set index {}
+    foreach d [list {} $tcldir] {
+        set dir [file join $lib $d]
+        set names [glob -nocomplain -tails -directory $dir *]
+        if {$d eq {} && [lsearch -exact $names pkgIndex.kit] < 0} {
+            lappend names pkgIndex.kit
+        }
+        lappend dirs $d [lsort $names]
+
+        # same order as tclPkgUnknown: subdirectories first
+        set files [lsort [glob -nocomplain -directory $dir -join * pkgIndex.tcl]]
+        if {[file exists $dir/pkgIndex.tcl]} {
+            lappend files $dir/pkgIndex.tcl
+        }
+        foreach file $files {
+            set fin [open $file r]
+            fconfigure $fin -encoding utf-8
+            lappend index [string range [file dirname $file] \
+                             [expr {[string length $lib] + 1}] end] [read $fin]
+            close $fin
+            if {$::debugOpt} {
+                puts "  $file  ==>  \$vfs/lib/pkgIndex.kit"
+            }
+        }
+    }
+    set fout [open $lib/pkgIndex.kit w]
+    fconfigure $fout -translation lf -encoding utf-8
+    puts $fout "# package index scripts of this kit, see setupvfs.tcl and boot.tcl"
+    puts $fout [list variable kitPkgDirs $dirs]
+    puts $fout [list variable kitPkgIndex $index]
+    close $fout
+}
+
 # Create a pkgIndex file for a statick package 'pkg'. If the version
 # is not provided then it is detected when creating the vfs.
 proc staticpkg {pkg {ver {}} {init {}}} {
@@ -397,7 +436,7 @@ set vfs [lindex $argv 0]
 if {$lite} {
     vfs::m2m::Mount $vfs $vfs
 } else {
-    vfs::mk4::Mount $vfs $vfs
+    set db [vfs::mk4::Mount $vfs $vfs]
 }
 
 switch [info sharedlibext] {
@@ -492,6 +531,13 @@ if {$customOpt ne {}} {
     source $customOpt
 }
 
+mkpkgindex $vfs/lib [string map $versmap tcl8@]
+
+# store a hashed path index in the kit, used by mk4vfs to resolve paths
+if {!$lite} {
+    mk4vfs::index $db
+}
+
 vfs::unmount $vfs
 
 if {$debugOpt} {
@@ -43,6 +43,16 @@ if {![catch {package require Thread}]} {
     puts "thread: $r"
 }
 
+# startup time of further interps, which reuse the cached boot scripts
+set n 20
+set t [time {interp delete [interp create]} $n]
+set r [list child [lindex $t 0]]
+if {[info exists tid]} {
+    set t [time {thread::release [thread::create]} $n]
+    lappend r thread [lindex $t 0]
+}
+puts "startup: $r (microseconds)"
+
 # check pkgconfig in 8.5+
 if {[package vsatisfies [package provide Tcl] 8.5]} {
     tcl::pkgconfig list
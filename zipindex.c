@@ -0,0 +1,625 @@
+/* Written as part of Tclkit, placed in the public domain.
+ *
+ * Native table of contents for the zip archives mounted by zipvfs.tcl
+ *
+ *   vfs::zipindex chan
+ *
+ * reads the central directory of the zip archive open on chan in one go,
+ * including the ZIP64 extensions, and returns a command to look it up:
+ *
+ *   $cmd exists path        - 1 if path is a file or directory
+ *   $cmd stat path          - the entry for path, as a list for array set
+ *   $cmd getdir path ?pat?  - same results as zip::getdir
+ *   $cmd offset path        - where the data of path starts in chan
+ *
+ * Paths are looked up case-insensitively, with the same layout as the Tcl
+ * arrays built by zip::open.  Rename the command to {} to release it.
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef TCL_DECLARE_MUTEX
+#define TCL_DECLARE_MUTEX(v)
+#define Tcl_MutexLock(v)
+#define Tcl_MutexUnlock(v)
+#endif
+
+#ifndef CONST84
+#define CONST84
+#endif
+
+#define ZIP_EOCD_SIZE	  22
+#define ZIP_EOCD64_SIZE	  56
+#define ZIP_LOCATOR_SIZE  20
+#define ZIP_CENTRAL_SIZE  46
+#define ZIP_LOCAL_SIZE	  30
+#define ZIP_MAX_COMMENT	  65535
+
+  static int zipIndexSeq = 0;
+  TCL_DECLARE_MUTEX(zipIndexMutex)
+
+typedef struct
+{
+  Tcl_Obj* name;	/* as stored, without leading "./" */
+  Tcl_WideInt ino;	/* offset of the local header, -1 if implied */
+  Tcl_WideInt data;	/* offset of the data, 0 until known */
+  Tcl_WideInt csize;
+  Tcl_WideInt size;
+  Tcl_WideInt mtime;
+  unsigned long crc;
+  int method;
+  int flags;
+  int mode;
+  int isdir;
+  int depth;
+} ZipEntry;
+
+typedef struct
+{
+  Tcl_Channel _chan;
+  Tcl_HashTable _toc;	/* lowercase path -> ZipEntry* */
+  Tcl_HashTable _dirs;	/* lowercase directory -> list of names */
+} ZipIndex;
+
+static unsigned int
+zGet16 (const unsigned char* p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static unsigned long
+zGet32 (const unsigned char* p)
+{
+  return zGet16(p) | ((unsigned long) zGet16(p + 2) << 16);
+}
+
+static Tcl_WideInt
+zGet64 (const unsigned char* p)
+{
+  return (Tcl_WideInt) zGet32(p) | ((Tcl_WideInt) zGet32(p + 4) << 32);
+}
+
+/* same as zip::DosTime, seconds since the epoch taking the time as UTC */
+static Tcl_WideInt
+zDosTime (unsigned int date, unsigned int time)
+{
+  int sec  = (time & 0x1F) * 2;
+  int min  = (time >> 5) & 0x3F;
+  int hour = (time >> 11) & 0x1F;
+  int mday = date & 0x1F;
+  int mon  = (date >> 5) & 0xF;
+  int year = ((date >> 9) & 0xFF) + 1980;
+  long days;
+
+  /* fix up bad date/time data, no need to fail */
+  if (sec  > 59) sec  = 59;
+  if (min  > 59) min  = 59;
+  if (hour > 23) hour = 23;
+  if (mday < 1)  mday = 1;
+  if (mon  < 1)  mon  = 1;
+  if (mon  > 12) mon  = 12;
+
+  /* days since 1970-01-01 in the proleptic Gregorian calendar */
+  if (mon <= 2) {
+    --year;
+    mon += 12;
+  }
+  days = 365L * year + year / 4 - year / 100 + year / 400
+       + (153 * (mon - 3) + 2) / 5 + mday - 1 - 719468L;
+
+  return ((days * 24 + hour) * 60 + min) * 60 + (Tcl_WideInt) sec;
+}
+
+static ZipEntry*
+zNewEntry (Tcl_HashTable* toc, const char* key)
+{
+  int isNew;
+  Tcl_HashEntry* h = Tcl_CreateHashEntry(toc, key, &isNew);
+  ZipEntry* ze = (ZipEntry*) Tcl_GetHashValue(h);
+
+  if (!isNew)
+    Tcl_DecrRefCount(ze->name);
+  else {
+    ze = (ZipEntry*) Tcl_Alloc(sizeof *ze);
+    Tcl_SetHashValue(h, ze);
+  }
+  memset(ze, 0, sizeof *ze);
+  return ze;
+}
+
+/* append a name to the list of a directory, duplicates are removed later */
+static void
+zAddToDir (Tcl_HashTable* dirs, const char* dir, int dlen,
+	   const char* tail, int tlen)
+{
+  Tcl_DString key;
+  Tcl_HashEntry* h;
+  Tcl_Obj* list;
+  int isNew;
+
+  Tcl_DStringInit(&key);
+  Tcl_DStringAppend(&key, dir, dlen);
+  Tcl_UtfToLower(Tcl_DStringValue(&key));
+  h = Tcl_CreateHashEntry(dirs, Tcl_DStringValue(&key), &isNew);
+  Tcl_DStringFree(&key);
+
+  if (isNew) {
+    list = Tcl_NewObj();
+    Tcl_IncrRefCount(list);
+    Tcl_SetHashValue(h, list);
+  } else
+    list = (Tcl_Obj*) Tcl_GetHashValue(h);
+  Tcl_ListObjAppendElement(NULL, list, Tcl_NewStringObj(tail, tlen));
+}
+
+/* the equivalent of zip::FAKEDIR, for all the parents of a lowercase key */
+static void
+zAddParents (ZipIndex* zi, const char* key)
+{
+  const char* end = strrchr(key, '/');
+  int depth;
+
+  while (end != NULL) {
+    Tcl_DString path;
+    const char* p;
+
+    Tcl_DStringInit(&path);
+    Tcl_DStringAppend(&path, key, end - key);
+
+    if (Tcl_FindHashEntry(&zi->_toc, Tcl_DStringValue(&path)) == NULL) {
+      ZipEntry* ze = zNewEntry(&zi->_toc, Tcl_DStringValue(&path));
+      ze->name = Tcl_NewStringObj(Tcl_DStringValue(&path), -1);
+      Tcl_IncrRefCount(ze->name);
+      ze->ino = -1;
+      ze->mode = 0777;
+      ze->isdir = 1;
+      for (depth = 1, p = key; p < end; ++p)
+	depth += *p == '/';
+      ze->depth = depth;
+
+      p = end;
+      while (p > key && p[-1] != '/')
+	--p;
+      zAddToDir(&zi->_dirs, key, p > key ? p - key - 1 : 0, p, end - p);
+    }
+
+    Tcl_DStringFree(&path);
+
+    while (end > key && *--end != '/')
+      ;
+    if (end == key)
+      end = NULL;
+  }
+}
+
+static int
+zCompareObjs (const void* a, const void* b)
+{
+  return strcmp(Tcl_GetString(*(Tcl_Obj* const*) a),
+		Tcl_GetString(*(Tcl_Obj* const*) b));
+}
+
+/* sort the directory lists and drop duplicate names, as lsort -unique */
+static void
+zSortDirs (ZipIndex* zi)
+{
+  Tcl_HashSearch search;
+  Tcl_HashEntry* h;
+
+  for (h = Tcl_FirstHashEntry(&zi->_dirs, &search); h != NULL;
+       h = Tcl_NextHashEntry(&search)) {
+    Tcl_Obj* list = (Tcl_Obj*) Tcl_GetHashValue(h);
+    Tcl_Obj **items, **elems;
+    Tcl_Obj* sorted;
+    int i, n;
+
+    Tcl_ListObjGetElements(NULL, list, &n, &items);
+    elems = (Tcl_Obj**) Tcl_Alloc((n + 1) * sizeof (Tcl_Obj*));
+    memcpy(elems, items, n * sizeof (Tcl_Obj*));
+    qsort(elems, n, sizeof (Tcl_Obj*), zCompareObjs);
+
+    sorted = Tcl_NewObj();
+    for (i = 0; i < n; ++i)
+      if (i == 0 || zCompareObjs(elems + i - 1, elems + i) != 0)
+	Tcl_ListObjAppendElement(NULL, sorted, elems[i]);
+    Tcl_Free((char*) elems);
+
+    Tcl_IncrRefCount(sorted);
+    Tcl_DecrRefCount(list);
+    Tcl_SetHashValue(h, sorted);
+  }
+}
+
+/* add one central directory entry of len bytes, returns 0 if malformed */
+static int
+zAddEntry (ZipIndex* zi, const unsigned char* p, int len, Tcl_WideInt base,
+	   Tcl_Encoding utf8, Tcl_Encoding latin1)
+{
+  unsigned int flen = zGet16(p + 28), elen = zGet16(p + 30);
+  unsigned long atx = zGet32(p + 38);
+  unsigned long csize = zGet32(p + 20), size = zGet32(p + 24);
+  unsigned long offset = zGet32(p + 42);
+  const unsigned char* x;
+  const char *name, *key, *end, *tail;
+  Tcl_DString dsName, dsKey;
+  ZipEntry* ze;
+  int n, flags = zGet16(p + 8);
+
+  if (ZIP_CENTRAL_SIZE + flen + elen > (unsigned) len)
+    return 0;
+
+  Tcl_ExternalToUtfDString(flags & (1 << 11) ? utf8 : latin1,
+			   (const char*) p + ZIP_CENTRAL_SIZE, flen, &dsName);
+
+  /* same as: string trimleft $name "./" */
+  name = Tcl_DStringValue(&dsName);
+  while (*name == '.' || *name == '/')
+    ++name;
+
+  Tcl_DStringInit(&dsKey);
+  Tcl_DStringAppend(&dsKey, name, -1);
+  Tcl_UtfToLower(Tcl_DStringValue(&dsKey));
+  key = Tcl_DStringValue(&dsKey);
+  n = strlen(key);
+  while (n > 0 && key[n-1] == '/')
+    --n;
+  Tcl_DStringSetLength(&dsKey, n);
+
+  ze = zNewEntry(&zi->_toc, key);
+  ze->name = Tcl_NewStringObj(name, -1);
+  Tcl_IncrRefCount(ze->name);
+  ze->flags = flags;
+  ze->method = zGet16(p + 10);
+  ze->mtime = zDosTime(zGet16(p + 14), zGet16(p + 12));
+  ze->crc = zGet32(p + 16);
+  ze->mode = (atx >> 16) & 0xffff;
+  ze->isdir = (atx & 16) != 0 || (ze->mode & 0x4000) != 0;
+  ze->csize = csize;
+  ze->size = size;
+  ze->ino = offset;
+
+  /* ZIP64 extra field, holds the values which did not fit in 32 bits */
+  for (x = p + ZIP_CENTRAL_SIZE + flen;
+       x + 4 <= p + ZIP_CENTRAL_SIZE + flen + elen;
+       x += 4 + zGet16(x + 2)) {
+    const unsigned char* v = x + 4;
+    const unsigned char* e = v + zGet16(x + 2);
+    if (zGet16(x) != 1 || e > p + ZIP_CENTRAL_SIZE + flen + elen)
+      continue;
+    if (size == 0xffffffffUL && v + 8 <= e) {
+      ze->size = zGet64(v);
+      v += 8;
+    }
+    if (csize == 0xffffffffUL && v + 8 <= e) {
+      ze->csize = zGet64(v);
+      v += 8;
+    }
+    if (offset == 0xffffffffUL && v + 8 <= e)
+      ze->ino = zGet64(v);
+  }
+  ze->ino += base;
+
+  /* the parent is taken from the name without trailing slashes */
+  n = strlen(name);
+  while (n > 0 && name[n-1] == '/')
+    --n;
+  for (end = name + n, tail = end; tail > name && tail[-1] != '/'; )
+    --tail;
+  ze->depth = 0;
+  for (x = (const unsigned char*) name; x < (const unsigned char*) end; ) {
+    while (*x == '/')
+      ++x;
+    if (x < (const unsigned char*) end)
+      ++ze->depth;
+    while (x < (const unsigned char*) end && *x != '/')
+      ++x;
+  }
+  zAddToDir(&zi->_dirs, name, tail > name ? tail - name - 1 : 0,
+	    tail, end - tail);
+
+  zAddParents(zi, key);
+
+  Tcl_DStringFree(&dsKey);
+  Tcl_DStringFree(&dsName);
+  return 1;
+}
+
+/* locate and load the central directory, returns an error message or NULL */
+static const char*
+zLoad (ZipIndex* zi, Tcl_Interp* interp)
+{
+  Tcl_WideInt fsize, tail, eocd, dirOff, dirLen, base, count, i;
+  Tcl_Encoding utf8, latin1;
+  unsigned char *buf, *p;
+  int n, ok;
+
+  fsize = Tcl_Seek(zi->_chan, 0, SEEK_END);
+  if (fsize < ZIP_EOCD_SIZE)
+    return "no header found";
+
+  /* the end of central directory record can only be followed by a comment */
+  tail = fsize < ZIP_EOCD_SIZE + ZIP_MAX_COMMENT + ZIP_LOCATOR_SIZE
+       ? fsize : ZIP_EOCD_SIZE + ZIP_MAX_COMMENT + ZIP_LOCATOR_SIZE;
+  buf = (unsigned char*) Tcl_Alloc((int) tail);
+  if (Tcl_Seek(zi->_chan, fsize - tail, SEEK_SET) < 0 ||
+      Tcl_Read(zi->_chan, (char*) buf, (int) tail) != tail) {
+    Tcl_Free((char*) buf);
+    return "cannot read archive";
+  }
+
+  for (p = buf + tail - ZIP_EOCD_SIZE; p >= buf; --p)
+    if (p[0] == 'P' && p[1] == 'K' && p[2] == 5 && p[3] == 6)
+      break;
+  if (p < buf) {
+    Tcl_Free((char*) buf);
+    return "no header found";
+  }
+
+  eocd = fsize - tail + (p - buf);
+  count = zGet16(p + 10);
+  dirLen = zGet32(p + 12);
+  dirOff = zGet32(p + 16);
+
+  /* a ZIP64 locator in front of it points to the 64-bit record */
+  if (p - buf >= ZIP_LOCATOR_SIZE &&
+      zGet32(p - ZIP_LOCATOR_SIZE) == 0x07064b50UL) {
+    unsigned char rec [ZIP_EOCD64_SIZE];
+    Tcl_WideInt at = eocd - ZIP_LOCATOR_SIZE - ZIP_EOCD64_SIZE;
+    if (at >= 0 && Tcl_Seek(zi->_chan, at, SEEK_SET) >= 0 &&
+	Tcl_Read(zi->_chan, (char*) rec, sizeof rec) == sizeof rec &&
+	zGet32(rec) == 0x06064b50UL) {
+      count = zGet64(rec + 24);
+      dirLen = zGet64(rec + 40);
+      dirOff = zGet64(rec + 48);
+      eocd = at;
+    }
+  }
+  Tcl_Free((char*) buf);
+
+  /* allow for data in front of the archive, e.g. an executable */
+  base = eocd - dirLen - dirOff;
+  if (base < 0)
+    base = 0;
+  if (dirLen > eocd || dirLen >= 0x7fffffff)
+    return "bad central directory";
+
+  buf = (unsigned char*) Tcl_Alloc((int) dirLen + 1);
+  if (Tcl_Seek(zi->_chan, base + dirOff, SEEK_SET) < 0 ||
+      Tcl_Read(zi->_chan, (char*) buf, (int) dirLen) != dirLen) {
+    Tcl_Free((char*) buf);
+    return "cannot read central directory";
+  }
+
+  utf8 = Tcl_GetEncoding(interp, "utf-8");
+  latin1 = Tcl_GetEncoding(interp, "iso8859-1");
+
+  ok = utf8 != NULL && latin1 != NULL;
+  for (i = 0, p = buf; ok && i < count; ++i) {
+    n = (int) (buf + dirLen - p);
+    ok = n >= ZIP_CENTRAL_SIZE && zGet32(p) == 0x02014b50UL &&
+	 zAddEntry(zi, p, n, base, utf8, latin1);
+    if (ok)
+      p += ZIP_CENTRAL_SIZE + zGet16(p + 28) + zGet16(p + 30) + zGet16(p + 32);
+  }
+
+  if (utf8 != NULL)
+    Tcl_FreeEncoding(utf8);
+  if (latin1 != NULL)
+    Tcl_FreeEncoding(latin1);
+  Tcl_Free((char*) buf);
+
+  if (!ok)
+    return "bad central header";
+
+  zSortDirs(zi);
+  return NULL;
+}
+
+static void
+zFreeIndex (ClientData cd_)
+{
+  ZipIndex* zi = (ZipIndex*) cd_;
+  Tcl_HashSearch search;
+  Tcl_HashEntry* h;
+
+  for (h = Tcl_FirstHashEntry(&zi->_toc, &search); h != NULL;
+       h = Tcl_NextHashEntry(&search)) {
+    ZipEntry* ze = (ZipEntry*) Tcl_GetHashValue(h);
+    Tcl_DecrRefCount(ze->name);
+    Tcl_Free((char*) ze);
+  }
+  Tcl_DeleteHashTable(&zi->_toc);
+
+  for (h = Tcl_FirstHashEntry(&zi->_dirs, &search); h != NULL;
+       h = Tcl_NextHashEntry(&search))
+    Tcl_DecrRefCount((Tcl_Obj*) Tcl_GetHashValue(h));
+  Tcl_DeleteHashTable(&zi->_dirs);
+
+  Tcl_UnregisterChannel(NULL, zi->_chan);
+  Tcl_Free((char*) zi);
+}
+
+/* lowercase the path into ds, "." is the same as the root */
+static const char*
+zKey (Tcl_Obj* path, Tcl_DString* ds)
+{
+  Tcl_DStringInit(ds);
+  Tcl_DStringAppend(ds, Tcl_GetString(path), -1);
+  if (strcmp(Tcl_DStringValue(ds), ".") == 0)
+    Tcl_DStringSetLength(ds, 0);
+  Tcl_UtfToLower(Tcl_DStringValue(ds));
+  return Tcl_DStringValue(ds);
+}
+
+static void
+zPutWide (Tcl_Obj* list, const char* name, Tcl_WideInt value)
+{
+  Tcl_ListObjAppendElement(NULL, list, Tcl_NewStringObj(name, -1));
+  Tcl_ListObjAppendElement(NULL, list, Tcl_NewWideIntObj(value));
+}
+
+static int
+zIndexCmd (ClientData cd_, Tcl_Interp* ip_, int objc_, Tcl_Obj* const* objv_)
+{
+  static CONST84 char* cmds[] = { "exists", "stat", "getdir", "offset", NULL };
+  ZipIndex* zi = (ZipIndex*) cd_;
+  Tcl_HashEntry* h;
+  Tcl_DString ds;
+  ZipEntry* ze;
+  const char* key;
+  int id, result = TCL_OK;
+
+  if (objc_ < 3) {
+    Tcl_WrongNumArgs(ip_, 1, objv_, "cmd path ?arg?");
+    return TCL_ERROR;
+  }
+  if (Tcl_GetIndexFromObj(ip_, objv_[1], cmds, "command", 0, &id) != TCL_OK)
+    return TCL_ERROR;
+  if (objc_ > (id == 2 ? 4 : 3)) {
+    Tcl_WrongNumArgs(ip_, 2, objv_, id == 2 ? "path ?pattern?" : "path");
+    return TCL_ERROR;
+  }
+
+  key = zKey(objv_[2], &ds);
+  h = Tcl_FindHashEntry(id == 2 ? &zi->_dirs : &zi->_toc, key);
+  ze = h != NULL && id != 2 ? (ZipEntry*) Tcl_GetHashValue(h) : NULL;
+
+  switch (id) {
+    case 0:	/* exists */
+      Tcl_SetObjResult(ip_, Tcl_NewBooleanObj(h != NULL || *key == 0));
+      break;
+
+    case 1: {	/* stat */
+      Tcl_Obj* r;
+      if (ze == NULL) {
+	result = TCL_ERROR;
+	break;
+      }
+      r = Tcl_NewObj();
+      Tcl_ListObjAppendElement(NULL, r, Tcl_NewStringObj("name", -1));
+      Tcl_ListObjAppendElement(NULL, r, ze->name);
+      Tcl_ListObjAppendElement(NULL, r, Tcl_NewStringObj("type", -1));
+      Tcl_ListObjAppendElement(NULL, r,
+	Tcl_NewStringObj(ze->isdir ? "directory" : "file", -1));
+      zPutWide(r, "mtime", ze->mtime);
+      zPutWide(r, "size", ze->size);
+      zPutWide(r, "mode", ze->mode);
+      zPutWide(r, "ino", ze->ino);
+      zPutWide(r, "depth", ze->depth);
+      if (ze->ino >= 0) {
+	zPutWide(r, "csize", ze->csize);
+	zPutWide(r, "crc", ze->crc);
+	zPutWide(r, "method", ze->method);
+	zPutWide(r, "flags", ze->flags);
+      }
+      Tcl_SetObjResult(ip_, r);
+      break;
+    }
+
+    case 2: {	/* getdir, an empty pattern only checks for the directory */
+      Tcl_Obj *list, *r, **elems;
+      const char* pat = objc_ > 3 ? Tcl_GetString(objv_[3]) : "*";
+      int i, n;
+
+      if (h == NULL)
+	break;
+      list = (Tcl_Obj*) Tcl_GetHashValue(h);
+      if (*pat == 0) {
+	Tcl_Obj* dir = Tcl_NewStringObj(key, -1);
+	Tcl_SetObjResult(ip_, Tcl_NewListObj(1, &dir));
+	break;
+      }
+      if (strcmp(pat, "*") == 0) {
+	Tcl_SetObjResult(ip_, list);
+	break;
+      }
+      r = Tcl_NewObj();
+      Tcl_ListObjGetElements(NULL, list, &n, &elems);
+      for (i = 0; i < n; ++i)
+	if (Tcl_StringCaseMatch(Tcl_GetString(elems[i]), pat, 1))
+	  Tcl_ListObjAppendElement(NULL, r, elems[i]);
+      Tcl_SetObjResult(ip_, r);
+      break;
+    }
+
+    case 3:	/* offset */
+      if (ze == NULL) {
+	result = TCL_ERROR;
+	break;
+      }
+      if (ze->data == 0 && ze->ino >= 0) {
+	unsigned char hdr [ZIP_LOCAL_SIZE];
+	if (Tcl_Seek(zi->_chan, ze->ino, SEEK_SET) < 0 ||
+	    Tcl_Read(zi->_chan, (char*) hdr, sizeof hdr) != sizeof hdr ||
+	    zGet32(hdr) != 0x04034b50UL) {
+	  Tcl_AppendResult(ip_, "bad header for \"",
+			   Tcl_GetString(objv_[2]), "\"", NULL);
+	  Tcl_DStringFree(&ds);
+	  return TCL_ERROR;
+	}
+	ze->data = ze->ino + ZIP_LOCAL_SIZE + zGet16(hdr + 26)
+						+ zGet16(hdr + 28);
+      }
+      Tcl_SetObjResult(ip_, Tcl_NewWideIntObj(ze->data));
+      break;
+  }
+
+  if (result != TCL_OK)
+    Tcl_AppendResult(ip_, "could not read \"", Tcl_GetString(objv_[2]),
+		     "\": no such file or directory", NULL);
+  Tcl_DStringFree(&ds);
+  return result;
+}
+
+static int
+cmd_zipindex(ClientData cd_, Tcl_Interp* ip_, int objc_, Tcl_Obj* const* objv_)
+{
+  ZipIndex* zi;
+  Tcl_Channel chan;
+  const char* msg;
+  char buffer [20];
+
+  if (objc_ != 2) {
+    Tcl_WrongNumArgs(ip_, 1, objv_, "channel");
+    return TCL_ERROR;
+  }
+  chan = Tcl_GetChannel(ip_, Tcl_GetString(objv_[1]), NULL);
+  if (chan == NULL)
+    return TCL_ERROR;
+  if (Tcl_SetChannelOption(ip_, chan, "-translation", "binary") != TCL_OK)
+    return TCL_ERROR;
+
+  zi = (ZipIndex*) Tcl_Alloc(sizeof *zi);
+  zi->_chan = chan;
+  Tcl_InitHashTable(&zi->_toc, TCL_STRING_KEYS);
+  Tcl_InitHashTable(&zi->_dirs, TCL_STRING_KEYS);
+
+  /* keep the channel, the index reads local headers from it */
+  Tcl_RegisterChannel(NULL, chan);
+
+  msg = zLoad(zi, ip_);
+  if (msg != NULL) {
+    zFreeIndex(zi);
+    Tcl_SetResult(ip_, (char*) msg, TCL_STATIC);
+    return TCL_ERROR;
+  }
+
+  Tcl_MutexLock(&zipIndexMutex);
+  sprintf(buffer, "zipindex%d", ++zipIndexSeq);
+  Tcl_MutexUnlock(&zipIndexMutex);
+
+  Tcl_CreateObjCommand(ip_, buffer, zIndexCmd, (ClientData) zi, zFreeIndex);
+  Tcl_SetResult(ip_, buffer, TCL_VOLATILE);
+  return TCL_OK;
+}
+
+DLLEXPORT int Zipindex_Init(Tcl_Interp* interp)
+{
+  if (!Tcl_InitStubs(interp, "8.4", 0))
+    return TCL_ERROR;
+  Tcl_CreateObjCommand(interp, "vfs::zipindex", cmd_zipindex, 0, 0);
+  return Tcl_PkgProvide(interp, "zipindex", "1.0");
+}
@@ -6,6 +6,16 @@
 
 #include "zlib.h"
 #include <tcl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef TCL_DECLARE_MUTEX
+#define TCL_DECLARE_MUTEX(v)
+#define Tcl_MutexLock(v)
+#define Tcl_MutexUnlock(v)
+#endif
 
 typedef struct {
   z_stream stream;
@@ -72,10 +82,402 @@ void zstreamdelproc(ClientData cd)
   Tcl_Free((void*) zp);
 }
 
+static int
+zstreamoutcmd(ClientData cd, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
+{
+  zlibstream *zp = (zlibstream*) cd;
+  int count = 0;
+  int e, index;
+  Tcl_Obj *obj;
+
+  static CONST84 char* cmds[] = { "fill", "drain", "flush", "finish", NULL, };
+  static int flushes[] = { 0, Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH, };
+
+  if (objc < 2 || objc > 3) {
+    Tcl_WrongNumArgs(ip, 2, objv, "fill|drain|flush|finish data");
+    return TCL_ERROR;
+  }
+  if (Tcl_GetIndexFromObj(ip, objv[1], cmds, "option", 0, &index) != TCL_OK)
+    return TCL_ERROR;
+
+  if (index == 0) { /* fill ?data? */
+    if (objc >= 3) {
+      Tcl_IncrRefCount(objv[2]);
+      Tcl_DecrRefCount(zp->indata);
+      zp->indata = objv[2];
+      zp->stream.next_in = Tcl_GetByteArrayFromObj(zp->indata,
+						(int*) &zp->stream.avail_in);
+    }
+    Tcl_SetObjResult(ip, Tcl_NewIntObj(zp->stream.avail_in));
+    return TCL_OK;
+  }
+
+  /* drain|flush|finish count, repeat until less than count is returned */
+  if (objc != 3) {
+    Tcl_WrongNumArgs(ip, 2, objv, "count");
+    return TCL_ERROR;
+  }
+  if (Tcl_GetIntFromObj(ip, objv[2], &count) != TCL_OK)
+    return TCL_ERROR;
+  obj = Tcl_GetObjResult(ip);
+  Tcl_SetByteArrayLength(obj, count);
+  zp->stream.next_out = Tcl_GetByteArrayFromObj(obj,
+					      (int*) &zp->stream.avail_out);
+  e = deflate(&zp->stream, flushes[index]);
+  /* no progress is not an error, it just means there is no more output */
+  if (e != Z_OK && e != Z_STREAM_END && e != Z_BUF_ERROR) {
+    Tcl_SetResult(ip, (char*) zError(e), TCL_STATIC);
+    return TCL_ERROR;
+  }
+  Tcl_SetByteArrayLength(obj, count - zp->stream.avail_out);
+  return TCL_OK;
+}
+
+void zstreamoutdelproc(ClientData cd)
+{
+  zlibstream *zp = (zlibstream*) cd;
+  deflateEnd(&zp->stream);
+  Tcl_DecrRefCount(zp->indata);
+  Tcl_Free((void*) zp);
+}
+
+/* sdeflate|scompress cmdname ?-level n? ?-strategy s? ?-memlevel n?
+ * scompress also takes ?-gzip bool? to write gzip instead of zlib framing,
+ * raw deflate data has no framing, so sdeflate rejects it */
+static int
+zstreamoutcreate(Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[], int wbits)
+{
+  int i, e, gzip = 0, level = Z_DEFAULT_COMPRESSION, memlevel = MAX_MEM_LEVEL;
+  int strategy = Z_DEFAULT_STRATEGY;
+  zlibstream *zp;
+
+  static CONST84 char* opts[] = {
+    "-level", "-strategy", "-memlevel", "-gzip", NULL,
+  };
+  static CONST84 char* rawOpts[] = {
+    "-level", "-strategy", "-memlevel", NULL,
+  };
+  static CONST84 char* strategies[] = {
+    "default", "filtered", "huffman", "rle", "fixed", NULL,
+  };
+  static int strategyValues[] = {
+    Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED,
+  };
+
+  if (objc < 3 || objc % 2 == 0) {
+    Tcl_WrongNumArgs(ip, 2, objv, "cmdname ?-option value ...?");
+    return TCL_ERROR;
+  }
+
+  for (i = 3; i < objc; i += 2) {
+    int opt;
+    if (Tcl_GetIndexFromObj(ip, objv[i], wbits > 0 ? opts : rawOpts,
+			    "option", 0, &opt) != TCL_OK)
+      return TCL_ERROR;
+    switch (opt) {
+      case 0:
+	e = Tcl_GetIntFromObj(ip, objv[i+1], &level);
+	break;
+      case 1:
+	e = Tcl_GetIndexFromObj(ip, objv[i+1], strategies, "strategy", 0,
+				&strategy);
+	if (e == TCL_OK)
+	  strategy = strategyValues[strategy];
+	break;
+      case 2:
+	e = Tcl_GetIntFromObj(ip, objv[i+1], &memlevel);
+	break;
+      default:
+	e = Tcl_GetBooleanFromObj(ip, objv[i+1], &gzip);
+	break;
+    }
+    if (e != TCL_OK)
+      return TCL_ERROR;
+  }
+
+  /* adding 16 to the window bits writes a gzip header and trailer */
+  if (gzip)
+    wbits += 16;
+
+  zp = (zlibstream*) Tcl_Alloc(sizeof (zlibstream));
+  memset(zp, 0, sizeof (zlibstream));
+  e = deflateInit2(&zp->stream, level, Z_DEFLATED, wbits, memlevel, strategy);
+  if (e != Z_OK) {
+    Tcl_Free((void*) zp);
+    Tcl_SetResult(ip, (char*) zError(e), TCL_STATIC);
+    return TCL_ERROR;
+  }
+  zp->indata = Tcl_NewObj();
+  Tcl_IncrRefCount(zp->indata);
+  Tcl_CreateObjCommand(ip, Tcl_GetStringFromObj(objv[2], 0), zstreamoutcmd,
+			(ClientData) zp, zstreamoutdelproc);
+  return TCL_OK;
+}
+
+/*
+ * Parallel compression, as done by pigz: the data is split into blocks of
+ * ZBLOCK_SIZE bytes, which worker threads deflate on their own, each primed
+ * with the 32K of data before it.  All but the last end with a sync flush,
+ * so the pieces concatenate into one deflate stream.  A zlib or gzip
+ * wrapper is added around it when wbits > 0, with the adler32 or crc32
+ * checksums of the blocks combined into one.
+ *
+ * In threaded builds, the worker threads are started when first needed and
+ * then kept for later calls, from any interpreter.  They take jobs from a queue, as does the
+ * calling thread, which also runs whatever no thread could be started for.
+ */
+
+#define ZBLOCK_SIZE 131072
+#define ZBLOCK_MAXTHREADS 64
+
+typedef struct {
+  Byte *out;
+  uInt olen;
+  uLong check;		/* adler32 or crc32 of the input */
+} zblock;
+
+typedef struct zworker {
+  Byte *data;
+  int dlen;
+  int bsize;		/* size of all blocks but the last */
+  int level;
+  int gzip;		/* crc32 instead of adler32 checksums */
+  int first;		/* this worker does blocks first, first+step, ... */
+  int step;
+  int nblocks;
+  zblock *blocks;
+  int error;
+  int done;
+  struct zworker *next;	/* in the job queue */
+} zworker;
+
+TCL_DECLARE_MUTEX(zPoolMutex)
+#ifdef TCL_THREADS
+static Tcl_Condition zPoolWork;	/* jobs were queued, or the pool stops */
+static Tcl_Condition zPoolDone;	/* a job is done, or a thread has exited */
+static int zPoolThreads = 0;
+static int zPoolStop = 0;
+#endif
+static zworker *zPoolJobs = NULL;
+
+static void
+zCompressBlocks(zworker *w)
+{
+  z_stream stream;
+  int i;
+
+  memset(&stream, 0, sizeof stream);
+  w->error = deflateInit2(&stream, w->level, Z_DEFLATED, -MAX_WBITS,
+			  MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+
+  for (i = w->first; i < w->nblocks && w->error == Z_OK; i += w->step) {
+    Byte *in = w->data + (long) i * w->bsize;
+    int last = i == w->nblocks - 1;
+    uInt len = last ? w->dlen - i * w->bsize : w->bsize;
+    uLong bound;
+    int e;
+
+    deflateReset(&stream);
+    if (i > 0)
+      deflateSetDictionary(&stream, in - 32768, 32768);
+
+    /* room for a sync flush marker after the data */
+    bound = deflateBound(&stream, len) + 16;
+    w->blocks[i].out = (Byte*) Tcl_AttemptAlloc(bound);
+    if (w->blocks[i].out == NULL) {
+      w->error = Z_MEM_ERROR;
+      break;
+    }
+
+    stream.next_in = in;
+    stream.avail_in = len;
+    stream.next_out = w->blocks[i].out;
+    stream.avail_out = bound;
+    e = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (last ? e != Z_STREAM_END : (e != Z_OK || stream.avail_out == 0))
+      w->error = Z_BUF_ERROR;
+
+    w->blocks[i].olen = bound - stream.avail_out;
+    w->blocks[i].check = w->gzip ? crc32(crc32(0, 0, 0), in, len)
+				 : adler32(adler32(0, 0, 0), in, len);
+  }
+
+  deflateEnd(&stream);
+}
+
+/* run queued jobs until there are none left, called with zPoolMutex held */
+static void
+zRunJobs(void)
+{
+  zworker *w;
+
+  while ((w = zPoolJobs) != NULL) {
+    zPoolJobs = w->next;
+    Tcl_MutexUnlock(&zPoolMutex);
+    zCompressBlocks(w);
+    Tcl_MutexLock(&zPoolMutex);
+    w->done = 1;
+#ifdef TCL_THREADS
+    Tcl_ConditionNotify(&zPoolDone);
+#endif
+  }
+}
+
+#ifdef TCL_THREADS
+static Tcl_ThreadCreateType
+zWorkerThread(ClientData cd)
+{
+  Tcl_MutexLock(&zPoolMutex);
+  while (!zPoolStop) {
+    zRunJobs();
+    if (!zPoolStop)
+      Tcl_ConditionWait(&zPoolWork, &zPoolMutex, NULL);
+  }
+  --zPoolThreads;
+  Tcl_ConditionNotify(&zPoolDone);
+  Tcl_MutexUnlock(&zPoolMutex);
+  TCL_THREAD_CREATE_RETURN;
+}
+
+/* let the worker threads finish before Tcl cleans up the mutex they use */
+static void
+zPoolExit(ClientData cd)
+{
+  Tcl_MutexLock(&zPoolMutex);
+  zPoolStop = 1;
+  Tcl_ConditionNotify(&zPoolWork);
+  while (zPoolThreads > 0)
+    Tcl_ConditionWait(&zPoolDone, &zPoolMutex, NULL);
+  Tcl_MutexUnlock(&zPoolMutex);
+}
+#endif
+
+/* compress data into obj using up to threads threads, returns a zlib code */
+static int
+zParallelDeflate(Tcl_Obj *obj, Byte *data, int dlen, int level, int wbits,
+		 int threads)
+{
+  /* a single block, without any sync flush, if there is only one thread */
+  int bsize = threads > 1 || dlen == 0 ? ZBLOCK_SIZE : dlen;
+  int i, e = Z_OK, nblocks = dlen == 0 ? 1 : (dlen + bsize - 1) / bsize;
+  int gzip = wbits > MAX_WBITS;
+  long total = gzip ? 18 : wbits > 0 ? 6 : 0;
+  uLong check = gzip ? crc32(0, 0, 0) : adler32(0, 0, 0);
+  zblock *blocks;
+  zworker *workers;
+  Byte *p;
+
+  if (threads > nblocks)
+    threads = nblocks;
+  if (threads > ZBLOCK_MAXTHREADS)
+    threads = ZBLOCK_MAXTHREADS;
+
+  blocks = (zblock*) Tcl_Alloc(nblocks * sizeof (zblock));
+  memset(blocks, 0, nblocks * sizeof (zblock));
+  workers = (zworker*) Tcl_Alloc(threads * sizeof (zworker));
+
+  Tcl_MutexLock(&zPoolMutex);
+  for (i = 0; i < threads; ++i) {
+    workers[i].data = data;
+    workers[i].dlen = dlen;
+    workers[i].bsize = bsize;
+    workers[i].level = level;
+    workers[i].gzip = gzip;
+    workers[i].first = i;
+    workers[i].step = threads;
+    workers[i].nblocks = nblocks;
+    workers[i].blocks = blocks;
+    workers[i].error = Z_OK;
+    workers[i].done = 0;
+    workers[i].next = zPoolJobs;
+    zPoolJobs = workers + i;
+  }
+
+#ifdef TCL_THREADS
+  /* start more threads if needed, this thread is one of the workers */
+  while (zPoolThreads < threads - 1 && !zPoolStop) {
+    Tcl_ThreadId id;
+    if (Tcl_CreateThread(&id, zWorkerThread, NULL, TCL_THREAD_STACK_DEFAULT,
+			 TCL_THREAD_NOFLAGS) != TCL_OK)
+      break;
+    if (zPoolThreads++ == 0)
+      Tcl_CreateExitHandler(zPoolExit, NULL);
+  }
+  Tcl_ConditionNotify(&zPoolWork);
+#endif
+
+  /* help out, then wait for the jobs which were taken by the pool */
+  zRunJobs();
+  for (i = 0; i < threads; ++i) {
+#ifdef TCL_THREADS
+    while (!workers[i].done)
+      Tcl_ConditionWait(&zPoolDone, &zPoolMutex, NULL);
+#endif
+    if (workers[i].error != Z_OK)
+      e = workers[i].error;
+  }
+  Tcl_MutexUnlock(&zPoolMutex);
+
+  if (e == Z_OK) {
+    for (i = 0; i < nblocks; ++i)
+      total += blocks[i].olen;
+    Tcl_SetByteArrayLength(obj, total);
+    p = Tcl_GetByteArrayFromObj(obj, NULL);
+
+    /* gzip header without name or time, flags set as deflate does */
+    if (gzip) {
+      static const Byte header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+      memcpy(p, header, sizeof header);
+      p[8] = level == 9 ? 2 : level == 0 || level == 1 ? 4 : 0;
+      p += sizeof header;
+    }
+
+    /* zlib header, with the compression level flags set as deflate does */
+    if (wbits > 0 && !gzip) {
+      int flags = level < 0 || level == 6 ? 2 : level < 2 ? 0 : level < 6 ? 1 : 3;
+      int header = (0x78 << 8) | (flags << 6);
+      header += 31 - header % 31;
+      *p++ = (Byte) (header >> 8);
+      *p++ = (Byte) header;
+    }
+
+    for (i = 0; i < nblocks; ++i) {
+      uInt len = i == nblocks - 1 ? dlen - i * bsize : bsize;
+      memcpy(p, blocks[i].out, blocks[i].olen);
+      p += blocks[i].olen;
+      check = gzip ? crc32_combine(check, blocks[i].check, len)
+		   : adler32_combine(check, blocks[i].check, len);
+    }
+
+    /* the checksum and size are little endian in gzip, big endian in zlib */
+    if (gzip) {
+      for (i = 0; i < 4; ++i)
+	*p++ = (Byte) (check >> 8 * i);
+      for (i = 0; i < 4; ++i)
+	*p++ = (Byte) ((uLong) dlen >> 8 * i);
+    } else if (wbits > 0) {
+      *p++ = (Byte) (check >> 24);
+      *p++ = (Byte) (check >> 16);
+      *p++ = (Byte) (check >> 8);
+      *p++ = (Byte) check;
+    }
+  }
+
+  for (i = 0; i < nblocks; ++i)
+    if (blocks[i].out != NULL)
+      Tcl_Free((char*) blocks[i].out);
+  Tcl_Free((char*) blocks);
+  Tcl_Free((char*) workers);
+  return e;
+}
+
+/* largest first buffer for one-shot inflates, if not told the size */
+#define ZINFLATE_GUESS 1048576
+
 static int
 ZlibCmd(ClientData dummy, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
 {
-  int e = TCL_OK, index, dlen, wbits = -MAX_WBITS;
+  int e = TCL_OK, index, dlen, wbits = -MAX_WBITS, threads = 1;
   long flag;
   Byte *data;
   z_stream stream;
@@ -83,16 +485,27 @@ ZlibCmd(ClientData dummy, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
 
   static CONST84 char* cmds[] = {
     "adler32", "crc32", "compress", "deflate", "decompress", "inflate", 
-    "sdecompress", "sinflate", NULL,
+    "sdecompress", "sinflate", "scompress", "sdeflate", NULL,
   };
 
-  if (objc < 3 || objc > 4) {
+  if (objc < 3) {
     Tcl_WrongNumArgs(ip, 1, objv, "option data ?...?");
     return TCL_ERROR;
   }
+  if (Tcl_GetIndexFromObj(ip, objv[1], cmds, "option", 0, &index) != TCL_OK)
+    return TCL_ERROR;
+
+  /* scompress|sdeflate cmdname ?options? -> */
+  if (index >= 8)
+    return zstreamoutcreate(ip, objc, objv, index == 8 ? MAX_WBITS : -MAX_WBITS);
 
-  if (Tcl_GetIndexFromObj(ip, objv[1], cmds, "option", 0, &index) != TCL_OK ||
-      objc > 3 && Tcl_GetLongFromObj(ip, objv[3], &flag) != TCL_OK)
+  /* compress and deflate also take a number of threads */
+  if (objc > (index == 2 || index == 3 ? 5 : 4)) {
+    Tcl_WrongNumArgs(ip, 1, objv, "option data ?...?");
+    return TCL_ERROR;
+  }
+  if ((objc > 3 && Tcl_GetLongFromObj(ip, objv[3], &flag) != TCL_OK) ||
+      (objc > 4 && Tcl_GetIntFromObj(ip, objv[4], &threads) != TCL_OK))
     return TCL_ERROR;
 
   data = Tcl_GetByteArrayFromObj(objv[2], &dlen);
@@ -111,12 +524,19 @@ ZlibCmd(ClientData dummy, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
       Tcl_SetLongObj(obj, (long) crc32((uLong) flag, data, dlen));
       return TCL_OK;
       
-    case 2: /* compress data ?level? -> data */
+    case 2: /* compress data ?level? ?threads? -> data */
       wbits = MAX_WBITS;
-    case 3: /* deflate data ?level? -> data */
+    case 3: /* deflate data ?level? ?threads? -> data */
       if (objc < 4)
       	flag = Z_DEFAULT_COMPRESSION;
 
+      if (threads > 1 && dlen > ZBLOCK_SIZE) {
+	e = zParallelDeflate(obj, data, dlen, (int) flag, wbits, threads);
+	if (e != Z_OK)
+	  break;
+	return TCL_OK;
+      }
+
       stream.avail_in = (uInt) dlen;
       stream.next_in = data;
 
@@ -145,42 +565,47 @@ ZlibCmd(ClientData dummy, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
       wbits = MAX_WBITS;
     case 5: /* inflate data ?bufsize? -> data */
     {
+      /* the exact size avoids resizing, else guess and grow as needed */
       if (objc < 4)
-      	flag = 16 * 1024;
-      if (flag < 1) {
+	flag = dlen < 4 * 1024 ? 16 * 1024 :
+	       dlen < ZINFLATE_GUESS / 4 ? 4 * (long) dlen : ZINFLATE_GUESS;
+      if (flag < 1 || flag > INT_MAX) {
           Tcl_SetResult(ip, "invalid buffer size", TCL_STATIC);
           return TCL_ERROR;
       }
 
-      for (;;) {
-      	stream.zalloc = 0;
-      	stream.zfree = 0;
-
-      	/* +1 because ZLIB can "over-request" input (but ignore it) */
-      	stream.avail_in = (uInt) dlen +  1;
-      	stream.next_in = data;
-
-      	stream.avail_out = (uInt) flag;
-      	Tcl_SetByteArrayLength(obj, stream.avail_out);
-      	stream.next_out = Tcl_GetByteArrayFromObj(obj, NULL);
-
-      	/* Negative value suppresses ZLIB header */
-      	e = inflateInit2(&stream, wbits);
-      	if (e == Z_OK) {
-      	  e = inflate(&stream, Z_FINISH);
-      	  if (e != Z_STREAM_END) {
-      	    inflateEnd(&stream);
-      	    if (e == Z_OK) e = Z_BUF_ERROR;
-      	  } else
-      	    e = inflateEnd(&stream);
-      	}
-
-      	if (e == Z_OK || e != Z_BUF_ERROR) break;
-
-      	Tcl_SetByteArrayLength(obj, 0);
-      	flag *= 2;
+      stream.zalloc = 0;
+      stream.zfree = 0;
+
+      /* +1 because ZLIB can "over-request" input (but ignore it) */
+      stream.avail_in = (uInt) dlen +  1;
+      stream.next_in = data;
+
+      stream.avail_out = (uInt) flag;
+      Tcl_SetByteArrayLength(obj, stream.avail_out);
+      stream.next_out = Tcl_GetByteArrayFromObj(obj, NULL);
+
+      /* Negative value suppresses ZLIB header */
+      e = inflateInit2(&stream, wbits);
+      if (e != Z_OK)
+	break;
+
+      /* continue the same stream in a larger buffer when this one is full */
+      while ((e = inflate(&stream, Z_FINISH)) == Z_BUF_ERROR &&
+	     stream.avail_out == 0) {
+	if (flag > INT_MAX / 2)
+	  break; /* too large for a byte array, report the buffer error */
+	flag *= 2;
+	Tcl_SetByteArrayLength(obj, flag);
+	stream.next_out = Tcl_GetByteArrayFromObj(obj, NULL) + stream.total_out;
+	stream.avail_out = (uInt) (flag - stream.total_out);
       }
 
+      if (e != Z_STREAM_END) {
+	inflateEnd(&stream);
+	if (e == Z_OK) e = Z_BUF_ERROR;
+      } else
+	e = inflateEnd(&stream);
       break;
     }
       
@@ -217,3 +642,492 @@ int Zlib_Init(Tcl_Interp *interp)
     Tcl_CreateObjCommand(interp, "zlib", ZlibCmd, 0, 0);
     return Tcl_PkgProvide( interp, "zlib", "1.1");
 }
+
+/*
+ * Compressed channels, replacing the rechan based vfs::zstream of vfslib:
+ *
+ *   vfs::zstream decompress|inflate chan clen ilen ?-keepopen bool?
+ *   vfs::zstream compress|deflate chan ?-level n? ?-keepopen bool?
+ *
+ * The first returns a read-only channel with the ilen bytes inflated from
+ * the next clen bytes of chan.  While reading it saves the inflate state
+ * about every ZSTREAM_SPAN bytes (as in zlib's examples/zran.c), seeking
+ * resumes from the last of these checkpoints before the new position.
+ * The second returns a write-only channel which compresses what is written
+ * to it into chan.  The compress and decompress modes use a zlib header,
+ * deflate and inflate use raw data without one.
+ * Chan is closed with the new channel, unless -keepopen is set, in which
+ * case it may be used by others, who may also move its access point.
+ */
+
+#define ZSTREAM_BUFSIZE 16384
+#define ZSTREAM_SPAN	1048576	/* inflated bytes between checkpoints */
+#define ZSTREAM_WINDOW	32768
+
+static int zcChanSeq = 0;
+TCL_DECLARE_MUTEX(zcMutex)
+
+typedef struct {
+  Tcl_WideInt out;	/* position in the inflated data */
+  Tcl_WideInt in;	/* offset in ifd of the first byte not fully used */
+  int bits;		/* number of bits of that byte already used */
+  unsigned int wlen;
+  Byte *window;		/* the last wlen inflated bytes */
+} zpoint;
+
+typedef struct {
+  Tcl_Channel chan;
+  Tcl_Channel ifd;	/* channel with the compressed data */
+  int mode;		/* TCL_READABLE or TCL_WRITABLE */
+  int watchMask;
+  Tcl_TimerToken timer;
+  z_stream stream;
+  Tcl_WideInt start;	/* offset of the compressed data in ifd */
+  Tcl_WideInt clen;	/* size of the compressed data */
+  Tcl_WideInt ilen;	/* size of the inflated data */
+  Tcl_WideInt tell;	/* offset in ifd from where to continue reading */
+  Tcl_WideInt pos;	/* position in the inflated data */
+  int wbits;		/* as passed to inflateInit2 */
+  int npoints;
+  zpoint *points;	/* checkpoints, in increasing order */
+  Tcl_WideInt next;	/* where to save the next checkpoint */
+  Byte buf[ZSTREAM_BUFSIZE];
+} zchannel;
+
+/* save the inflate state at a block boundary, returns 0 if out of memory */
+static int
+zcCheckpoint(zchannel *zc, Tcl_WideInt out)
+{
+  zpoint *p;
+
+  if ((zc->npoints & 15) == 0) {
+    p = (zpoint*) Tcl_AttemptRealloc((char*) zc->points,
+				   (zc->npoints + 16) * sizeof (zpoint));
+    if (p == NULL)
+      return 0;
+    zc->points = p;
+  }
+
+  p = zc->points + zc->npoints;
+  p->window = (Byte*) Tcl_AttemptAlloc(ZSTREAM_WINDOW);
+  if (p->window == NULL)
+    return 0;
+  p->wlen = ZSTREAM_WINDOW;
+  inflateGetDictionary(&zc->stream, p->window, &p->wlen);
+  p->out = out;
+  p->bits = zc->stream.data_type & 7;
+  p->in = zc->tell - zc->stream.avail_in;
+
+  ++zc->npoints;
+  zc->next = out + ZSTREAM_SPAN;
+  return 1;
+}
+
+/* read more compressed data, returns its size, 0 at the end, or -1 */
+static int
+zcFill(zchannel *zc)
+{
+  Tcl_WideInt left = zc->start + zc->clen - zc->tell;
+  int n = left < ZSTREAM_BUFSIZE ? (int) left : ZSTREAM_BUFSIZE;
+
+  if (n <= 0)
+    return 0;
+  /* someone else may have moved the access point of a shared channel */
+  if (Tcl_Tell(zc->ifd) != zc->tell && Tcl_Seek(zc->ifd, zc->tell, SEEK_SET) < 0)
+    return -1;
+
+  n = Tcl_Read(zc->ifd, (char*) zc->buf, n);
+  if (n < 0)
+    return -1;
+
+  zc->tell += n;
+  zc->stream.next_in = zc->buf;
+  zc->stream.avail_in = n;
+  return n;
+}
+
+static int
+zcInput(ClientData cd, char *buf, int toRead, int *errorCodePtr)
+{
+  zchannel *zc = (zchannel*) cd;
+  int e = Z_OK, n;
+
+  if (toRead > zc->ilen - zc->pos)
+    toRead = (int) (zc->ilen - zc->pos);
+
+  zc->stream.next_out = (Bytef*) buf;
+  zc->stream.avail_out = toRead;
+
+  while (zc->stream.avail_out > 0 && e != Z_STREAM_END) {
+    Tcl_WideInt out = zc->pos + toRead - zc->stream.avail_out;
+    /* once past the next checkpoint, stop at the end of each block */
+    int flush = out >= zc->next ? Z_BLOCK : Z_NO_FLUSH;
+
+    if (zc->stream.avail_in == 0) {
+      n = zcFill(zc);
+      if (n < 0) {
+	*errorCodePtr = Tcl_GetErrno();
+	return -1;
+      }
+      if (n == 0)
+	break; /* truncated, let it look like the end of the file */
+    }
+    e = inflate(&zc->stream, flush);
+    if (e != Z_OK && e != Z_STREAM_END) {
+      *errorCodePtr = EIO;
+      return -1;
+    }
+    /* end of a block which is not the last one */
+    if (flush == Z_BLOCK && (zc->stream.data_type & 192) == 128 &&
+	!zcCheckpoint(zc, zc->pos + toRead - zc->stream.avail_out))
+      zc->next = zc->ilen; /* no memory, give up on further checkpoints */
+  }
+
+  n = toRead - zc->stream.avail_out;
+  zc->pos += n;
+  return n;
+}
+
+/* pass on compressed data until deflate needs more, or is done if flushed */
+static int
+zcDeflate(zchannel *zc, int flush)
+{
+  int e, n;
+
+  do {
+    zc->stream.next_out = zc->buf;
+    zc->stream.avail_out = ZSTREAM_BUFSIZE;
+    e = deflate(&zc->stream, flush);
+    if (e != Z_OK && e != Z_STREAM_END && e != Z_BUF_ERROR)
+      return EIO;
+
+    n = ZSTREAM_BUFSIZE - zc->stream.avail_out;
+    if (n > 0 && Tcl_Write(zc->ifd, (char*) zc->buf, n) != n)
+      return Tcl_GetErrno();
+  } while (zc->stream.avail_out == 0 ||
+	   (flush == Z_FINISH && e != Z_STREAM_END));
+
+  return 0;
+}
+
+static int
+zcOutput(ClientData cd, const char *buf, int toWrite, int *errorCodePtr)
+{
+  zchannel *zc = (zchannel*) cd;
+
+  zc->stream.next_in = (Bytef*) buf;
+  zc->stream.avail_in = toWrite;
+
+  *errorCodePtr = zcDeflate(zc, Z_NO_FLUSH);
+  if (*errorCodePtr != 0)
+    return -1;
+
+  zc->pos += toWrite;
+  return toWrite;
+}
+
+/* continue inflating from a checkpoint, or from the start if p is NULL */
+static int
+zcRestore(zchannel *zc, zpoint *p)
+{
+  zc->stream.avail_in = 0;
+  if (p == NULL) {
+    inflateReset2(&zc->stream, zc->wbits);
+    zc->tell = zc->start;
+    zc->pos = 0;
+    return 0;
+  }
+
+  /* resumes in the middle of the data, where there is no header */
+  inflateReset2(&zc->stream, -MAX_WBITS);
+  zc->tell = p->in - (p->bits ? 1 : 0);
+  if (p->bits) {
+    if (zcFill(zc) <= 0)
+      return -1;
+    inflatePrime(&zc->stream, p->bits,
+		 zc->stream.next_in[0] >> (8 - p->bits));
+    ++zc->stream.next_in;
+    --zc->stream.avail_in;
+  }
+  inflateSetDictionary(&zc->stream, p->window, p->wlen);
+  zc->pos = p->out;
+  return 0;
+}
+
+static Tcl_WideInt
+zcWideSeek(ClientData cd, Tcl_WideInt offset, int seekMode, int *errorCodePtr)
+{
+  zchannel *zc = (zchannel*) cd;
+  Tcl_WideInt want = offset;
+  char skip[ZSTREAM_BUFSIZE];
+  int i;
+
+  switch (seekMode) {
+    case SEEK_CUR: want += zc->pos; break;
+    case SEEK_END: want += zc->ilen; break;
+  }
+
+  /* compressed output can only report its position */
+  if (zc->mode == TCL_WRITABLE ? want != zc->pos : want < 0 || want > zc->ilen) {
+    *errorCodePtr = EINVAL;
+    return -1;
+  }
+
+  /* resume from the last checkpoint before want, if that skips ahead */
+  for (i = zc->npoints; i > 0 && zc->points[i-1].out > want; --i)
+    ;
+  if (want < zc->pos || (i > 0 && zc->points[i-1].out > zc->pos)) {
+    if (zcRestore(zc, i > 0 ? zc->points + i - 1 : NULL) < 0) {
+      *errorCodePtr = Tcl_GetErrno();
+      return -1;
+    }
+  }
+
+  /* consume data while not yet at seek position */
+  while (zc->pos < want) {
+    int n = want - zc->pos < sizeof skip ? (int) (want - zc->pos) : sizeof skip;
+    n = zcInput(cd, skip, n, errorCodePtr);
+    if (n <= 0) {
+      if (n == 0)
+	*errorCodePtr = EIO;
+      return -1;
+    }
+  }
+
+  return zc->pos;
+}
+
+/* only used by cores without wide seeks, or if they can't be reported */
+static int
+zcSeek(ClientData cd, long offset, int seekMode, int *errorCodePtr)
+{
+  zchannel *zc = (zchannel*) cd;
+  Tcl_WideInt want = offset;
+
+  switch (seekMode) {
+    case SEEK_CUR: want += zc->pos; break;
+    case SEEK_END: want += zc->ilen; break;
+  }
+  if (want != (long) want) {
+    *errorCodePtr = EINVAL;
+    return -1;
+  }
+
+  return (long) zcWideSeek(cd, want, SEEK_SET, errorCodePtr);
+}
+
+static int
+zcClose(ClientData cd, Tcl_Interp *interp)
+{
+  zchannel *zc = (zchannel*) cd;
+  int e = 0;
+
+  if (zc->mode == TCL_WRITABLE) {
+    zc->stream.avail_in = 0;
+    e = zcDeflate(zc, Z_FINISH);
+    deflateEnd(&zc->stream);
+  } else
+    inflateEnd(&zc->stream);
+
+  while (--zc->npoints >= 0)
+    Tcl_Free((char*) zc->points[zc->npoints].window);
+  if (zc->points != NULL)
+    Tcl_Free((char*) zc->points);
+
+  if (zc->timer != NULL)
+    Tcl_DeleteTimerHandler(zc->timer);
+
+  /* drops our reference, this closes chan unless -keepopen was used */
+  Tcl_UnregisterChannel(NULL, zc->ifd);
+  Tcl_Free((char*) zc);
+  return e;
+}
+
+static void
+zcTimerProc(ClientData cd)
+{
+  zchannel *zc = (zchannel*) cd;
+
+  zc->timer = NULL;
+  Tcl_NotifyChannel(zc->chan, zc->watchMask);
+}
+
+static void
+zcWatchChannel(ClientData cd, int mask)
+{
+  zchannel *zc = (zchannel*) cd;
+
+  /* data is always at hand, so report readiness right away */
+  zc->watchMask = mask & zc->mode;
+  if (zc->watchMask && zc->timer == NULL)
+    zc->timer = Tcl_CreateTimerHandler(0, zcTimerProc, cd);
+  else if (!zc->watchMask && zc->timer != NULL) {
+    Tcl_DeleteTimerHandler(zc->timer);
+    zc->timer = NULL;
+  }
+}
+
+static int
+zcGetFile(ClientData cd, int direction, ClientData *handlePtr)
+{
+  return TCL_ERROR;
+}
+
+static Tcl_ChannelType zcChannelType = {
+  "zstream",      /* Type name.                                    */
+  TCL_CHANNEL_VERSION_2, /* Version, for the wide seek below       */
+  zcClose,        /* Close channel, clean instance data            */
+  zcInput,        /* Handle read request                           */
+  zcOutput,       /* Handle write request                          */
+  zcSeek,         /* Move location of access point.    NULL'able   */
+  0,              /* Set options.                      NULL'able   */
+  0,              /* Get options.                      NULL'able   */
+  zcWatchChannel, /* Initialize notifier                           */
+  zcGetFile,      /* Get OS handle from the channel.               */
+  0,              /* Close with direction.             NULL'able   */
+  0,              /* Set blocking mode (version 2).    NULL'able   */
+  0,              /* Flush.                            NULL'able   */
+  0,              /* Handle events.                    NULL'able   */
+  zcWideSeek      /* Move to a 64-bit position.        NULL'able   */
+};
+
+static int
+ZstreamCmd(ClientData dummy, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
+{
+  int index, mode, i, e, keepopen = 0, level = Z_DEFAULT_COMPRESSION;
+  Tcl_WideInt clen = 0, ilen = 0;
+  Tcl_Channel ifd;
+  zchannel *zc;
+  char buffer[20];
+
+  static CONST84 char* cmds[] = {
+    "compress", "decompress", "deflate", "inflate", NULL,
+  };
+  static CONST84 char* opts[] = { "-keepopen", "-level", NULL, };
+
+  if (objc < 3) {
+    Tcl_WrongNumArgs(ip, 1, objv, "mode channel ?clen ilen? ?options?");
+    return TCL_ERROR;
+  }
+  if (Tcl_GetIndexFromObj(ip, objv[1], cmds, "mode", 0, &index) != TCL_OK)
+    return TCL_ERROR;
+
+  mode = index & 1 ? TCL_READABLE : TCL_WRITABLE;
+  ifd = Tcl_GetChannel(ip, Tcl_GetString(objv[2]), NULL);
+  if (ifd == NULL)
+    return TCL_ERROR;
+
+  i = 3;
+  if (mode == TCL_READABLE) {
+    if (objc < 5) {
+      Tcl_WrongNumArgs(ip, 2, objv, "channel clen ilen ?options?");
+      return TCL_ERROR;
+    }
+    if (Tcl_GetWideIntFromObj(ip, objv[3], &clen) != TCL_OK ||
+	Tcl_GetWideIntFromObj(ip, objv[4], &ilen) != TCL_OK)
+      return TCL_ERROR;
+    i = 5;
+  }
+
+  for (; i < objc; i += 2) {
+    int opt;
+    if (Tcl_GetIndexFromObj(ip, objv[i], opts, "option", 0, &opt) != TCL_OK)
+      return TCL_ERROR;
+    if (i + 1 >= objc) {
+      Tcl_AppendResult(ip, "value for \"", Tcl_GetString(objv[i]),
+		       "\" missing", NULL);
+      return TCL_ERROR;
+    }
+    if ((opt == 0 ? Tcl_GetBooleanFromObj(ip, objv[i+1], &keepopen)
+		  : Tcl_GetIntFromObj(ip, objv[i+1], &level)) != TCL_OK)
+      return TCL_ERROR;
+  }
+
+  if (Tcl_SetChannelOption(ip, ifd, "-translation", "binary") != TCL_OK)
+    return TCL_ERROR;
+
+  zc = (zchannel*) Tcl_Alloc(sizeof (zchannel));
+  memset(zc, 0, sizeof (zchannel));
+  zc->mode = mode;
+  zc->ifd = ifd;
+  zc->start = zc->tell = Tcl_Tell(ifd);
+  zc->clen = clen;
+  zc->ilen = ilen;
+  zc->next = ZSTREAM_SPAN;
+
+  /* negative window bits suppress the zlib header */
+  zc->wbits = index < 2 ? MAX_WBITS : -MAX_WBITS;
+  if (mode == TCL_READABLE)
+    e = inflateInit2(&zc->stream, zc->wbits);
+  else
+    e = deflateInit2(&zc->stream, level, Z_DEFLATED,
+		     index < 2 ? MAX_WBITS : -MAX_WBITS,
+		     MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+  if (e != Z_OK) {
+    Tcl_Free((char*) zc);
+    Tcl_SetResult(ip, (char*) zError(e), TCL_STATIC);
+    return TCL_ERROR;
+  }
+
+  Tcl_MutexLock(&zcMutex);
+  sprintf(buffer, "zstream%d", ++zcChanSeq);
+  Tcl_MutexUnlock(&zcMutex);
+
+  zc->chan = Tcl_CreateChannel(&zcChannelType, buffer, (ClientData) zc, mode);
+  Tcl_RegisterChannel(ip, zc->chan);
+
+  /* keep chan alive, and unless it is shared, take it over from the interp */
+  Tcl_RegisterChannel(NULL, ifd);
+  if (!keepopen)
+    Tcl_UnregisterChannel(ip, ifd);
+
+  Tcl_SetResult(ip, buffer, TCL_VOLATILE);
+  return TCL_OK;
+}
+
+/*
+ * One-shot compression in parallel, also for kits using the 8.6 core zlib:
+ *
+ *   vfs::zcompress compress|deflate|gzip data ?level? ?threads?
+ *
+ * Returns the same format as "zlib compress", "zlib deflate" or the 8.6
+ * "zlib gzip", the gzip header has no file name and a zero time.
+ */
+
+static int
+ZcompressCmd(ClientData dummy, Tcl_Interp *ip, int objc, Tcl_Obj *CONST objv[])
+{
+  int index, dlen, e, level = Z_DEFAULT_COMPRESSION, threads = 1;
+  Byte *data;
+  Tcl_Obj *obj;
+
+  static CONST84 char* cmds[] = { "compress", "deflate", "gzip", NULL, };
+  static int wbits[] = { MAX_WBITS, -MAX_WBITS, MAX_WBITS + 16, };
+
+  if (objc < 3 || objc > 5) {
+    Tcl_WrongNumArgs(ip, 1, objv, "mode data ?level? ?threads?");
+    return TCL_ERROR;
+  }
+  if (Tcl_GetIndexFromObj(ip, objv[1], cmds, "mode", 0, &index) != TCL_OK ||
+      (objc > 3 && Tcl_GetIntFromObj(ip, objv[3], &level) != TCL_OK) ||
+      (objc > 4 && Tcl_GetIntFromObj(ip, objv[4], &threads) != TCL_OK))
+    return TCL_ERROR;
+
+  data = Tcl_GetByteArrayFromObj(objv[2], &dlen);
+  obj = Tcl_NewObj();
+  e = zParallelDeflate(obj, data, dlen, level, wbits[index], threads);
+  if (e != Z_OK) {
+    Tcl_DecrRefCount(obj);
+    Tcl_SetResult(ip, (char*) zError(e), TCL_STATIC);
+    return TCL_ERROR;
+  }
+  Tcl_SetObjResult(ip, obj);
+  return TCL_OK;
+}
+
+int Zstream_Init(Tcl_Interp *interp)
+{
+    Tcl_CreateObjCommand(interp, "vfs::zstream", ZstreamCmd, 0, 0);
+    Tcl_CreateObjCommand(interp, "vfs::zcompress", ZcompressCmd, 0, 0);
+    return Tcl_PkgProvide(interp, "zstream", "1.0");
+}